@@ -0,0 +1,514 @@
+/*-----------------------------------------------------------------------------
+* Measures the scanner on one or more corpus files, such as those written by
+* generateCorpus, and writes the results to a JSON report.
+*
+* The scanner is compiled into this program (with SCANNER_LIBRARY defined,
+* so its main function is left out), which lets the hot paths be timed on
+* their own as well as the whole scan:
+*
+*   buildToken       - lexing every token of the corpus, without IDs
+*   assignID         - looking up the ID of each sampled token
+*   getHash          - hashing each sampled identifier
+*   searchForSymbol  - finding each sampled identifier in a symbol table
+*                      holding all of them, frozen as it is after BEGIN
+*   printToken       - appending each sampled token to the listing buffer
+*
+* The end-to-end figures time what the program does for one input file: it
+* is opened, scanned with the default lexer, the table-driven lexer, or in
+* split chunks, and its listing is written to the null device. Each figure
+* is the best of several repetitions, and is given in seconds together with
+* MB/s and tokens/s (or nanoseconds per operation for the microbenchmarks).
+-----------------------------------------------------------------------------*/
+#define SCANNER_LIBRARY
+#include "../scanner.c"
+
+#include <time.h>
+
+#define SAMPLE_TOKENS (1 << 20)
+#define MICRO_COUNT 5
+#define MODE_COUNT 3
+#ifdef SCANNER_POSIX
+#define NULL_DEVICE "/dev/null"
+#else
+#define NULL_DEVICE "NUL"
+#endif
+
+typedef struct
+{
+	const char *name;
+	double seconds;
+	double operations;
+} measurement;
+
+/* Everything measured for one corpus file */
+typedef struct
+{
+	char *filename;
+	size_t length;
+	long lineCount;
+	long tokenCount;
+	int sampleCount;
+	int identifierCount;
+	measurement micro[MICRO_COUNT];
+	measurement endToEnd[MODE_COUNT];
+} corpusResult;
+
+bool benchmarkCorpus(tokenTable *table, char *filename, int repetitions, corpusResult *result);
+double getSeconds();
+void keepFastest(measurement *best, const char *name, double seconds, double operations);
+double lexCorpus(scannerContext *context, token *sample, int *sampleCount, long *tokenCount);
+double scanCorpus(tokenTable *table, char *filename, scanOptions *options);
+void writeReport(FILE *reportFile, char *label, int repetitions, corpusResult *results, int resultCount);
+
+/*-----------------------------------------------------------------------------
+* The main program reads the options, loads the token table, benchmarks
+* each corpus file named on the command line, prints a summary line for each
+* measurement, and writes the JSON report.
+-----------------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+{
+    int repetitions = 5;
+    char *reportFilename = "benchmark.json";
+    char *tokenTableFilename = NULL;
+    char *label = "";
+    char **corpusFilenames = malloc(argc * sizeof(char *));
+    int corpusCount = 0;
+
+    int arg = 1;
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "-r") == 0 && arg + 1 < argc &&
+            atoi(argv[arg + 1]) > 0)
+        {
+            arg++;
+            repetitions = atoi(argv[arg]);
+        }
+        else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            reportFilename = argv[arg];
+        }
+        else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            tokenTableFilename = argv[arg];
+        }
+        else if (strcmp(argv[arg], "-l") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            label = argv[arg];
+        }
+        else if (argv[arg][0] != '-')
+        {
+            corpusFilenames[corpusCount] = argv[arg];
+            corpusCount++;
+        }
+        else
+        {
+            corpusCount = 0;
+            break;
+        }
+    }
+
+    if (corpusCount == 0)
+    {
+        printf("Usage: %s [-r repetitions] [-o report.json] [-t tokenTable] "
+               "[-l label] corpusFile ...\n", argv[0]);
+        exit(1);
+    }
+
+    tokenTable *table = tokenTableFilename != NULL 
+                      ? scanner_load_token_table(tokenTableFilename) 
+                      : scanner_builtin_token_table();
+    if (table == NULL)
+    {
+        printf("Error: %s could not be loaded.\n", 
+               tokenTableFilename != NULL ? tokenTableFilename : "Token table");
+        exit(1);
+    }
+
+    corpusResult *results = calloc(corpusCount, sizeof(corpusResult));
+    if (results == NULL)
+    {
+        printf("Error: Results could not be allocated.\n");
+        exit(1);
+    }
+
+    int i = 0;
+    for (i = 0; i < corpusCount; i++)
+    {
+        if (benchmarkCorpus(table, corpusFilenames[i], repetitions,
+                            &results[i]) == false)
+        {
+            printf("Error: %s could not be benchmarked.\n", corpusFilenames[i]);
+            exit(1);
+        }
+
+        int j = 0;
+        for (j = 0; j < MICRO_COUNT; j++)
+        {
+            measurement *micro = &results[i].micro[j];
+            printf("%s\t%-16s\t%10.2f ns/op\n", corpusFilenames[i], micro->name,
+                   micro->seconds * 1e9 / micro->operations);
+        }
+        for (j = 0; j < MODE_COUNT; j++)
+        {
+            measurement *mode = &results[i].endToEnd[j];
+            printf("%s\t%-16s\t%10.2f MB/s\t%12.0f tokens/s\n",
+                   corpusFilenames[i], mode->name,
+                   results[i].length / mode->seconds / 1e6,
+                   results[i].tokenCount / mode->seconds);
+        }
+    }
+
+    FILE *reportFile = fopen(reportFilename, "w");
+    if (reportFile == NULL)
+    {
+        printf("Error: %s could not be opened.\n", reportFilename);
+        exit(1);
+    }
+    writeReport(reportFile, label, repetitions, results, corpusCount);
+    if (fclose(reportFile) != 0)
+    {
+        printf("Error: %s could not be written.\n", reportFilename);
+        exit(1);
+    }
+    printf("Report stored in %s\n", reportFilename);
+
+    free(results);
+    free(corpusFilenames);
+    scanner_free_token_table(table);
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+* benchmarkCorpus function:
+* Input: a pointer to a tokenTable object, a pointer to a character
+*   containing the corpus file name, the number of repetitions, and a
+*   pointer to a corpusResult object to fill in
+* Output: a boolean that is false if the corpus could not be read
+* Purpose: Runs every microbenchmark and end-to-end scan on one corpus,
+*   keeping the fastest of the repetitions of each. The microbenchmarks
+*   after buildToken work on the first SAMPLE_TOKENS tokens of the corpus,
+*   so their memory use does not grow with the corpus.
+-----------------------------------------------------------------------------*/
+
+bool benchmarkCorpus(tokenTable *table, char *filename, int repetitions,
+                     corpusResult *result)
+{
+    source corpus;
+    if (openSource(filename, &corpus) == false)
+    {
+        return false;
+    }
+
+    token *sample = malloc(SAMPLE_TOKENS * sizeof(token));
+    token *identifiers = malloc(SAMPLE_TOKENS * sizeof(token));
+    outputBuffer output;
+    FILE *nullFile = fopen(NULL_DEVICE, "w");
+    if (sample == NULL || identifiers == NULL || nullFile == NULL)
+    {
+        closeSource(&corpus);
+        return false;
+    }
+
+    memset(result, 0, sizeof(corpusResult));
+    result->filename = filename;
+    result->length = corpus.length;
+    size_t position = 0;
+    for (position = 0; position < corpus.length; position++)
+    {
+        result->lineCount = result->lineCount + (corpus.buffer[position] == '\n');
+    }
+
+    scanOptions options;
+    memset(&options, 0, sizeof(options));
+    const char *modeNames[MODE_COUNT] = { "default", "table-driven", "split" };
+
+    int repetition = 0;
+    for (repetition = 0; repetition < repetitions; repetition++)
+    {
+        /*
+        * Lexing, which also collects the sample. The context is kept until
+        * the sampled tokens, which point into its copy of the corpus, are used.
+        */
+        scannerContext *lexer = scanner_create(table, corpus.buffer, corpus.length);
+        if (lexer == NULL)
+        {
+            break;
+        }
+        double seconds = lexCorpus(lexer, sample, &result->sampleCount,
+                                   &result->tokenCount);
+        keepFastest(&result->micro[0], "buildToken", seconds, result->tokenCount);
+
+        int i = 0;
+        double start = getSeconds();
+        for (i = 0; i < result->sampleCount; i++)
+        {
+            assignID(table, &sample[i]);
+        }
+        keepFastest(&result->micro[1], "assignID", getSeconds() - start,
+                    result->sampleCount);
+
+        result->identifierCount = 0;
+        for (i = 0; i < result->sampleCount; i++)
+        {
+            if (sample[i].ID == table->idID)
+            {
+                identifiers[result->identifierCount] = sample[i];
+                result->identifierCount++;
+            }
+        }
+
+        /* The sum keeps the hashes from being optimized away */
+        volatile unsigned int hashSum = 0;
+        start = getSeconds();
+        for (i = 0; i < result->identifierCount; i++)
+        {
+            hashSum = hashSum + getHash(&identifiers[i]);
+        }
+        keepFastest(&result->micro[2], "getHash", getSeconds() - start,
+                    result->identifierCount);
+
+        scannerContext context;
+        initContext(&context, table, NULL, false);
+        for (i = 0; i < result->identifierCount; i++)
+        {
+            addSymbol(&context, &identifiers[i]);
+        }
+        freezeSymbolTable(&context.symTable);
+        volatile int found = 0;
+        start = getSeconds();
+        for (i = 0; i < result->identifierCount; i++)
+        {
+            found = found + searchForSymbol(&identifiers[i], &context.symTable);
+        }
+        keepFastest(&result->micro[3], "searchForSymbol", getSeconds() - start,
+                    result->identifierCount);
+        freeSymbolTable(&context.symTable);
+
+        if (openOutput(&output, nullFile) == false)
+        {
+            scanner_destroy(lexer);
+            break;
+        }
+        start = getSeconds();
+        for (i = 0; i < result->sampleCount; i++)
+        {
+            printToken(&output, table, &sample[i]);
+        }
+        closeOutput(&output);
+        keepFastest(&result->micro[4], "printToken", getSeconds() - start,
+                    result->sampleCount);
+        scanner_destroy(lexer);
+
+        /* Whole scans of the file, as the program would do them */
+        int mode = 0;
+        for (mode = 0; mode < MODE_COUNT; mode++)
+        {
+            options.tableDriven = mode == 1;
+            options.splitInput = mode == 2;
+            seconds = scanCorpus(table, filename, &options);
+            if (seconds < 0)
+            {
+                break;
+            }
+            keepFastest(&result->endToEnd[mode], modeNames[mode], seconds,
+                        corpus.length);
+        }
+        if (mode < MODE_COUNT)
+        {
+            break;
+        }
+    }
+
+    fclose(nullFile);
+    free(identifiers);
+    free(sample);
+    closeSource(&corpus);
+    return repetition == repetitions;
+}
+
+/*-----------------------------------------------------------------------------
+* getSeconds function:
+* Input: None
+* Output: the current time in seconds
+* Purpose: Reads a monotonic clock where the platform has one, and the
+*   processor clock otherwise. Only differences between readings are used.
+-----------------------------------------------------------------------------*/
+
+double getSeconds()
+{
+#ifdef SCANNER_POSIX
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+* keepFastest function:
+* Input: a pointer to the best measurement so far, the measurement's name,
+*   the seconds taken by this repetition, and the operations it performed
+* Output: void
+* Purpose: Keeps this repetition's time if it is the first or the fastest.
+-----------------------------------------------------------------------------*/
+
+void keepFastest(measurement *best, const char *name, double seconds,
+                 double operations)
+{
+    if (best->name == NULL || seconds < best->seconds)
+    {
+        best->name = name;
+        best->seconds = seconds;
+        best->operations = operations;
+    }
+}
+
+/*-----------------------------------------------------------------------------
+* lexCorpus function:
+* Input: a pointer to a new scannerContext object for the corpus, an array
+*   for the sample of tokens and a pointer to its count, and a pointer to
+*   the number of tokens
+* Output: the seconds taken
+* Purpose: Times buildToken over the whole corpus, indexing its lines and
+*   skipping blanks as getToken does but leaving out assignID, the line
+*   lookups and the symbol checks. The first SAMPLE_TOKENS tokens are kept
+*   for the other microbenchmarks.
+-----------------------------------------------------------------------------*/
+
+double lexCorpus(scannerContext *context, token *sample, int *sampleCount,
+                 long *tokenCount)
+{
+    *sampleCount = 0;
+    *tokenCount = 0;
+
+    double start = getSeconds();
+    indexLines(context);
+    while (!endOfSource(context))
+    {
+        if (skipBlanks(context) == false)
+        {
+            break;
+        }
+
+        size_t offset = context->input.position;
+        token currentToken = buildToken(context);
+        currentToken.offset = offset;
+        currentToken.lineNumber = 0;
+        currentToken.column = 0;
+        if (*sampleCount < SAMPLE_TOKENS)
+        {
+            sample[*sampleCount] = currentToken;
+            *sampleCount = *sampleCount + 1;
+        }
+        *tokenCount = *tokenCount + 1;
+    }
+    return getSeconds() - start;
+}
+
+/*-----------------------------------------------------------------------------
+* scanCorpus function:
+* Input: a pointer to a tokenTable object, a pointer to a character
+*   containing the corpus file name, and a pointer to the scan options
+* Output: the seconds taken, or a negative number if the scan failed
+* Purpose: Times one whole scan of the file as the program does it: loading
+*   the input, scanning it, and writing the listing, here to the null device.
+-----------------------------------------------------------------------------*/
+
+double scanCorpus(tokenTable *table, char *filename, scanOptions *options)
+{
+    FILE *outputFile = fopen(NULL_DEVICE, "w");
+    if (outputFile == NULL)
+    {
+        return -1;
+    }
+
+    double start = getSeconds();
+    source input;
+    bool written = false;
+    if (openSource(filename, &input) == true)
+    {
+        written = scanSource(table, &input, outputFile, options);
+        closeSource(&input);
+    }
+    double seconds = getSeconds() - start;
+
+    fclose(outputFile);
+    return written == true ? seconds : -1;
+}
+
+/*-----------------------------------------------------------------------------
+* writeReport function:
+* Input: a pointer to the report file, a label for the run, the number of
+*   repetitions, and the results for each corpus and their count
+* Output: void
+* Purpose: Writes the results as one JSON object. Each corpus lists its size
+*   and token counts, the microbenchmarks in seconds and nanoseconds per
+*   operation, and the end-to-end scans in seconds, MB/s and tokens/s.
+-----------------------------------------------------------------------------*/
+
+void writeReport(FILE *reportFile, char *label, int repetitions,
+                 corpusResult *results, int resultCount)
+{
+    fprintf(reportFile, "{\n  \"label\": \"");
+    char *letter = label;
+    for (letter = label; *letter != '\0'; letter++)
+    {
+        if (*letter == '"' || *letter == '\\')
+        {
+            fputc('\\', reportFile);
+        }
+        fputc(*letter, reportFile);
+    }
+    fprintf(reportFile, "\",\n  \"repetitions\": %d,\n  \"corpora\": [",
+            repetitions);
+
+    int i = 0;
+    for (i = 0; i < resultCount; i++)
+    {
+        corpusResult *result = &results[i];
+        fprintf(reportFile, "%s\n    {\n      \"file\": \"", i > 0 ? "," : "");
+        for (letter = result->filename; *letter != '\0'; letter++)
+        {
+            if (*letter == '"' || *letter == '\\')
+            {
+                fputc('\\', reportFile);
+            }
+            fputc(*letter, reportFile);
+        }
+        fprintf(reportFile, "\",\n      \"bytes\": %lu,\n      \"lines\": %ld,\n"
+                "      \"tokens\": %ld,\n      \"sampledTokens\": %d,\n"
+                "      \"sampledIdentifiers\": %d,\n      \"micro\": {",
+                (unsigned long)result->length, result->lineCount,
+                result->tokenCount, result->sampleCount, result->identifierCount);
+
+        int j = 0;
+        for (j = 0; j < MICRO_COUNT; j++)
+        {
+            measurement *micro = &result->micro[j];
+            fprintf(reportFile, "%s\n        \"%s\": { \"seconds\": %.9f, "
+                    "\"operations\": %.0f, \"nsPerOperation\": %.3f }",
+                    j > 0 ? "," : "", micro->name, micro->seconds,
+                    micro->operations,
+                    micro->operations > 0 ? micro->seconds * 1e9 / micro->operations : 0);
+        }
+
+        fprintf(reportFile, "\n      },\n      \"endToEnd\": {");
+        for (j = 0; j < MODE_COUNT; j++)
+        {
+            measurement *mode = &result->endToEnd[j];
+            fprintf(reportFile, "%s\n        \"%s\": { \"seconds\": %.9f, "
+                    "\"mbPerSecond\": %.3f, \"tokensPerSecond\": %.0f }",
+                    j > 0 ? "," : "", mode->name, mode->seconds,
+                    result->length / mode->seconds / 1e6,
+                    result->tokenCount / mode->seconds);
+        }
+        fprintf(reportFile, "\n      }\n    }");
+    }
+
+    fprintf(reportFile, "\n  ]\n}\n");
+}
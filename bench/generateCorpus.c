@@ -0,0 +1,414 @@
+/*-----------------------------------------------------------------------------
+* Writes a synthetic Simplified Pascal program for benchmarking the scanner.
+*
+* The program is built from a seeded random number generator, so the same
+* profile, size and seed always give the same bytes on every platform. It
+* has the usual shape: a PROGRAM line, a VAR section of declarations, and a
+* BEGIN ... END. block of statements that use the declared identifiers. The
+* profile decides what the program is mostly made of:
+*
+*   declarations - most of the size is spent declaring unique identifiers
+*   comments     - statements are interleaved with one- and multi-line comments
+*   identifiers  - every identifier is the full 12 characters long
+*   integers     - expressions are full of long integer literals
+*   mixed        - an even blend of all of the above
+*
+* Sizes may be given in bytes or with a K, M or G suffix, so corpora from a
+* few kilobytes to several gigabytes can be produced. Output is written to
+* the named file, or to standard output.
+-----------------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_DECLARATIONS 0
+#define PROFILE_COMMENTS 1
+#define PROFILE_IDENTIFIERS 2
+#define PROFILE_INTEGERS 3
+#define PROFILE_MIXED 4
+#define MAX_LINE_LENGTH 256
+#define NAME_LENGTH 12
+#define WRITE_BLOCK_SIZE (1 << 20)
+
+typedef struct
+{
+	int profile;
+	uint64_t state;
+	uint64_t declared;
+	uint64_t written;
+	char *block;
+	size_t blockLength;
+	FILE *outputFile;
+} generator;
+
+void appendLine(generator *gen, char *line, int length);
+void buildComment(generator *gen, char *line, int *length);
+void buildDeclaration(generator *gen, char *line, int *length);
+void buildStatement(generator *gen, char *line, int *length);
+void flushBlock(generator *gen);
+int getNameLength(generator *gen);
+void getIdentifier(uint64_t number, char *name, int length);
+void getInteger(generator *gen, char *digits, int *length);
+uint64_t getRandom(generator *gen);
+bool parseSize(char *text, uint64_t *size);
+
+/*-----------------------------------------------------------------------------
+* The main program reads the profile, size and seed, writes the program
+* header and declarations, then statements until the requested size is
+* reached, and finally the END. that closes the program.
+-----------------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+{
+    char *profiles[] = { "declarations", "comments", "identifiers",
+                         "integers", "mixed" };
+    uint64_t size = 0;
+
+    generator gen;
+    memset(&gen, 0, sizeof(gen));
+    gen.profile = -1;
+
+    int i = 0;
+    for (i = 0; i < 5 && argc >= 4; i++)
+    {
+        if (strcmp(argv[1], profiles[i]) == 0)
+        {
+            gen.profile = i;
+        }
+    }
+
+    if (argc < 4 || argc > 5 || gen.profile < 0 ||
+        parseSize(argv[2], &size) == false)
+    {
+        printf("Usage: %s declarations|comments|identifiers|integers|mixed "
+               "size[K|M|G] seed [outputFile]\n", argv[0]);
+        exit(1);
+    }
+
+    /* splitmix64 turns any seed, including 0, into a usable state */
+    gen.state = strtoull(argv[3], NULL, 10) + 0x9E3779B97F4A7C15ull;
+    gen.state = (gen.state ^ (gen.state >> 30)) * 0xBF58476D1CE4E5B9ull;
+    gen.state = (gen.state ^ (gen.state >> 27)) * 0x94D049BB133111EBull;
+    gen.state = gen.state ^ (gen.state >> 31);
+    if (gen.state == 0)
+    {
+        gen.state = 1;
+    }
+
+    gen.outputFile = stdout;
+    if (argc == 5 && (gen.outputFile = fopen(argv[4], "wb")) == NULL)
+    {
+        printf("Error: %s could not be opened.\n", argv[4]);
+        exit(1);
+    }
+
+    gen.block = malloc(WRITE_BLOCK_SIZE);
+    if (gen.block == NULL)
+    {
+        printf("Error: Output buffer could not be allocated.\n");
+        exit(1);
+    }
+
+    /* Declarations take most of the size in that profile, a tenth otherwise */
+    char line[MAX_LINE_LENGTH];
+    int length = 0;
+    uint64_t declarationBytes = gen.profile == PROFILE_DECLARATIONS
+                              ? size - size / 5 : size / 10;
+
+    appendLine(&gen, "PROGRAM BENCHMARK;\n", 19);
+    appendLine(&gen, "VAR\n", 4);
+    do
+    {
+        buildDeclaration(&gen, line, &length);
+        appendLine(&gen, line, length);
+    } while (gen.written < declarationBytes);
+
+    appendLine(&gen, "BEGIN\n", 6);
+    while (gen.written + 5 < size)
+    {
+        buildStatement(&gen, line, &length);
+        appendLine(&gen, line, length);
+    }
+    appendLine(&gen, "END.\n", 5);
+
+    flushBlock(&gen);
+    free(gen.block);
+    if (gen.outputFile != stdout && fclose(gen.outputFile) != 0)
+    {
+        printf("Error: %s could not be written.\n", argv[4]);
+        exit(1);
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+* appendLine function:
+* Input: a pointer to a generator object, a pointer to a line and its length
+* Output: void
+* Purpose: Adds a line to the output block, writing the block out when it
+*   is full, and counts the bytes written.
+-----------------------------------------------------------------------------*/
+
+void appendLine(generator *gen, char *line, int length)
+{
+    if (gen->blockLength + length > WRITE_BLOCK_SIZE)
+    {
+        flushBlock(gen);
+    }
+
+    memcpy(gen->block + gen->blockLength, line, length);
+    gen->blockLength = gen->blockLength + length;
+    gen->written = gen->written + length;
+}
+
+/*-----------------------------------------------------------------------------
+* buildComment function:
+* Input: a pointer to a generator object, a pointer to a line, and a pointer
+*   to its length
+* Output: void
+* Purpose: Builds a comment of a few words. Some comments are left open at
+*   the end of the line and closed at the start of the next one, so the
+*   scanner has to follow them across lines.
+-----------------------------------------------------------------------------*/
+
+void buildComment(generator *gen, char *line, int *length)
+{
+    char *words[] = { "TOTAL", "LOOP", "CHECK", "VALUE", "UPDATE", "THE",
+                      "COUNT", "OF", "ITEMS", "READ", "BEFORE", "WRITING" };
+
+    int position = sprintf(line, "    (* ");
+    int count = 2 + (int)(getRandom(gen) % 8);
+    int i = 0;
+    for (i = 0; i < count; i++)
+    {
+        position += sprintf(line + position, "%s ", words[getRandom(gen) % 12]);
+    }
+
+    if (getRandom(gen) % 4 == 0)
+    {
+        position += sprintf(line + position, "\n       CONTINUED ");
+    }
+    position += sprintf(line + position, "*)\n");
+    *length = position;
+}
+
+/*-----------------------------------------------------------------------------
+* buildDeclaration function:
+* Input: a pointer to a generator object, a pointer to a line, and a pointer
+*   to its length
+* Output: void
+* Purpose: Builds a line declaring a few new, unique identifiers as INTEGER.
+-----------------------------------------------------------------------------*/
+
+void buildDeclaration(generator *gen, char *line, int *length)
+{
+    int position = sprintf(line, "    ");
+    int count = 1 + (int)(getRandom(gen) % 6);
+
+    int i = 0;
+    for (i = 0; i < count; i++)
+    {
+        char name[NAME_LENGTH + 1];
+        getIdentifier(gen->declared, name, getNameLength(gen));
+        gen->declared = gen->declared + 1;
+        position += sprintf(line + position, i == 0 ? "%s" : ", %s", name);
+    }
+
+    position += sprintf(line + position, " : INTEGER;\n");
+    *length = position;
+}
+
+/*-----------------------------------------------------------------------------
+* buildStatement function:
+* Input: a pointer to a generator object, a pointer to a line, and a pointer
+*   to its length
+* Output: void
+* Purpose: Builds one statement using declared identifiers: an assignment,
+*   a FOR loop header, a READ or a WRITE. Comments are mixed in according
+*   to the profile.
+-----------------------------------------------------------------------------*/
+
+void buildStatement(generator *gen, char *line, int *length)
+{
+    int commentRate = gen->profile == PROFILE_COMMENTS ? 2
+                    : gen->profile == PROFILE_MIXED ? 6 : 40;
+    if (getRandom(gen) % commentRate == 0)
+    {
+        buildComment(gen, line, length);
+        return;
+    }
+
+    char target[NAME_LENGTH + 1];
+    char source[NAME_LENGTH + 1];
+    char digits[32];
+    int digitCount = 0;
+    getIdentifier(getRandom(gen) % gen->declared, target, getNameLength(gen));
+    getIdentifier(getRandom(gen) % gen->declared, source, getNameLength(gen));
+    getInteger(gen, digits, &digitCount);
+
+    char *operators[] = { "+", "-", "*", "DIV" };
+    int position = 0;
+    switch (getRandom(gen) % 8)
+    {
+        case 0:
+            position = sprintf(line, "    FOR %s := 1 TO %.*s DO\n",
+                               target, digitCount, digits);
+            break;
+        case 1:
+            position = sprintf(line, "    READ(%s);\n", target);
+            break;
+        case 2:
+            position = sprintf(line, "    WRITE(%s, %s);\n", target, source);
+            break;
+        default:
+            position = sprintf(line, "    %s := %s %s %.*s;\n", target, source,
+                               operators[getRandom(gen) % 4], digitCount, digits);
+            break;
+    }
+    *length = position;
+}
+
+/*-----------------------------------------------------------------------------
+* flushBlock function:
+* Input: a pointer to a generator object
+* Output: void
+* Purpose: Writes the output block to the output file and empties it.
+-----------------------------------------------------------------------------*/
+
+void flushBlock(generator *gen)
+{
+    if (fwrite(gen->block, 1, gen->blockLength, gen->outputFile) != gen->blockLength)
+    {
+        printf("Error: Output could not be written.\n");
+        exit(1);
+    }
+    gen->blockLength = 0;
+}
+
+/*-----------------------------------------------------------------------------
+* getIdentifier function:
+* Input: the identifier's number, a pointer to a name, and the name's length
+* Output: void
+* Purpose: Spells an identifier number in letters, using at least the
+*   requested number of them, so every number gives a different identifier
+*   of between 1 and NAME_LENGTH characters. A number always gives the same
+*   name, so statements can refer to declared identifiers. No keyword
+*   starts with one of the letters used first, so no identifier can be
+*   mistaken for a keyword. Digits are not used, since the scanner ends a
+*   token at a digit that is followed by a letter.
+-----------------------------------------------------------------------------*/
+
+void getIdentifier(uint64_t number, char *name, int length)
+{
+    char *firstLetters = "ACGHJKLMNOQSUXYZ";
+    char *letters = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+    int position = 0;
+    name[position] = firstLetters[number % 16];
+    number = number / 16;
+    position++;
+    while ((number > 0 || position < length) && position < NAME_LENGTH)
+    {
+        name[position] = letters[number % 26];
+        number = number / 26;
+        position++;
+    }
+    name[position] = '\0';
+}
+
+/*-----------------------------------------------------------------------------
+* getInteger function:
+* Input: a pointer to a generator object, a pointer to an array of digits,
+*   and a pointer to the number of digits
+* Output: void
+* Purpose: Picks an integer literal, short in most profiles and up to 10
+*   digits long in the integers profile. A 10-digit literal starts with a
+*   1, so every literal is at most 2147483647, the largest the scanner
+*   accepts without an error.
+-----------------------------------------------------------------------------*/
+
+void getInteger(generator *gen, char *digits, int *length)
+{
+    int count = gen->profile == PROFILE_INTEGERS ? 4 + (int)(getRandom(gen) % 7)
+                                                 : 1 + (int)(getRandom(gen) % 4);
+
+    digits[0] = count == 10 ? '1' : (char)('1' + getRandom(gen) % 9);
+    int i = 0;
+    for (i = 1; i < count; i++)
+    {
+        digits[i] = (char)('0' + getRandom(gen) % 10);
+    }
+    *length = count;
+}
+
+/*-----------------------------------------------------------------------------
+* getNameLength function:
+* Input: a pointer to a generator object
+* Output: the length to pad identifiers to
+* Purpose: Long names in the identifiers profile, no padding otherwise. The
+*   length is fixed per profile so every use of an identifier matches its
+*   declaration.
+-----------------------------------------------------------------------------*/
+
+int getNameLength(generator *gen)
+{
+    return gen->profile == PROFILE_IDENTIFIERS ? NAME_LENGTH : 0;
+}
+
+/*-----------------------------------------------------------------------------
+* getRandom function:
+* Input: a pointer to a generator object
+* Output: the next 64-bit random number
+* Purpose: xorshift64* generator, chosen because it gives the same sequence
+*   everywhere, unlike rand().
+-----------------------------------------------------------------------------*/
+
+uint64_t getRandom(generator *gen)
+{
+    gen->state ^= gen->state >> 12;
+    gen->state ^= gen->state << 25;
+    gen->state ^= gen->state >> 27;
+    return gen->state * 0x2545F4914F6CDD1Dull;
+}
+
+/*-----------------------------------------------------------------------------
+* parseSize function:
+* Input: a pointer to a size such as "512K" or "2G", a pointer to the size
+*   in bytes
+* Output: a boolean that is false if the size could not be read
+* Purpose: Reads a size in bytes, kilobytes, megabytes or gigabytes.
+-----------------------------------------------------------------------------*/
+
+bool parseSize(char *text, uint64_t *size)
+{
+    char *end = NULL;
+    *size = strtoull(text, &end, 10);
+    if (end == text)
+    {
+        return false;
+    }
+
+    switch (*end)
+    {
+        case 'G':
+        case 'g':
+            *size = *size * 1024;
+            /* fall through */
+        case 'M':
+        case 'm':
+            *size = *size * 1024;
+            /* fall through */
+        case 'K':
+        case 'k':
+            *size = *size * 1024;
+            end++;
+            break;
+        default:
+            break;
+    }
+
+    return *end == '\0' && *size > 0;
+}
@@ -0,0 +1,192 @@
+/*-----------------------------------------------------------------------------
+* Writes the token table in "tokenTable.txt" as the C header "tokenTable.h",
+* which the scanner compiles in so it can start without reading or hashing
+* a file.
+*
+* The scanner is compiled into this program (with SCANNER_LIBRARY defined,
+* so its main function is left out, and SCANNER_TABLE_GENERATOR defined, so
+* it does not need the header being written). The file is read and checked
+* by readTokenTable, and the keyword hash and lexer tables are built by the
+* same functions the scanner uses for "--token-table", so the header holds
+* exactly what the scanner would build at run time:
+*
+*   builtinTokenString, builtinTokenLength, builtinTokenID
+*                       - the rows of the table, in the order of the file
+*   builtinKeywordSeed, builtinKeywordSlot
+*                       - the seed and slots of the keyword hash
+*   builtinIdID, builtinIntID
+*                       - the IDs of identifiers and integers
+*   builtinCharClass, builtinAction
+*                       - the tables of the table-driven lexer
+*
+* Build and run it from the folder holding the scanner after changing the
+* token table:
+*
+*   cc -O2 -pthread -o generateTokenTable generateTokenTable.c
+*   ./generateTokenTable tokenTable.txt tokenTable.h
+-----------------------------------------------------------------------------*/
+#define SCANNER_LIBRARY
+#define SCANNER_TABLE_GENERATOR
+#include "scanner.c"
+
+bool writeHeader(FILE *headerFile, tokenTable *table, char *tokenTableFilename);
+void writeNumbers(FILE *headerFile, const char *declaration, const int *numbers, int count);
+
+/*-----------------------------------------------------------------------------
+* The main program reads and checks the token table file, builds the keyword
+* hash and lexer tables from it, and writes them to the header.
+-----------------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+{
+    if (argc > 3 || (argc > 1 && argv[1][0] == '-'))
+    {
+        printf("Usage: %s [tokenTable.txt [tokenTable.h]]\n", argv[0]);
+        exit(1);
+    }
+    char *tokenTableFilename = argc > 1 ? argv[1] : "tokenTable.txt";
+    char *headerFilename = argc > 2 ? argv[2] : "tokenTable.h";
+
+    tokenTable table = constructTokenTable(tokenTableFilename);
+
+    FILE *headerFile = fopen(headerFilename, "w");
+    if (headerFile == NULL)
+    {
+        printf("Error: %s could not be opened.\n", headerFilename);
+        exit(1);
+    }
+
+    bool written = writeHeader(headerFile, &table, tokenTableFilename);
+    if (fclose(headerFile) != 0 || written == false)
+    {
+        printf("Error: %s could not be written.\n", headerFilename);
+        exit(1);
+    }
+
+    printf("Token table from %s stored in %s\n", tokenTableFilename,
+           headerFilename);
+    freeArena(&table.names);
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+* writeHeader function:
+* Input: a pointer to the open header file, a pointer to a tokenTable object
+*   whose hash and lexer tables are built, and a pointer to a character
+*   containing the name of the file it was read from
+* Output: a boolean that is false if the header could not be written
+* Purpose: Writes the table as static arrays. The header checks that the
+*   sizes it was generated with still match the scanner's, so a header
+*   left over from another version of the scanner fails to compile instead
+*   of giving a wrong table.
+-----------------------------------------------------------------------------*/
+
+bool writeHeader(FILE *headerFile, tokenTable *table, char *tokenTableFilename)
+{
+    int numbers[256];
+
+    fprintf(headerFile,
+            "/*-----------------------------------------------------------------------------\n"
+            "* Token table compiled into the scanner. Generated from %s by\n"
+            "* generateTokenTable; run it again instead of editing this file.\n"
+            "-----------------------------------------------------------------------------*/\n"
+            "#ifndef TOKEN_TABLE_H\n"
+            "#define TOKEN_TABLE_H\n"
+            "\n"
+            "#if TOKEN_TABLE_LENGTH != %d || KEYWORD_HASH_SIZE != %d || CLASS_COUNT != %d\n"
+            "#error \"tokenTable.h is out of date; run generateTokenTable again.\"\n"
+            "#endif\n"
+            "\n",
+            tokenTableFilename, TOKEN_TABLE_LENGTH, KEYWORD_HASH_SIZE,
+            CLASS_COUNT);
+
+    fprintf(headerFile, "static const char *const builtinTokenString[TOKEN_TABLE_LENGTH] =\n{\n");
+    int i = 0;
+    for (i = 0; i < TOKEN_TABLE_LENGTH; i++)
+    {
+        fprintf(headerFile, "    \"");
+        int c = 0;
+        for (c = 0; c < table->token[i].length; c++)
+        {
+            char character = table->token[i].string[c];
+            if (character == '"' || character == '\\')
+            {
+                fputc('\\', headerFile);
+            }
+            fputc(character, headerFile);
+        }
+        fprintf(headerFile, "\"%s\n", i + 1 < TOKEN_TABLE_LENGTH ? "," : "");
+    }
+    fprintf(headerFile, "};\n\n");
+
+    for (i = 0; i < TOKEN_TABLE_LENGTH; i++)
+    {
+        numbers[i] = table->token[i].length;
+    }
+    writeNumbers(headerFile, "static const int builtinTokenLength[TOKEN_TABLE_LENGTH]",
+                 numbers, TOKEN_TABLE_LENGTH);
+    for (i = 0; i < TOKEN_TABLE_LENGTH; i++)
+    {
+        numbers[i] = table->token[i].ID;
+    }
+    writeNumbers(headerFile, "static const int builtinTokenID[TOKEN_TABLE_LENGTH]",
+                 numbers, TOKEN_TABLE_LENGTH);
+
+    fprintf(headerFile, "static const unsigned int builtinKeywordSeed = 0x%08Xu;\n",
+            table->seed);
+    writeNumbers(headerFile, "static const int builtinKeywordSlot[KEYWORD_HASH_SIZE]",
+                 table->slot, KEYWORD_HASH_SIZE);
+    fprintf(headerFile, "static const int builtinIdID = %d;\n", table->idID);
+    fprintf(headerFile, "static const int builtinIntID = %d;\n\n", table->intID);
+
+    for (i = 0; i < 256; i++)
+    {
+        numbers[i] = table->charClass[i];
+    }
+    writeNumbers(headerFile, "static const unsigned char builtinCharClass[256]",
+                 numbers, 256);
+
+    /* One row of actions for each class of the current character */
+    fprintf(headerFile, "static const unsigned char builtinAction[CLASS_COUNT][CLASS_COUNT] =\n{\n");
+    for (i = 0; i < CLASS_COUNT; i++)
+    {
+        int next = 0;
+        fprintf(headerFile, "    {");
+        for (next = 0; next < CLASS_COUNT; next++)
+        {
+            fprintf(headerFile, "%s%d", next == 0 ? "" : ", ",
+                    table->action[i][next]);
+        }
+        fprintf(headerFile, "}%s\n", i + 1 < CLASS_COUNT ? "," : "");
+    }
+    fprintf(headerFile, "};\n\n");
+
+    fprintf(headerFile, "#endif\n");
+    return ferror(headerFile) == 0;
+}
+
+/*-----------------------------------------------------------------------------
+* writeNumbers function:
+* Input: a pointer to the open header file, a pointer to a character
+*   containing the declaration of an array, a pointer to the numbers in it,
+*   and how many there are
+* Output: void
+* Purpose: Writes an initialized array, sixteen numbers to a line.
+-----------------------------------------------------------------------------*/
+
+void writeNumbers(FILE *headerFile, const char *declaration, const int *numbers,
+                  int count)
+{
+    fprintf(headerFile, "%s =\n{\n", declaration);
+    int i = 0;
+    for (i = 0; i < count; i++)
+    {
+        fprintf(headerFile, "%s%d%s", i % 16 == 0 ? "    " : " ", numbers[i],
+                i + 1 < count ? "," : "");
+        if (i % 16 == 15 || i + 1 == count)
+        {
+            fprintf(headerFile, "\n");
+        }
+    }
+    fprintf(headerFile, "};\n\n");
+}
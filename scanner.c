@@ -8,99 +8,1099 @@
 *
 * This program also manages a symbol table for all identifier tokens 
 * in the input file. If the identifier appears before the BEGIN token and is 
-* not already in the symbol table, then it is added to the symbol table if 
-* there is room. If the identifier appears after the BEGIN token, then the 
-* table is searched for the identifier. If the identifier is not found, an 
-* error is printed to the output file.
+* not already in the symbol table, then it is added to the symbol table. If 
+* the identifier appears after the BEGIN token, then the table is searched 
+* for the identifier. If the identifier is not found, an error is printed to 
+* the output file.
 *
-* NOTE: "tokenTable.txt" must contain the token table and must be in the same 
-* folder as this program to function properly. 
+* The input file is read into memory in one piece (memory-mapped where the 
+* platform allows it) and lexed by byte offset into that buffer. The 
+* newlines are indexed in one pass, and a token's line and column are only 
+* looked up when a listing line or an error needs them.
+*
+* When input files are named on the command line, the program scans them all 
+* without prompting, spreading the files across a pool of threads. The token 
+* table is loaded once and shared by every thread. A single large file can 
+* also be split into chunks at line boundaries that are lexed in parallel 
+* and then stitched back together in order.
+*
+* The scanner itself works on a scannerContext and reports lines and errors 
+* through handlers, so the same code serves the listing written by this 
+* program and the library interface declared in scanner.h. The listing is 
+* built in a large output buffer and written out in a few big writes. The 
+* tokens can also be written as a binary token stream instead of a listing. 
+* Texts being edited are kept as scannerDocuments, which rescan only what 
+* an edit can have changed.
+*
+* NOTE: The token table in "tokenTable.txt" is compiled into the program 
+* through "tokenTable.h", which generateTokenTable writes from it. Run it 
+* again after changing the file, or name a table file to load at run time 
+* with "--token-table". 
 -----------------------------------------------------------------------------*/
+/* Declares madvise, futimens and the other POSIX calls under -std=c11 */
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#include "scanner.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SCANNER_POSIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCANNER_SIMD
+#include <immintrin.h>
+#endif
+
+/* 
+* USDT probes for tracing with perf or bpftrace, where the system has the 
+* SystemTap SDT header. Each probe is a single no-op until a tracer attaches. 
+* Define SCANNER_NO_PROBES to leave them out. The probes of the "scanner" 
+* provider and their arguments are:
+*
+*   file__open      file name
+*   file__close     bytes loaded (0 for a file read by the pipeline)
+*   lines__indexed  lines, bytes
+*   line            line number, text, length (as passed to a line handler)
+*   token           token ID, offset, text, length
+*   symbol__insert  text, length, slot, slots probed, 1 if a duplicate
+*   symbol__lookup  text, length, slot or -1, slots (or groups) probed
+*/
+#if defined(__linux__) && defined(__has_include) && !defined(SCANNER_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#define SCANNER_PROBES
+#include <sys/sdt.h>
+#endif
+#endif
 
-#define LINE_LENGTH 81
+#define READ_BLOCK_SIZE 65536
 #define TOKEN_LENGTH 12
 #define TOKEN_TABLE_LENGTH 23
+#define KEYWORD_HASH_BITS 6
+#define KEYWORD_HASH_SIZE (1 << KEYWORD_HASH_BITS)
+#define KEYWORD_SEED_ATTEMPTS 100000
+
+/* Character classes used by the table-driven lexer */
+#define CLASS_OTHER 0
+#define CLASS_LETTER 1
+#define CLASS_DIGIT 2
+#define CLASS_DOT 3
+#define CLASS_COLON 4
+#define CLASS_EQUALS 5
+#define CLASS_LPAREN 6
+#define CLASS_STAR 7
+#define CLASS_DELIMITER 8
+#define CLASS_SPACE 9
+#define CLASS_NEWLINE 10
+#define CLASS_COUNT 11
+
+/* Lexer actions, indexed by the classes of the current and next characters */
+#define ACTION_CONTINUE 0
+#define ACTION_STOP 1
+#define ACTION_STOP_BEFORE 2
+#define ACTION_ERROR 3
+#define ACTION_JOIN 4
+#define ACTION_DOT 5
+#define ACTION_DOT_SWALLOW 6
+#define ACTION_COMMENT 7
+
+/* Kinds of event passed from the lexer to the writer of a pipeline */
+#define EVENT_LINE 0
+#define EVENT_TOKEN 1
+#define EVENT_DIAGNOSTIC 2
+
 #define SYMBOL_TABLE_LENGTH 32
+#define SYMBOL_TABLE_LOAD_PERCENT 70
+#define SYMBOL_GROUP_SIZE 16
+#define SYMBOL_KEY_LENGTH 16
+#define SYMBOL_TAG_EMPTY 0
+#define CACHE_LINE_SIZE 64
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
 #define MAX_FILENAME_LENGTH 30
+#define MAX_PATH_LENGTH 4096
+#define SPLIT_CHUNK_SIZE (1 << 22)
+#define PIPELINE_BLOCK_SIZE (1 << 20)
+#define PIPELINE_DEPTH 8
+#define CACHE_MAGIC "PCAC"
+#define CACHE_VERSION 2
+#define CACHE_EXTENSION ".entry"
+#define CACHE_LIMIT_MB 256
+#define HASH_PRIME_1 0x87C37B91114253D5ull
+#define HASH_PRIME_2 0x4CF5AD432745937Full
+#define SERVER_REQUEST_LENGTH (MAX_PATH_LENGTH + 64)
+#define SERVER_BACKLOG 64
+#define SERVER_TIMEOUT_SECONDS 30
+#define SERVER_TEXT_LIMIT (256ull << 20)
+#define MESSAGE_LENGTH SCANNER_MESSAGE_LENGTH
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define FOLD_BLOCK_SIZE 256
+#define ARENA_BLOCK_SIZE 65536
+#define LINE_INDEX_BLOCK 65536
 
+/* Phases of a scan timed by the statistics, and the sizes of its counters */
+#ifdef SCANNER_STATS
+#define PHASE_IDLE 0
+#define PHASE_READ 1
+#define PHASE_LEX 2
+#define PHASE_ASSIGN 3
+#define PHASE_SYMBOL 4
+#define PHASE_OUTPUT 5
+#define PHASE_COUNT 6
+#define STATS_TOKEN_IDS 64
+#define STATS_ERROR_KINDS 7
+#define PROBE_HISTOGRAM_LENGTH 16
+#endif
+
+/* 
+* The token table built from "tokenTable.txt" by generateTokenTable, so the 
+* program starts without reading or hashing a file. The generator is built 
+* from this file too, without the table it is about to write.
+*/
+#ifndef SCANNER_TABLE_GENERATOR
+#include "tokenTable.h"
+#endif
+
+/* 
+* The offset of each '\n' in an input, in order, found in one pass over the 
+* whole input before its first token is read. The lexer works on offsets 
+* into the input and never keeps track of lines itself: a token's line and 
+* column are found in the index only when they are needed, and lines are 
+* passed to the line handler once the lexer has reached them. Line i of 
+* the input is line number lineBase + i + 1.
+*/
 typedef struct
 {
-    char string[LINE_LENGTH];
-    int lineNumber;
-    int index;
-} line;
+    size_t *newline;
+    int count;
+    int lineBase;
+    int passed;
+    int lastFound;
+} lineIndex;
 
+/* 
+* A program loaded for scanning. newlineAdded is set when the final '\n' was 
+* added because the text did not end in one, so the bytes actually read are 
+* length less one.
+*/
+typedef struct
+{
+    char *buffer;
+    size_t length;
+    size_t position;
+    bool mapped;
+    bool commentOpen;
+    bool newlineAdded;
+} source;
+
+/* 
+* A token's string is a view of its text where it was found, in the input 
+* or in an arena, so tokens never copy or zero-fill their text. The length 
+* limit of TOKEN_LENGTH is a rule of the language checked by the lexers, 
+* not the size of a buffer. The value of an integer is converted by the 
+* lexer as it measures the digits, and is 0 for other tokens. Tokens are 
+* built with only their offset; their line and column stay 0 until they 
+* are looked up with locateToken.
+*/
 typedef struct 
 {
-    char string[TOKEN_LENGTH];
+    char *string;
+    int length;
     int index;
     int ID;
+    int lineNumber;
+    int column;
+    size_t offset;
+    int value;
 } token;
 
-typedef struct
+/* 
+* One block of a bump allocator. Strings are carved from the newest block 
+* end to end and never freed one at a time; the whole chain is released at 
+* once, such as when the scan of a file ends.
+*/
+typedef struct arenaBlock
+{
+	struct arenaBlock *next;
+	size_t used;
+	size_t capacity;
+	char data[];
+} arenaBlock;
+
+struct tokenTable
 {
 	token token[TOKEN_TABLE_LENGTH];
-} tokenTable;
+	arenaBlock *names;
+	int slot[KEYWORD_HASH_SIZE];
+	unsigned int seed;
+	int idID;
+	int intID;
+	unsigned char charClass[256];
+	unsigned char action[CLASS_COUNT][CLASS_COUNT];
+};
+
+#ifdef SCANNER_STATS
+/* 
+* Counters and phase timers for one or more scans. Time is charged to the 
+* current phase whenever the scan moves on to another one, so each phase 
+* boundary costs a single read of the timer.
+*/
+typedef struct
+{
+	int currentPhase;
+	uint64_t mark;
+	uint64_t phaseTicks[PHASE_COUNT];
+	uint64_t fileCount;
+	uint64_t lineCount;
+	uint64_t bytesIn;
+	uint64_t bytesOut;
+	uint64_t tokenCount[STATS_TOKEN_IDS];
+	uint64_t errorCount[STATS_ERROR_KINDS];
+	uint64_t probeCount[PROBE_HISTOGRAM_LENGTH];
+	uint64_t symbolCount;
+	uint64_t symbolCapacity;
+	uint64_t cacheHits;
+	uint64_t cacheMisses;
+} scanStats;
+#endif
+
+typedef struct
+{
+	bool tableDriven;
+	bool splitInput;
+	bool tokensOnly;
+	bool binaryOutput;
+	bool preserveCase;
+	bool pipeline;
+	char *cacheDirectory;
+	int threadCount;
+	bool crossReference;
+	FILE *indexFile;
+#ifdef SCANNER_STATS
+	scanStats *stats;
+#endif
+} scanOptions;
+
+/* One token of a binary token stream, before it is split into sections */
+typedef struct
+{
+	uint64_t offset;
+	uint32_t lineNumber;
+	uint32_t literal;
+	uint16_t kind;
+	uint8_t length;
+} streamToken;
 
+/* 
+* Output is appended here and written to the file in large blocks. Without 
+* a file the buffer grows to hold everything appended to it. Program text 
+* is written in uppercase unless upperCase is cleared.
+*/
 typedef struct
 {
-	token token[SYMBOL_TABLE_LENGTH];
+	char *data;
+	size_t length;
+	size_t capacity;
+	FILE *file;
+	bool failed;
+	bool upperCase;
+#ifdef SCANNER_STATS
+	uint64_t written;
+#endif
+} outputBuffer;
+
+typedef struct
+{
+	tokenTable *table;
+	scanOptions *options;
+	char **inputFilenames;
+	int fileCount;
+	int nextFile;
+	int failures;
+	char *outputDirectory;
+#ifdef SCANNER_POSIX
+	pthread_mutex_t lock;
+#endif
+} batchJob;
+
+/* A file of a batch and the name of the output it is written to */
+typedef struct
+{
+	char *inputFilename;
+	char *outputFilename;
+} batchOutput;
+
+/* An identifier or BEGIN token whose symbol check waits for the stitch */
+typedef struct
+{
+	size_t offset;
+	token token;
+} symbolEvent;
+
+/* 
+* A piece of a split input, lexed once as if it starts outside a comment 
+* and once as if it starts inside one (indexed by the starting state).
+*/
+typedef struct
+{
+	source input;
+	int firstLine;
+	outputBuffer text[2];
+	symbolEvent *events[2];
+	int eventCount[2];
+	bool endsInComment[2];
+#ifdef SCANNER_STATS
+	scanStats stats[2];
+#endif
+} chunk;
+
+typedef struct
+{
+	tokenTable *table;
+	scanOptions *options;
+	chunk *chunks;
+	int chunkCount;
+	int nextTask;
+#ifdef SCANNER_POSIX
+	pthread_mutex_t lock;
+#endif
+} splitJob;
+
+/* 
+* Kernels for case folding, for measuring runs of letters or digits, and 
+* for finding the ends of lines and comments. selectKernels points these 
+* at the widest versions the CPU supports.
+*/
+int countRunScalar(char *string, int length, char low, char high, char fold);
+size_t findCommentEndScalar(const char *string, size_t length);
+size_t findNewlinesScalar(const char *string, size_t length, size_t base, size_t *newline);
+void foldCaseScalar(char *string, int length);
+
+int (*countRun)(char *string, int length, char low, char high, char fold) = countRunScalar;
+size_t (*findCommentEnd)(const char *string, size_t length) = findCommentEndScalar;
+size_t (*findNewlines)(const char *string, size_t length, size_t base, size_t *newline) = findNewlinesScalar;
+void (*foldCase)(char *string, int length) = foldCaseScalar;
+
+/* 
+* An identifier in the frozen layout of a symbol table: its name in 
+* uppercase, padded with NULs so that two names compare as one vector. 
+*/
+typedef struct
+{
+	char name[SYMBOL_KEY_LENGTH];
+} symbolKey;
+
+/* 
+* The sites where one identifier is declared and used, in the order they 
+* were scanned, packed as described for scannerIndexHeader. The line and 
+* column of the last site are kept to encode the next one.
+*/
+typedef struct
+{
+	unsigned char *data;
+	size_t length;
+	size_t capacity;
+	int count;
+	int lineNumber;
+	int column;
+} postingList;
+
+/* 
+* Identifiers are added to the slots while the declarations are scanned. 
+* Once BEGIN is reached the table only answers lookups, so it is frozen: a 
+* copy of its names is laid out for searching in groups of 
+* SYMBOL_GROUP_SIZE keys, each with a byte of tags kept apart from the keys 
+* and the number of the slot it came from (see freezeSymbolTable). The 
+* slots are still used to print the table. When a cross-reference index is 
+* kept, uses holds a postingList for each slot.
+*/
+typedef struct
+{
+	token *token;
+	int capacity;
+	int count;
+	arenaBlock *names;
+	void *frozen;
+	symbolKey *keys;
+	unsigned char *tags;
+	int *slots;
+	unsigned int groupMask;
+	postingList *uses;
+#ifdef SCANNER_STATS
+	scanStats *stats;
+#endif
 } symbolTable;
 
+/* Lookup in a frozen symbol table; selectKernels picks the version to use */
+int findFrozenSymbolScalar(token *currentToken, symbolTable *symTable, int *probes);
+
+int (*findFrozenSymbol)(token *currentToken, symbolTable *symTable, int *probes) = findFrozenSymbolScalar;
+
+/* An error found in a line of a scannerDocument */
+typedef struct
+{
+	int kind;
+	int column;
+	char message[MESSAGE_LENGTH];
+} documentDiagnostic;
+
+/* 
+* One line of a scannerDocument, with the tokens and errors found in it and 
+* a checkpoint of the scanner's state at its start: whether a comment is 
+* open, whether BEGIN has been reached, and how many identifiers are in the 
+* symbol table.
+*/
+typedef struct
+{
+	char *text;
+	int length;
+	size_t start;
+	bool startsInComment;
+	bool endsInComment;
+	bool beginReached;
+	int symbolCount;
+	token *tokens;
+	int tokenCount;
+	documentDiagnostic *diagnostics;
+	int diagnosticCount;
+	documentDiagnostic *symbolDiagnostics;
+	int symbolDiagnosticCount;
+} documentLine;
+
+struct scannerDocument
+{
+	tokenTable *table;
+	documentLine *lines;
+	int lineCount;
+	int lineCapacity;
+	token *declared;
+	int declaredCount;
+	int declaredCapacity;
+	arenaBlock *names;
+};
+
+/* 
+* The different values of the integer literals of one scan, in the order 
+* they were first seen, with a hash of them in slot (holding each value's 
+* number plus one, or 0 for a free slot) that has twice as many slots as 
+* the pool has room for values.
+*/
+typedef struct
+{
+	int *value;
+	int *slot;
+	int count;
+	int capacity;
+} literalPool;
+
+/* Everything one scan needs, so scans can run side by side */
+struct scannerContext
+{
+	tokenTable *table;
+	source input;
+	lineIndex lines;
+	symbolTable symTable;
+	literalPool literals;
+	bool beginReached;
+	bool tableDriven;
+	scannerLineHandler lineHandler;
+	void *lineData;
+	scannerDiagnosticHandler diagnosticHandler;
+	void *diagnosticData;
+#ifdef SCANNER_STATS
+	scanStats *stats;
+#endif
+};
+
+#ifdef SCANNER_POSIX
+/* 
+* A bounded queue with one producer thread and one consumer thread. Each 
+* end only writes its own index, so no lock is needed; a full queue makes 
+* the producer wait, which keeps a fast stage from running ahead.
+*/
+typedef struct
+{
+	void *slot[PIPELINE_DEPTH];
+	unsigned int head;
+	char padding[64];
+	unsigned int tail;
+} ringBuffer;
+
+/* 
+* A line, token or error found by the lexer of a pipeline. Tokens are 
+* written without their line, so only lines and errors give a line number.
+*/
+typedef struct
+{
+	int kind;
+	int lineNumber;
+	int ID;
+	int length;
+	const char *string;
+	size_t message;
+} pipelineEvent;
+
+/* 
+* A block of whole lines read from the input, and the events the lexer 
+* found in it. Strings in the events point into the block's data, except 
+* for error messages, which are kept in the block's messages.
+*/
+typedef struct
+{
+	char *data;
+	size_t length;
+	size_t capacity;
+	bool last;
+	bool failed;
+	pipelineEvent *events;
+	int eventCount;
+	int eventCapacity;
+	char *messages;
+	size_t messageLength;
+	size_t messageCapacity;
+} pipelineBlock;
+
+/* 
+* The stages of a pipeline scan and the queues between them. Blocks go from 
+* the reader to the lexer to the writer, and back to the reader when free.
+*/
+typedef struct
+{
+	FILE *inputFile;
+	scanOptions *options;
+	scannerContext context;
+	pipelineBlock block[PIPELINE_DEPTH];
+	ringBuffer freeBlocks;
+	ringBuffer readBlocks;
+	ringBuffer lexedBlocks;
+	size_t bytesRead;
+	int failed;
+} pipelineJob;
+
+/* 
+* Start of a cache entry, followed by the stored output. An entry is used 
+* only if everything but the output length matches the input being scanned: 
+* the input's length and 64-bit hash, and the hash of the token table and 
+* options. The input itself is not kept, so two inputs of the same length 
+* whose hashes collide would share an entry. The chance is about one in 
+* 2^64 for any pair of inputs, which the cache accepts.
+*/
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t inputLength;
+	uint64_t inputHash;
+	uint64_t settingsHash;
+	uint64_t outputLength;
+} cacheHeader;
 
-void addSymbol(token *currentToken, symbolTable *symTable, int *symbolCount, FILE *outputFile);
+/* A file in the cache directory, when trimming the cache */
+typedef struct
+{
+	char *path;
+	off_t size;
+	time_t used;
+} cacheEntry;
+
+/* 
+* A scan server and the socket its threads take connections from. The 
+* token table is loaded once and shared by every request.
+*/
+typedef struct
+{
+	tokenTable *table;
+	scanOptions *options;
+	char *socketPath;
+	int listener;
+	int threadCount;
+	int stopping;
+} serverJob;
+#endif
+
+bool addDocumentDiagnostic(documentDiagnostic **list, int *count, int kind, int column, const char *message);
+#ifdef SCANNER_POSIX
+bool addPipelineEvent(pipelineBlock *block, int kind, int lineNumber, int ID, const char *string, int length);
+#endif
+void addSymbol(scannerContext *context, token *currentToken);
+void addUse(symbolTable *symTable, int tableSlot, token *currentToken);
+void appendBytes(outputBuffer *output, const char *bytes, size_t length);
+void appendFolded(outputBuffer *output, const char *bytes, size_t length);
+void appendInteger(outputBuffer *output, int value);
 void assignID(tokenTable *table, token *token);
-token buildToken(FILE *inputFile, line *currentLine, FILE *outputFile);
-void checkSymbol(token *currentToken, symbolTable *symTable, bool *beginReached, int *symbolCount, FILE *outputFile);
+#ifdef SCANNER_STATS
+void attachStats(scannerContext *context, scanStats *stats);
+#endif
+bool buildKeywordHash(tokenTable *table);
+void buildLexerTables(tokenTable *table);
+bool buildRunToken(scannerContext *context, token *newToken);
+token buildToken(scannerContext *context);
+token buildTokenFromTable(scannerContext *context);
+bool checkDocumentSymbols(scannerDocument *document, int firstLine, int stableLine);
+bool checkOutputFilenames(batchJob *job);
+void checkSymbol(scannerContext *context, token *currentToken);
+#ifdef SCANNER_STATS
+void collectStats(scanStats *total, scannerContext *context);
+#endif
+bool closeOutput(outputBuffer *output);
+void closeSource(source *input);
+void compactDocumentNames(scannerDocument *document);
+int compareBatchOutputs(const void *left, const void *right);
+#ifdef SCANNER_POSIX
+int compareCacheEntries(const void *left, const void *right);
+#endif
+int compareIndexSymbols(const void *left, const void *right);
+#ifdef SCANNER_POSIX
+int connectServer(char *socketPath);
+#endif
 tokenTable constructTokenTable(char* tokenTableFilename);
 symbolTable constructSymbolTable();
-void formatLine(line *currentLine);
-int getHash(token *currentToken);
-void getNewLine(FILE *inputFile, line *currentLine);
-token getToken(FILE *inputFile, line *currentLine, tokenTable *table, FILE *outputFile);
-void ignoreComment(FILE *inputFile, line *currentLine, FILE *outputFile);
-void printLine(FILE *outputFile, line *currentLine);
-void printSymbolTable(symbolTable *symTable, FILE *outputFile);
-void printToken(FILE *outputFile, token *currentToken);
+#ifdef SCANNER_SIMD
+int countRunAVX2(char *string, int length, char low, char high, char fold);
+int countRunSSE2(char *string, int length, char low, char high, char fold);
+#endif
+int decodeUses(const unsigned char *data, size_t length, scannerUseSite *sites, int capacity);
+bool endOfSource(scannerContext *context);
+#ifdef SCANNER_STATS
+int enterPhase(scanStats *stats, int phase);
+#endif
+#ifdef SCANNER_SIMD
+size_t findCommentEndAVX2(const char *string, size_t length);
+size_t findCommentEndSSE2(const char *string, size_t length);
+int findFrozenSymbolSSE2(token *currentToken, symbolTable *symTable, int *probes);
+#endif
+int findLine(lineIndex *lines, size_t offset);
+#ifdef SCANNER_SIMD
+size_t findNewlinesAVX2(const char *string, size_t length, size_t base, size_t *newline);
+size_t findNewlinesSSE2(const char *string, size_t length, size_t base, size_t *newline);
+#endif
+int findSymbol(token *currentToken, symbolTable *symTable);
+bool flushOutput(outputBuffer *output, const char *bytes, size_t length);
+#ifdef SCANNER_SIMD
+void foldCaseAVX2(char *string, int length);
+void foldCaseSSE2(char *string, int length);
+#endif
+char foldCharacter(char character);
+void freeArena(arenaBlock **arena);
+void freeDocumentLine(documentLine *current);
+void freeLineIndex(lineIndex *lines);
+void freeLiteralPool(literalPool *pool);
+void freeSymbolTable(symbolTable *symTable);
+void freeUses(symbolTable *symTable);
+bool freezeSymbolTable(symbolTable *symTable);
+#ifdef SCANNER_POSIX
+void getCacheHeader(tokenTable *table, source *input, scanOptions *options, cacheHeader *header);
+char *getCachePath(char *cacheDirectory, cacheHeader *header);
+#endif
+unsigned int getHash(token *currentToken);
+int getKeywordHash(char *string, int length, unsigned int seed);
+char *getOutputFilename(char *outputDirectory, char *inputFilename, char *extension);
+int getSymbolSlot(token *currentToken, symbolTable *symTable, int *probes);
+token getToken(scannerContext *context);
+bool growSymbolTable(symbolTable *symTable);
+uint64_t hashBytes(const void *bytes, size_t length, uint64_t seed);
+void ignoreComment(scannerContext *context);
+void indexLines(scannerContext *context);
+void initContext(scannerContext *context, tokenTable *table, source *input, bool tableDriven);
+int internLiteral(literalPool *pool, int value);
+char *internString(arenaBlock **arena, const char *string, int length);
+void keepDiagnostic(void *current, int kind, int lineNumber, int column, const char *message);
+void keepSymbolDiagnostic(void *current, int kind, int lineNumber, int column, const char *message);
+#ifdef SCANNER_POSIX
+bool lexChunk(tokenTable *table, scanOptions *options, chunk *part, int state);
+void *lexChunks(void *argument);
+#endif
+bool lexDocumentLine(scannerDocument *document, documentLine *current, bool startsInComment);
+#ifdef SCANNER_POSIX
+void *lexPipeline(void *argument);
+#endif
+#ifndef SCANNER_TABLE_GENERATOR
+void loadBuiltinTokenTable(tokenTable *table);
+#endif
+void locateOffset(scannerContext *context, size_t offset, int *lineNumber, int *column);
+void locateToken(scannerContext *context, token *currentToken);
+void *mapFile(const char *filename, size_t minimumLength, size_t *length);
+bool matchFolded(const char *left, const char *right, int length);
+#ifdef SCANNER_STATS
+void mergeStats(scanStats *total, scanStats *part);
+#endif
+bool openOutput(outputBuffer *output, FILE *outputFile);
+bool openSource(char *inputFilename, source *input);
+uint64_t parseInteger(const char *digits, int count);
+void passDiagnostic(scannerContext *context, int kind, int lineNumber, int column, const char *format, va_list arguments);
+void passLines(scannerContext *context);
+#ifdef SCANNER_POSIX
+void *popRing(ringBuffer *ring);
+#endif
+void printDiagnostic(void *output, int kind, int lineNumber, int column, const char *message);
+void printLine(void *output, int lineNumber, const char *string, int length);
+void printSymbolTable(symbolTable *symTable, outputBuffer *output);
+void printToken(outputBuffer *output, tokenTable *table, token *currentToken);
+#ifdef SCANNER_POSIX
+void pushRing(ringBuffer *ring, void *item);
+#endif
+#ifdef SCANNER_POSIX
+bool readCacheEntry(char *cacheDirectory, cacheHeader *header, source *input, FILE *outputFile, scanOptions *options);
+#endif
+#ifdef SCANNER_STATS
+double readClock();
+#endif
+bool readFileList(char *fileListFilename, char ***inputFilenames, int *fileCount);
+#ifdef SCANNER_POSIX
+void *readPipeline(void *argument);
+#endif
+bool readSource(FILE *inputFile, source *input);
+#ifdef SCANNER_STATS
+uint64_t readTimer();
+#endif
+bool readTokenTable(char *tokenTableFilename, tokenTable *table, char *error);
+#ifdef SCANNER_POSIX
+void recordDiagnostic(void *block, int kind, int lineNumber, int column, const char *message);
+void recordLine(void *block, int lineNumber, const char *string, int length);
+#endif
+void reportDiagnostic(scannerContext *context, int kind, int lineNumber, int column, const char *format, ...);
+void reportDiagnosticAt(scannerContext *context, int kind, size_t offset, const char *format, ...);
+int runBatch(batchJob *job, int threadCount);
+#ifdef SCANNER_POSIX
+bool runServer(tokenTable *table, char *socketPath, scanOptions *options);
+#endif
+void *scanBatchFiles(void *argument);
+bool scanFile(tokenTable *table, char *inputFilename, char *outputFilename, char *indexFilename, scanOptions *options);
+#ifdef SCANNER_POSIX
+bool scanPipeline(tokenTable *table, FILE *inputFile, FILE *outputFile, scanOptions *options);
+#endif
+bool scanSource(tokenTable *table, source *input, FILE *outputFile, scanOptions *options);
+#ifdef SCANNER_POSIX
+bool scanSplitSource(tokenTable *table, source *input, outputBuffer *output, scanOptions *options);
+#endif
 bool searchForSymbol(token *currentToken, symbolTable *symTable);
+void selectKernels();
+void selectKernelsOnce();
+#ifdef SCANNER_POSIX
+bool sendReply(int connection, const char *reply);
+void *serveConnections(void *argument);
+bool serveRequest(serverJob *job, int connection, char **buffer, size_t *capacity);
+#endif
+bool skipBlanks(scannerContext *context);
+bool splitDocumentLines(const char *text, size_t length, documentLine **lines, int *lineCount);
+bool startCrossReference(symbolTable *symTable);
+#ifdef SCANNER_POSIX
+void storeCacheEntry(char *cacheDirectory, cacheHeader *header, char *outputFilename);
+void trimCache(char *cacheDirectory, long long limit);
+void waitForRing(int *attempts);
+#endif
+bool writeIndex(symbolTable *symTable, FILE *indexFile);
+#ifdef SCANNER_STATS
+bool writeStats(char *statsFilename, scanStats *stats, tokenTable *table, uint64_t startTicks, double startSeconds);
+#endif
+bool writeTokenStream(tokenTable *table, source *input, FILE *outputFile, scanOptions *options);
 
+#ifndef SCANNER_LIBRARY
 /*-----------------------------------------------------------------------------
-* The main program calls a function to construct the token table, opens input 
-* and output files, then gets tokens, creates a symbol table, and prints the 
-* tokens. At the end of the file, the symbol table is printed. Then, the files  
-* are closed.
+* The main program loads the token table compiled into it, or constructs 
+* one from the file named with "--token-table". With no 
+* input files on the command line it prompts for one input file and one 
+* output file, loads the input and opens the output, then scans the input: 
+* it gets tokens, builds a symbol table, and prints the tokens, followed by 
+* the symbol table at the end of the file. Then, the files are closed.
+*
+* Input files named on the command line, or listed one per line in the file 
+* given with "-l", are scanned in batch instead. Each one is written to the 
+* output directory given with "-o" (the current folder by default), and up 
+* to "-j" files are scanned at once (one per processor by default).
+*
+* Passing "--table-driven" on the command line makes the scanner build tokens 
+* with the table-driven lexer instead of buildToken, "--split" lets a large 
+* input be lexed in parallel chunks, and "--tokens-only" leaves the lines of 
+* the input out of the listing. "--binary" writes a binary token stream in 
+* place of the listing. "--pipeline" scans each input file named on the 
+* command line as it is read, with the reading, lexing and writing done on 
+* threads of their own. "--cache" names a folder where the output for each 
+* input is kept, so an unchanged input is not scanned again on the next 
+* run; "--cache-limit" sets its size in megabytes, and the least recently 
+* used outputs are removed once the run is over. "--serve" keeps the 
+* program running as a server on a Unix domain socket, scanning files or 
+* text sent by scannerClient with the token table it loaded at the start. 
+* "--index" writes a cross-reference index of the identifiers' use sites 
+* next to each output, with the same name ending in ".idx". When the 
+* program is compiled with SCANNER_STATS defined, "--stats" names a file 
+* that receives counters and phase timings for all of the scans as JSON 
+* once they are done.
 -----------------------------------------------------------------------------*/
 
-int main()
+int main(int argc, char *argv[])
 {   
+    selectKernels();
+
+    scanOptions options;
+    options.tableDriven = false;
+    options.splitInput = false;
+    options.tokensOnly = false;
+    options.binaryOutput = false;
+    options.preserveCase = false;
+    options.pipeline = false;
+    options.cacheDirectory = NULL;
+    options.threadCount = 0;
+    options.crossReference = false;
+    options.indexFile = NULL;
+    long long cacheLimit = CACHE_LIMIT_MB;
+    char *socketPath = NULL;
+    char *tokenTableFilename = NULL;
+#ifdef SCANNER_STATS
+    scanStats totalStats;
+    memset(&totalStats, 0, sizeof(totalStats));
+    options.stats = NULL;
+    char *statsFilename = NULL;
+#endif
+    char *outputDirectory = ".";
+    char *fileListFilename = NULL;
+    char **inputFilenames = malloc(argc * sizeof(char *));
+    int fileCount = 0;
+
+    int arg = 1;
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "--table-driven") == 0)
+        {
+            options.tableDriven = true;
+        }
+        else if (strcmp(argv[arg], "--split") == 0)
+        {
+            options.splitInput = true;
+        }
+        else if (strcmp(argv[arg], "--tokens-only") == 0)
+        {
+            options.tokensOnly = true;
+        }
+        else if (strcmp(argv[arg], "--binary") == 0)
+        {
+            options.binaryOutput = true;
+        }
+        else if (strcmp(argv[arg], "--preserve-case") == 0)
+        {
+            options.preserveCase = true;
+        }
+        else if (strcmp(argv[arg], "--pipeline") == 0)
+        {
+            options.pipeline = true;
+        }
+        else if (strcmp(argv[arg], "--index") == 0)
+        {
+            options.crossReference = true;
+        }
+        else if (strcmp(argv[arg], "--cache") == 0 && arg + 1 < argc)
+        {
+#ifdef SCANNER_POSIX
+            arg++;
+            options.cacheDirectory = argv[arg];
+#else
+            printf("Error: --cache is only available on POSIX systems.\n");
+            exit(1);
+#endif
+        }
+        else if (strcmp(argv[arg], "--cache-limit") == 0 && arg + 1 < argc && 
+                 atoll(argv[arg + 1]) > 0)
+        {
+            arg++;
+            cacheLimit = atoll(argv[arg]);
+        }
+        else if (strcmp(argv[arg], "--token-table") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            tokenTableFilename = argv[arg];
+        }
+        else if (strcmp(argv[arg], "--serve") == 0 && arg + 1 < argc)
+        {
+#ifdef SCANNER_POSIX
+            arg++;
+            socketPath = argv[arg];
+#else
+            printf("Error: --serve is only available on POSIX systems.\n");
+            exit(1);
+#endif
+        }
+        else if (strcmp(argv[arg], "--stats") == 0 && arg + 1 < argc)
+        {
+#ifdef SCANNER_STATS
+            arg++;
+            statsFilename = argv[arg];
+            options.stats = &totalStats;
+#else
+            printf("Error: --stats needs the scanner to be compiled with "
+                   "SCANNER_STATS defined.\n");
+            exit(1);
+#endif
+        }
+        else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            outputDirectory = argv[arg];
+        }
+        else if (strcmp(argv[arg], "-l") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            fileListFilename = argv[arg];
+        }
+        else if (strcmp(argv[arg], "-j") == 0 && arg + 1 < argc && 
+                 atoi(argv[arg + 1]) > 0)
+        {
+            arg++;
+            options.threadCount = atoi(argv[arg]);
+        }
+        else if (argv[arg][0] != '-' || strcmp(argv[arg], "-") == 0)
+        {
+            inputFilenames[fileCount] = argv[arg];
+            fileCount++;
+        }
+        else
+        {
+            printf("Usage: %s [--table-driven] [--split] [--tokens-only] "
+                   "[--binary] [--preserve-case] [--pipeline] [--index] [--cache cacheDirectory] "
+                   "[--cache-limit megabytes] [--serve socketPath] [--stats statsFile] "
+                   "[--token-table tokenTableFile] "
+                   "[-o outputDirectory] [-j threads] [-l fileList] "
+                   "[inputFile ...]\n", argv[0]);
+            exit(1);
+        }
+    }
+
     /* 
-    * Use "tokenTable.txt" to build the table that will be referenced
-    * to assign token IDs. Data in the file should be in the format:
+    * The table that will be referenced to assign token IDs is compiled in 
+    * from "tokenTable.txt", unless another file is named with 
+    * "--token-table". Data in the file should be in the format:
     *       "TokenString TokenID"
     * where each token is on a new line. TokenStrings should be no longer
     * than the set constant TOKEN_LENGTH. 
     */
-    char tokenTableFilename[] = "tokenTable.txt";
-    tokenTable table = constructTokenTable(tokenTableFilename);
-    
-    symbolTable symTable = constructSymbolTable();
+    tokenTable table;
+    if (tokenTableFilename != NULL)
+    {
+        table = constructTokenTable(tokenTableFilename);
+    }
+    else
+    {
+        loadBuiltinTokenTable(&table);
+    }
+#ifdef SCANNER_STATS
+    uint64_t startTicks = readTimer();
+    double startSeconds = readClock();
+#endif
+
+#ifdef SCANNER_POSIX
+    /* Scan whatever clients send until one of them stops the server */
+    if (socketPath != NULL)
+    {
+        if (runServer(&table, socketPath, &options) == false)
+        {
+            printf("Error: %s could not be opened.\n", socketPath);
+            exit(1);
+        }
+        free(inputFilenames);
+#ifdef SCANNER_STATS
+        if (statsFilename != NULL && 
+            writeStats(statsFilename, &totalStats, &table, startTicks, 
+                       startSeconds) == false)
+        {
+            printf("Error: %s could not be written.\n", statsFilename);
+            return 1;
+        }
+#endif
+        freeArena(&table.names);
+
+        return 0;
+    }
+#endif
+
+    /* Scan every file named on the command line or in the file list */
+    if (fileCount > 0 || fileListFilename != NULL)
+    {
+        if (fileListFilename != NULL && 
+            readFileList(fileListFilename, &inputFilenames, &fileCount) == false)
+        {
+            printf("Error: %s could not be opened.\n", fileListFilename);
+            exit(1);
+        }
+
+        batchJob job;
+        job.table = &table;
+        job.options = &options;
+        job.inputFilenames = inputFilenames;
+        job.fileCount = fileCount;
+        job.nextFile = 0;
+        job.failures = 0;
+        job.outputDirectory = outputDirectory;
+        if (checkOutputFilenames(&job) == false)
+        {
+            exit(1);
+        }
+
+#ifdef SCANNER_POSIX
+        if (options.cacheDirectory != NULL)
+        {
+            /* If the folder cannot be made, outputs are just not cached */
+            mkdir(options.cacheDirectory, 0777);
+        }
+#endif
+        int failures = runBatch(&job, options.threadCount);
+        printf("Results for %d of %d files stored in %s\n", 
+               fileCount - failures, fileCount, outputDirectory);
+#ifdef SCANNER_POSIX
+        if (options.cacheDirectory != NULL)
+        {
+            trimCache(options.cacheDirectory, cacheLimit * 1024 * 1024);
+        }
+#endif
+        free(inputFilenames);
+#ifdef SCANNER_STATS
+        if (statsFilename != NULL && 
+            writeStats(statsFilename, &totalStats, &table, startTicks, 
+                       startSeconds) == false)
+        {
+            printf("Error: %s could not be written.\n", statsFilename);
+            return 1;
+        }
+#endif
+        freeArena(&table.names);
+
+        return failures == 0 ? 0 : 1;
+    }
+
+    free(inputFilenames);
 
     /* 
     * Prompts user for input file name,
-    * opens file, and returns an error 
-    * if file couldn't be opened.
+    * loads file, and returns an error 
+    * if file couldn't be read.
     */
     printf("Enter name of input file to scan. (maximum of %d characters): ", MAX_FILENAME_LENGTH);
     char inputFilename[MAX_FILENAME_LENGTH];
     scanf("%s", inputFilename);
 
-    FILE *inputFile;
-    if ((inputFile = fopen(inputFilename, "r")) == NULL) {
+    source input;
+    if (openSource(inputFilename, &input) == false) {
         printf("\nError: %s could not be opened.\n", inputFilename);
         exit(1);
     }
@@ -115,244 +1115,796 @@ int main()
     scanf("%s", outputFilename);
 
     FILE *outputFile;
-    if ((outputFile = fopen(outputFilename, "w")) == NULL) {
+    if ((outputFile = fopen(outputFilename, options.binaryOutput ? "wb" : "w")) == NULL) {
         printf("\nError: %s could not be opened.\n", outputFilename);
         exit(1);
     }
 
-    
-    
-    line currentLine;
-    bool beginReached = false;
-    int symbolCount = 0;
-    
-    while (!feof(inputFile))
+    /* The index goes next to the output file */
+    char *indexFilename = NULL;
+    if (options.crossReference == true)
     {
-    	/*
-    	* getToken starts the process of generating tokens for output.
-    	* Check symbol determines whether the token needs to be added
-    	* to the symbol table or searched for in the table. 
-    	*/
-        token currentToken = getToken(inputFile, &currentLine, &table, outputFile);
-        printToken(outputFile, &currentToken);
-        checkSymbol(&currentToken, &symTable, &beginReached, &symbolCount, outputFile);
-	}
-	
-	printSymbolTable(&symTable, outputFile);
-    fclose(inputFile); /* close files */
-    fclose(outputFile);
+        indexFilename = getOutputFilename(".", outputFilename, "idx");
+        if (indexFilename == NULL || 
+            (options.indexFile = fopen(indexFilename, "wb")) == NULL)
+        {
+            printf("\nError: %s could not be opened.\n", 
+                   indexFilename != NULL ? indexFilename : outputFilename);
+            exit(1);
+        }
+    }
+
+    bool written = scanSource(&table, &input, outputFile, &options);
+
+    closeSource(&input); /* close files */
+    if (fclose(outputFile) != 0 || written == false) {
+        printf("\nError: %s could not be written.\n", outputFilename);
+        exit(1);
+    }
+    if (options.indexFile != NULL && fclose(options.indexFile) != 0) {
+        printf("\nError: %s could not be written.\n", indexFilename);
+        exit(1);
+    }
     printf("Results stored in %s\n", outputFilename);
+    free(indexFilename);
+#ifdef SCANNER_STATS
+    if (statsFilename != NULL && 
+        writeStats(statsFilename, &totalStats, &table, startTicks, 
+                   startSeconds) == false)
+    {
+        printf("Error: %s could not be written.\n", statsFilename);
+        exit(1);
+    }
+#endif
+    freeArena(&table.names);
 
     return 0;
 }
+#endif
+
+/*-----------------------------------------------------------------------------
+* addDocumentDiagnostic function:
+* Input: a pointer to a list of diagnostics and to its count, the kind of 
+*   error, the column it was found at, and its message
+* Output: a boolean that is false if the list could not be grown
+* Purpose: Adds an error to one of the lists kept for a line of a 
+*   scannerDocument. Errors are rare, so the list grows one entry at a time.
+-----------------------------------------------------------------------------*/
+
+bool addDocumentDiagnostic(documentDiagnostic **list, int *count, int kind, 
+                           int column, const char *message)
+{
+    documentDiagnostic *grown = realloc(*list, (*count + 1) * 
+                                               sizeof(documentDiagnostic));
+    if (grown == NULL)
+    {
+        return false;
+    }
+
+    grown[*count].kind = kind;
+    grown[*count].column = column;
+    snprintf(grown[*count].message, MESSAGE_LENGTH, "%s", message);
+    *list = grown;
+    *count = *count + 1;
+    return true;
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* addPipelineEvent function:
+* Input: a pointer to a pipelineBlock object, the kind of event, its line 
+*   number and token ID, and a pointer to its string and the string's length
+* Output: a boolean that is false if the block's lists could not be grown
+* Purpose: Adds an event to the list that the lexer of a pipeline hands to 
+*   the writer along with the block. Lines and tokens point into the block's 
+*   data. Error messages are built in a buffer that is reused, so they are 
+*   copied into the block's messages and found there by their offset.
+-----------------------------------------------------------------------------*/
+
+bool addPipelineEvent(pipelineBlock *block, int kind, int lineNumber, int ID, 
+                      const char *string, int length)
+{
+    if (block->eventCount == block->eventCapacity)
+    {
+        int capacity = block->eventCapacity * 2 + 256;
+        pipelineEvent *grown = realloc(block->events, 
+                                       capacity * sizeof(pipelineEvent));
+        if (grown == NULL)
+        {
+            return false;
+        }
+        block->events = grown;
+        block->eventCapacity = capacity;
+    }
+
+    pipelineEvent *event = &block->events[block->eventCount];
+    event->kind = kind;
+    event->lineNumber = lineNumber;
+    event->ID = ID;
+    event->length = length;
+    event->string = string;
+    event->message = 0;
+
+    if (kind == EVENT_DIAGNOSTIC)
+    {
+        if (block->messageLength + length + 1 > block->messageCapacity)
+        {
+            size_t capacity = block->messageCapacity * 2 + length + 1;
+            char *grown = realloc(block->messages, capacity);
+            if (grown == NULL)
+            {
+                return false;
+            }
+            block->messages = grown;
+            block->messageCapacity = capacity;
+        }
+
+        memcpy(block->messages + block->messageLength, string, length);
+        block->messages[block->messageLength + length] = '\0';
+        event->string = NULL;
+        event->message = block->messageLength;
+        block->messageLength = block->messageLength + length + 1;
+    }
+
+    block->eventCount = block->eventCount + 1;
+    return true;
+}
+#endif
 
 /*-----------------------------------------------------------------------------
 * addSymbol function:
-* Input: a pointer to a token object, a pointer to a symbol table object, a 
-*		pointer to an integer representing the number of tokens in the symbol 
-*		table, and a pointer to an output file
+* Input: a pointer to a scannerContext object and a pointer to a token object
 * Output: void
 * Purpose: This function adds an identifier to a symbol table and increments
-*		the count of items in the symbol table by one. First, the symbol table
-*		is checked to determine if the symbol is already in the table. If the 
-*		symbol is a duplicate, it is not added to the symbol table and an 
-*		error is printed in the output file. The accepted symbols are stored 
-*		in the symbol table using a hashing function. The ASCII values of all 
-*		characters in the symbol are summed. The sum is then modulo'd by the 
-*		number of spaces in the symbol table to determine its location. If 
-*		there is a collision, linear probing will place the symbol in the 
-*		next available spot.
+*		the count of items in the symbol table by one. The symbol's slot is 
+*		found with getSymbolSlot, which follows the same probe sequence as a 
+*		search, so a duplicate is found on the way to the free slot without 
+*		scanning the rest of the table. If the symbol is a duplicate, it is 
+*		not added to the symbol table and an error is reported. The table is 
+*		grown before an insert would take it past SYMBOL_TABLE_LOAD_PERCENT 
+*		full. The identifier's string is interned in the table's arena, so 
+*		the table does not depend on the input. 
+*		When the table keeps a cross-reference index, the declaration is 
+*		added to the identifier's uses, a duplicate one included. The 
+*		token's line and column are only looked up when an error or a use 
+*		needs them.
 -----------------------------------------------------------------------------*/
 
-void addSymbol(token *currentToken, symbolTable *symTable, int *symbolCount, FILE *outputFile)
+void addSymbol(scannerContext *context, token *currentToken)
 {
-	bool duplicate = false;
-	int i = 0;
+	symbolTable *symTable = &context->symTable;
+	int probes = 0;
+	int tableSlot = getSymbolSlot(currentToken, symTable, &probes);
+#ifdef SCANNER_PROBES
+	DTRACE_PROBE5(scanner, symbol__insert, currentToken->string, 
+	              currentToken->length, tableSlot, probes, 
+	              symTable->token[tableSlot].ID != 0);
+#endif
+	
+	/* A table that is changed again is searched through its slots */
+	if (symTable->frozen != NULL)
+	{
+		free(symTable->frozen);
+		symTable->frozen = NULL;
+		symTable->keys = NULL;
+		symTable->tags = NULL;
+		symTable->slots = NULL;
+	}
 	
 	/* Check for duplicate entries */
-	while ((i < SYMBOL_TABLE_LENGTH) && (duplicate == false))
+	if (symTable->token[tableSlot].ID != 0)
 	{
-		if (strcmp(symTable->token[i].string, currentToken->string) == 0)
+		locateToken(context, currentToken);
+		reportDiagnostic(context, SCANNER_ERROR_DECLARED_TWICE, 
+			currentToken->lineNumber, currentToken->column, 
+			"*ERROR: TOKEN \"%.*s\" IS DECLARED TWICE", currentToken->length, 
+			currentToken->string);
+		if (symTable->uses != NULL)
 		{
-			duplicate = true;
-			fprintf(outputFile, "\t\t*ERROR: TOKEN \"%s\" IS DECLARED TWICE\n", currentToken->string);
+			addUse(symTable, tableSlot, currentToken);
 		}
-		
-		i = i + 1;
+		return;
 	}
 	
-	/* Calculate hash and place identifier in symbol table */
-	if (duplicate != true)
+	/* Grow the table if needed, then place identifier in it */
+	char *name = internString(&symTable->names, currentToken->string, 
+	                          currentToken->length);
+	if (name == NULL || 
+	    (symTable->count + 1) * 100 > symTable->capacity * SYMBOL_TABLE_LOAD_PERCENT)
 	{
-		int tableSlot = getHash(currentToken);
-		
-		/* Find slot in table */
-		if (symTable->token[tableSlot].ID == 0)
+		if (name == NULL || growSymbolTable(symTable) == false)
+		{
+			locateToken(context, currentToken);
+			reportDiagnostic(context, SCANNER_ERROR_TOO_MANY_IDENTIFIERS, 
+				currentToken->lineNumber, currentToken->column, 
+				"*ERROR: TOO MANY IDENTIFIERS IN PROGRAM, MAX IS %d", 
+				symTable->count);
+			return;
+		}
+		tableSlot = getSymbolSlot(currentToken, symTable, &probes);
+	}
+	
+	symTable->token[tableSlot] = *currentToken;
+	symTable->token[tableSlot].string = name;
+	symTable->count = symTable->count + 1;
+	if (symTable->uses != NULL)
+	{
+		locateToken(context, currentToken);
+		addUse(symTable, tableSlot, currentToken);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+* addUse function:
+* Input: a pointer to a symbol table object that keeps a cross-reference 
+*   index, the slot of an identifier, and a pointer to the token where it 
+*   is declared or used
+* Output: void
+* Purpose: Appends the token's line and column to the identifier's list of 
+*		uses. Sites arrive in the order they are scanned, so each is stored 
+*		as the number of lines since the last one and its column, or the 
+*		distance from the last column when both are on the same line, as 
+*		unsigned LEB128 numbers of seven bits to a byte; most sites fit in 
+*		two bytes. If a list cannot be grown, the index is dropped so that 
+*		an incomplete one is never written.
+-----------------------------------------------------------------------------*/
+
+void addUse(symbolTable *symTable, int tableSlot, token *currentToken)
+{
+	postingList *uses = &symTable->uses[tableSlot];
+	
+	/* Two numbers of up to five bytes each */
+	if (uses->length + 10 > uses->capacity)
+	{
+		size_t capacity = uses->capacity * 2 + 16;
+		unsigned char *grown = realloc(uses->data, capacity);
+		if (grown == NULL)
 		{
-			symTable->token[tableSlot] = *currentToken;
+			freeUses(symTable);
+			return;
 		}
-		else
+		uses->data = grown;
+		uses->capacity = capacity;
+	}
+	
+	unsigned int value[2];
+	value[0] = (unsigned int)(currentToken->lineNumber - uses->lineNumber);
+	value[1] = (unsigned int)(value[0] == 0 
+	                          ? currentToken->column - uses->column 
+	                          : currentToken->column);
+	int i = 0;
+	for (i = 0; i < 2; i++)
+	{
+		while (value[i] >= 0x80)
 		{
-			while(symTable->token[tableSlot].ID != 0)
-			{
-				if (tableSlot == SYMBOL_TABLE_LENGTH)
-				{
-					tableSlot = 0;
-				}
-				else if (tableSlot < SYMBOL_TABLE_LENGTH)
-				{
-					tableSlot = tableSlot + 1;
-				}
-			}	
-			symTable->token[tableSlot] = *currentToken;
+			uses->data[uses->length] = (unsigned char)(value[i] | 0x80);
+			uses->length = uses->length + 1;
+			value[i] = value[i] >> 7;
 		}
-		*symbolCount = *symbolCount + 1;
+		uses->data[uses->length] = (unsigned char)value[i];
+		uses->length = uses->length + 1;
 	}
+	
+	uses->count = uses->count + 1;
+	uses->lineNumber = currentToken->lineNumber;
+	uses->column = currentToken->column;
 }
 
 /*-----------------------------------------------------------------------------
-* assignID function:
-* Input: a pointer to a tokenTable object, a pointer to a token object.
+* appendBytes function:
+* Input: a pointer to an outputBuffer object, a pointer to some bytes, and 
+*   the number of bytes
 * Output: void
-* Purpose: Compares myToken's string with all of the token strings in the 
-*   tokenTable. If the strings match, then the ID of the token in the table 
-*   is assigned to myToken. This function sets the ID of variables to the ID of 
-*   the token with string "id" in the table, and the ID of integers to the ID 
-*   of the token with string "int" in the table. If no ID is assigned, a 0 
-*   ID will be given.
+* Purpose: Adds bytes to the end of the output. When they do not fit, a 
+*   buffer with a file is flushed first, and a block at least half the size 
+*   of the buffer is written straight from the caller's memory along with 
+*   it instead of being copied. A buffer without a file is grown. Errors 
+*   are remembered in the buffer and reported when it is closed.
 -----------------------------------------------------------------------------*/
 
-void assignID(tokenTable *table, token *myToken)
+void appendBytes(outputBuffer *output, const char *bytes, size_t length)
 {
-    myToken->ID = 0;
-
-    /* search for match in table to assign ID */
-    int i = 0;
-    for (i = 0; i < TOKEN_TABLE_LENGTH; i++)
+    if (output->length + length <= output->capacity)
     {
-        if (strcmp(table->token[i].string, myToken->string) == 0)
-        {
-            myToken->ID = table->token[i].ID;
-        }
-        
+        memcpy(output->data + output->length, bytes, length);
+        output->length = output->length + length;
+        return;
+    }
+
+    if (output->failed == true)
+    {
+        return;
+    }
+
+    if (output->file == NULL)
+    {
+        size_t capacity = output->capacity * 2;
+        while (capacity < output->length + length)
+        {
+            capacity = capacity * 2;
+        }
+
+        char *grown = realloc(output->data, capacity);
+        if (grown == NULL)
+        {
+            output->failed = true;
+            return;
+        }
+        output->data = grown;
+        output->capacity = capacity;
+    }
+    else if (length >= output->capacity / 2)
+    {
+        flushOutput(output, bytes, length);
+        return;
+    }
+    else
+    {
+        flushOutput(output, NULL, 0);
+    }
+
+    memcpy(output->data + output->length, bytes, length);
+    output->length = output->length + length;
+}
+
+/*-----------------------------------------------------------------------------
+* appendFolded function:
+* Input: a pointer to an outputBuffer object, a pointer to some program text, 
+*   and the number of bytes
+* Output: void
+* Purpose: Adds program text to the output, converted to uppercase if the 
+*   output asks for it. The input itself is never changed, so the text is 
+*   converted after it is copied: in place in the buffer when it fits, and 
+*   otherwise in a small block, one block at a time, on its way to a flush.
+-----------------------------------------------------------------------------*/
+
+void appendFolded(outputBuffer *output, const char *bytes, size_t length)
+{
+    if (output->upperCase == false)
+    {
+        appendBytes(output, bytes, length);
+        return;
+    }
+
+    /* Text that fits is copied once and converted in the buffer */
+    if (output->length + length <= output->capacity && length <= INT_MAX)
+    {
+        char *copy = output->data + output->length;
+        memcpy(copy, bytes, length);
+        foldCase(copy, (int)length);
+        output->length = output->length + length;
+        return;
+    }
+
+    char block[FOLD_BLOCK_SIZE];
+    while (length > 0)
+    {
+        size_t count = length < sizeof(block) ? length : sizeof(block);
+        memcpy(block, bytes, count);
+        foldCase(block, (int)count);
+        appendBytes(output, block, count);
+        bytes = bytes + count;
+        length = length - count;
+    }
+}
+
+/*-----------------------------------------------------------------------------
+* appendInteger function:
+* Input: a pointer to an outputBuffer object and an integer
+* Output: void
+* Purpose: Adds the integer to the output in decimal. The digits are worked 
+*   out from the right into a small array, which is much cheaper than going 
+*   through printf for the line numbers and token IDs in the listing.
+-----------------------------------------------------------------------------*/
+
+void appendInteger(outputBuffer *output, int value)
+{
+    char digits[12];
+    int start = sizeof(digits);
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value 
+                                       : (unsigned int)value;
+
+    do
+    {
+        start--;
+        digits[start] = (char)('0' + magnitude % 10);
+        magnitude = magnitude / 10;
+    } while (magnitude != 0);
+
+    if (value < 0)
+    {
+        start--;
+        digits[start] = '-';
+    }
+
+    appendBytes(output, digits + start, sizeof(digits) - start);
+}
+
+/*-----------------------------------------------------------------------------
+* assignID function:
+* Input: a pointer to a tokenTable object, a pointer to a token object.
+* Output: void
+* Purpose: Looks up myToken's string in the tokenTable's keyword hash. The 
+*   hash is perfect, so the only entry that can match is the one in the 
+*   token's slot and a single comparison decides. Case is ignored by both 
+*   the hash and the comparison. If the strings match, then 
+*   the ID of the token in the table is assigned to myToken. This function 
+*   sets the ID of variables to the ID of the token with string "id" in the 
+*   table, and the ID of integers to the ID of the token with string "int" in 
+*   the table. If no ID is assigned, a 0 ID will be given.
+-----------------------------------------------------------------------------*/
+
+void assignID(tokenTable *table, token *myToken)
+{
+    myToken->ID = 0;
+
+    /* look up the single candidate for this string in the table */
+    int length = myToken->length;
+    if (length == 0)
+    {
+        return;
+    }
+
+    int i = table->slot[getKeywordHash(myToken->string, length, table->seed)];
+    if (i >= 0 && table->token[i].length == length && 
+        matchFolded(table->token[i].string, myToken->string, length))
+    {
+        myToken->ID = table->token[i].ID;
     }
 
     /* if no match is found, set as id or int based on first character */
-    if (myToken->ID == 0 && isalpha(myToken->string[0]))
+    int firstClass = table->charClass[(unsigned char)myToken->string[0]];
+    if (myToken->ID == 0 && firstClass == CLASS_LETTER)
+    {
+        myToken->ID = table->idID;
+    }
+
+    else if (myToken->ID == 0 && firstClass == CLASS_DIGIT)
+    {
+        myToken->ID = table->intID;
+    }
+}
+
+#ifdef SCANNER_STATS
+/*-----------------------------------------------------------------------------
+* attachStats function:
+* Input: a pointer to a scannerContext object and a pointer to a scanStats 
+*   object (or NULL)
+* Output: void
+* Purpose: Clears the statistics and has the context and its symbol table 
+*   record into them. Passing NULL leaves the scan without statistics, so 
+*   every counter and timer in it is skipped.
+-----------------------------------------------------------------------------*/
+
+void attachStats(scannerContext *context, scanStats *stats)
+{
+	if (stats != NULL)
+	{
+		memset(stats, 0, sizeof(scanStats));
+	}
+	context->stats = stats;
+	context->symTable.stats = stats;
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* buildKeywordHash function:
+* Input: a pointer to a tokenTable object
+* Output: a boolean that is false if no seed separates every string
+* Purpose: Builds a collision-free hash over the keyword and operator strings 
+*   in the token table so that assignID needs only one comparison. Seeds are 
+*   tried in turn until every string lands in its own slot. The "id" and "int" 
+*   rows name token classes rather than strings that can appear in a program, 
+*   so they are kept out of the hash and their IDs are stored separately.
+-----------------------------------------------------------------------------*/
+
+bool buildKeywordHash(tokenTable *table)
+{
+    table->idID = 0;
+    table->intID = 0;
+
+    unsigned int attempt = 0;
+    for (attempt = 0; attempt < KEYWORD_SEED_ATTEMPTS; attempt++)
     {
-    	
-        for (i = 0; i < TOKEN_TABLE_LENGTH; i++)
+        bool collision = false;
+        table->seed = 0x9E3779B1u + attempt * 2;
+
+        int i = 0;
+        for (i = 0; i < KEYWORD_HASH_SIZE; i++)
+        {
+            table->slot[i] = -1;
+        }
+
+        for (i = 0; i < TOKEN_TABLE_LENGTH && collision == false; i++)
         {
             if (strcmp(table->token[i].string, "id") == 0)
             {
-            	myToken->ID = table->token[i].ID;
+                table->idID = table->token[i].ID;
+            }
+            else if (strcmp(table->token[i].string, "int") == 0)
+            {
+                table->intID = table->token[i].ID;
+            }
+            else
+            {
+                int slot = getKeywordHash(table->token[i].string, 
+                                          table->token[i].length, table->seed);
+                if (table->slot[slot] == -1)
+                {
+                    table->slot[slot] = i;
+                }
+                else
+                {
+                    collision = true;
+                }
             }
-        
         }
+
+        if (collision == false)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*-----------------------------------------------------------------------------
+* buildLexerTables function:
+* Input: a pointer to a tokenTable object
+* Output: void
+* Purpose: Fills in the character class table and the action matrix used by 
+*   buildTokenFromTable. Every byte is given a class, and the action for each 
+*   pair of classes (current character, next character) is generated from the 
+*   identifier, integer and operator rules that buildToken applies, so both 
+*   lexers split the input the same way. Two-character operators such as ":=" 
+*   come from the token table itself.
+-----------------------------------------------------------------------------*/
+
+void buildLexerTables(tokenTable *table)
+{
+    int c = 0;
+    for (c = 0; c < 256; c++)
+    {
+        table->charClass[c] = CLASS_OTHER;
+    }
+    for (c = 'A'; c <= 'Z'; c++)
+    {
+        table->charClass[c] = CLASS_LETTER;
+        table->charClass[c - 'A' + 'a'] = CLASS_LETTER;
+    }
+    for (c = '0'; c <= '9'; c++)
+    {
+        table->charClass[c] = CLASS_DIGIT;
     }
+    table->charClass['.'] = CLASS_DOT;
+    table->charClass[':'] = CLASS_COLON;
+    table->charClass['='] = CLASS_EQUALS;
+    table->charClass['('] = CLASS_LPAREN;
+    table->charClass['*'] = CLASS_STAR;
+    table->charClass[';'] = CLASS_DELIMITER;
+    table->charClass[','] = CLASS_DELIMITER;
+    table->charClass['+'] = CLASS_DELIMITER;
+    table->charClass['-'] = CLASS_DELIMITER;
+    table->charClass[')'] = CLASS_DELIMITER;
+    table->charClass['\r'] = CLASS_DELIMITER;
+    table->charClass['\0'] = CLASS_DELIMITER;
+    table->charClass[' '] = CLASS_SPACE;
+    table->charClass['\n'] = CLASS_NEWLINE;
 
-    else if (myToken->ID == 0 && isalnum(myToken->string[0]))
+    int current = 0;
+    int next = 0;
+    for (current = 0; current < CLASS_COUNT; current++)
     {
-        for (i = 0; i < TOKEN_TABLE_LENGTH; i++)
+        for (next = 0; next < CLASS_COUNT; next++)
         {
-            if (strcmp(table->token[i].string, "int") == 0)
+            int action = ACTION_STOP;
+            bool nextIsBlank = (next == CLASS_SPACE || next == CLASS_NEWLINE);
+
+            /* identifiers run on through letters, digits and a '.' */
+            if (current == CLASS_LETTER && (next == CLASS_LETTER || 
+                next == CLASS_DIGIT || next == CLASS_DOT))
             {
-                myToken->ID = table->token[i].ID;
+                action = ACTION_CONTINUE;
             }
-        
+            /* integers run on through digits only */
+            else if (current == CLASS_DIGIT && next == CLASS_DIGIT)
+            {
+                action = ACTION_CONTINUE;
+            }
+            /* '.' ends the token and consumes the following character */
+            else if (current == CLASS_DOT)
+            {
+                action = nextIsBlank ? ACTION_DOT : ACTION_DOT_SWALLOW;
+            }
+            /* "(*" opens a comment */
+            else if (current == CLASS_LPAREN && next == CLASS_STAR)
+            {
+                action = ACTION_COMMENT;
+            }
+            /* blanks end the token without being consumed */
+            else if (current == CLASS_SPACE || current == CLASS_NEWLINE)
+            {
+                action = ACTION_STOP_BEFORE;
+            }
+            /* characters outside the language are reported and kept */
+            else if (current == CLASS_OTHER)
+            {
+                action = ACTION_ERROR;
+            }
+
+            table->action[current][next] = action;
+        }
+    }
+
+    /* Two-character operators from the token table are joined */
+    int i = 0;
+    for (i = 0; i < TOKEN_TABLE_LENGTH; i++)
+    {
+        char *string = table->token[i].string;
+        if (table->token[i].length == 2 && 
+            table->charClass[(unsigned char)string[0]] == CLASS_COLON)
+        {
+            table->action[CLASS_COLON]
+                         [table->charClass[(unsigned char)string[1]]] = ACTION_JOIN;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------
+* buildRunToken function:
+* Input: a pointer to a scannerContext object and a pointer to a token object
+* Output: a boolean that is true if the token was built
+* Purpose: Fast path shared by both lexers for tokens that start with a letter 
+*   or a digit. The whole run of letters followed by digits (or of digits 
+*   alone) is measured with the countRun kernel and taken at once, giving 
+*   the same token and the same length error as stepping through it a 
+*   character at a time. A letter run that ends in '.' is left to the caller, 
+*   since the '.' becomes part of the token. The value of an integer is 
+*   converted from the digits just measured, and a value above 
+*   SCANNER_MAX_INTEGER is reported and replaced by SCANNER_MAX_INTEGER, 
+*   whether or not the literal was also reported as too long.
+-----------------------------------------------------------------------------*/
+
+bool buildRunToken(scannerContext *context, token *newToken)
+{
+    source *input = &context->input;
+    char *start = input->buffer + input->position;
+    size_t left = input->length - input->position;
+    int remaining = left < INT_MAX ? (int)left : INT_MAX;
+
+    int letters = countRun(start, remaining, 'a', 'z', 0x20);
+    int run = letters + countRun(start + letters, remaining - letters, '0', '9', 0);
+
+    if (run == 0 || (letters == run && start[run] == '.'))
+    {
+        return false;
+    }
+
+    int count = run < TOKEN_LENGTH ? run : TOKEN_LENGTH;
+    newToken->string = start;
+    newToken->length = count;
+    newToken->index = count;
+    input->position = input->position + count;
+
+    bool tooLong = run >= TOKEN_LENGTH && 
+                   (countRun(start + TOKEN_LENGTH, 1, 'a', 'z', 0x20) == 1 || 
+                    countRun(start + TOKEN_LENGTH, 1, '0', '9', 0) == 1);
+    if (tooLong == true)
+    {
+        reportDiagnosticAt(context, SCANNER_ERROR_TOKEN_LENGTH, input->position, 
+                           "*ERROR: TOO MANY CHARACTERS IN"
+                           " FOLLOWING TOKEN. MAX IS 12 CHARACTERS*");
+    }
+
+    if (letters == 0)
+    {
+        uint64_t value = parseInteger(start, count);
+        if (value > SCANNER_MAX_INTEGER)
+        {
+            reportDiagnosticAt(context, SCANNER_ERROR_INTEGER_RANGE, 
+                               input->position - count, 
+                               "*ERROR: INTEGER %.*s IS TOO LARGE, MAX IS %d*", 
+                               count, start, SCANNER_MAX_INTEGER);
+            value = SCANNER_MAX_INTEGER;
         }
+        newToken->value = (int)value;
     }
+
+    return true;
 }
 
 /*-----------------------------------------------------------------------------
 * buildToken function:
-* Input: a pointer to an input file, a pointer to an output file, a pointer to 
-*   a line object.
+* Input: a pointer to a scannerContext object
 * Output: a token object
 * Purpose: Uses rules of the Simplified Pascal language to create tokens. When 
 *   a case is found that requires a token string to end based on the lexical 
 *   rules of the language, the "stop" flag is set to true and the token is 
-*   returned.
+*   returned. The token's string is a view of the line starting where the 
+*   token does, of at most TOKEN_LENGTH characters; a comment ends the view 
+*   just before its "(*".
 -----------------------------------------------------------------------------*/
 
-token buildToken(FILE *inputFile, line *currentLine, FILE *outputFile)
+token buildToken(scannerContext *context)
 {
+    source *input = &context->input;
+    char *string = input->buffer;
+
     /* Create and initialize a new token */ 
     token newToken;
+    newToken.string = string + input->position;
+    newToken.length = 0;
     newToken.index = 0;
-    int i = 0;
-    for (i = 0; i < TOKEN_LENGTH; i++)
-    {
-        newToken.string[i] = '\0';
-    }
+    newToken.value = 0;
     
     bool stop = false;
 
-    /* Skip leading whitespace */
-    while (currentLine->string[currentLine->index] == ' ')
-        {
-            currentLine->index = currentLine->index + 1;  
-        }
+    /* Identifiers and integers are measured in one step */
+    if (buildRunToken(context, &newToken) == true)
+    {
+        return newToken;
+    }
 
     while (stop != true)
     {
         /* Add first character that isn't ' ' or '\n' to token and increment.*/
-        newToken.string[newToken.index] = currentLine->string[currentLine->index];
+        if (newToken.index < TOKEN_LENGTH)
+        {
+            newToken.length = newToken.index + 1;
+        }
 
         /* validate keywords and IDs */
-        if (isalpha(currentLine->string[currentLine->index]))
+        if (isalpha(string[input->position]))
         {
-            if (!isalnum(currentLine->string[currentLine->index + 1]) && 
-                         currentLine->string[currentLine->index + 1] != '.')
+            if (!isalnum(string[input->position + 1]) && 
+                         string[input->position + 1] != '.')
             {
                 stop = true;
             }
         }
 
         /* validate integers */
-        if (isdigit(currentLine->string[currentLine->index]))
+        if (isdigit(string[input->position]))
         {
-            if (!isdigit(currentLine->string[currentLine->index + 1]))
+            if (!isdigit(string[input->position + 1]))
             {
                 stop = true;
             }
         }
 
         /* Switch handles all operators that are not alphanumeric */
-        if (!isalnum((currentLine->string[currentLine->index])))
+        if (!isalnum((string[input->position])))
         {
-            switch (currentLine->string[currentLine->index])
+            switch (string[input->position])
             {
                 /* Allows '.' to be appended but then ends the token */
                 case '.': 
-                    newToken.string[newToken.index] = 
-                        currentLine->string[currentLine->index];
                     newToken.index++;
-                    currentLine->index++;
+                    input->position++;
                     stop = true;
                     break;
                 /* Handles ':' and ":=" cases */
                 case ':':
-                    if (currentLine->string[currentLine->index + 1] == '=')
+                    if (string[input->position + 1] == '=')
                     {
-                        newToken.string[newToken.index] = 
-                            currentLine->string[currentLine->index];
                         newToken.index++;
-                        currentLine->index++;
-                        newToken.string[newToken.index] = 
-                            currentLine->string[currentLine->index];
-                        
+                        input->position++;
+                        if (newToken.index < TOKEN_LENGTH)
+                        {
+                            newToken.length = newToken.index + 1;
+                        }
                     }
                     stop = true;
                     break;
                 /* Handles '(' and "(*" cases */
                 case '(':
-                    if (currentLine->string[currentLine->index + 1] == '*')
+                    if (string[input->position + 1] == '*')
                     {
                         /* Enter comment mode */
-                        newToken.string[newToken.index] = ' ';
-                        currentLine->index++;
-                        ignoreComment(inputFile, currentLine, outputFile);
+                        newToken.length = newToken.index;
+                        input->position++;
+                        ignoreComment(context);
                     }
                     stop = true;
                     break;
@@ -370,25 +1922,28 @@ token buildToken(FILE *inputFile, line *currentLine, FILE *outputFile)
                     stop = true;
                     break;
                 default:
-                    fprintf(outputFile, "\t\t*ERROR: CHARACTER '%c' NOT"
-                            " ALLOWED IN LANGUAGE*\n", 
-                            currentLine->string[currentLine->index]);
+                    reportDiagnosticAt(context, SCANNER_ERROR_CHARACTER, 
+                            input->position, 
+                            "*ERROR: CHARACTER '%c' NOT ALLOWED IN LANGUAGE*", 
+                            string[input->position]);
                     break;
             }
         }
            
-        if (currentLine->string[currentLine->index] != ' ' && 
-            currentLine->string[currentLine->index] != '\n')
+        if (string[input->position] != ' ' && 
+            string[input->position] != '\n')
         {
             newToken.index++;
-            currentLine->index++;
+            input->position++;
         }
 
         if (newToken.index >= TOKEN_LENGTH && 
-            isalnum(currentLine->string[currentLine->index]))
+            isalnum(string[input->position]))
         {
-            fprintf(outputFile, "\t\t*ERROR: TOO MANY CHARACTERS IN"
-                                " FOLLOWING TOKEN. MAX IS 12 CHARACTERS*\n");
+            reportDiagnosticAt(context, SCANNER_ERROR_TOKEN_LENGTH, 
+                               input->position, 
+                               "*ERROR: TOO MANY CHARACTERS IN"
+                               " FOLLOWING TOKEN. MAX IS 12 CHARACTERS*");
             stop = true;
         }
     }  
@@ -397,381 +1952,6455 @@ token buildToken(FILE *inputFile, line *currentLine, FILE *outputFile)
 }
 
 /*-----------------------------------------------------------------------------
-* checkSymbol function:
-* Input: a pointer to a token object, a pointer to a symbol table object, a 
-*			pointer to a bool, a pointer to an integer, and a pointer to an 
-*			output file
-* Output: void
-* Purpose: This program determines whether a symbol needs to be added to the 
-*		symbol table or searched for in the symbol table. If the symbol is an 
-*		identifier and comes before the BEGIN token and the symbol table is 
-*		not full, then it is added to the symbol table. If the identifier 
-*		comes after the BEGIN token, then the identifier is searched for in 
-*		the symbol table. If the symbol is the BEGIN token, then the 
-*		beginReached boolean is set to true.
+* buildTokenFromTable function:
+* Input: a pointer to a scannerContext object
+* Output: a token object
+* Purpose: Builds the same tokens, and reports the same errors, as buildToken, 
+*   but decides where a token ends with table lookups instead of ctype calls 
+*   and nested tests. Each character's class is looked up once, and the pair 
+*   of classes for the current and next characters selects an action from 
+*   the table built by buildLexerTables.
 -----------------------------------------------------------------------------*/
 
-void checkSymbol(token *currentToken, symbolTable *symTable, bool *beginReached, int *symbolCount, FILE *outputFile)
+token buildTokenFromTable(scannerContext *context)
 {
-	/*
-	* If BEGIN token is found, mark beginReached as true
-	*/
-	if (strcmp(currentToken->string, "BEGIN") == 0)
-    {
-    	*beginReached = true;
-	}
-	
-	/*
-	* If identifier is found before BEGIN is found, 
-	* add identifier to symbol table
-	*/
-	else if ((currentToken->ID == 22) && (*beginReached == false))
-	{
-		if (*symbolCount < (SYMBOL_TABLE_LENGTH))
-		{
-			addSymbol(currentToken, symTable, symbolCount, outputFile);
-		}
-		else
-		{
-			fprintf(outputFile, 
-				"\t\t*ERROR: TOO MANY IDENTIFIERS IN PROGRAM, MAX IS %d\n", 
-				SYMBOL_TABLE_LENGTH);
-		}
-			
-	}
-	
-	/*
-	* If identifier is found after BEGIN is found, 
-	* check for identifier in symbol table
-	*/
-	else if ((currentToken->ID == 22) && (*beginReached == true))
-	{
-		bool inTable = searchForSymbol(currentToken, symTable);
-		
-		if (inTable == false)
-		{
-			fprintf(outputFile, "\t\t*ERROR: TOKEN %s WAS NOT DECLARED\n", 
-				currentToken->string);
-		}
-	}
-}
-
-/*-----------------------------------------------------------------------------
-* constructSymbolTable function:
-* Input: None
-* Output: a symbolTable initialized with blank token 
-*			strings and token IDs of 0.
-* Purpose: This function creates a symbol table and sets all token 
-*			strings to blank and token IDs to zero.
------------------------------------------------------------------------------*/
+    source *input = &context->input;
+    tokenTable *table = context->table;
 
-symbolTable constructSymbolTable()
-{
-	symbolTable symTable;
-	
-	int i = 0;
-	for (i = 0; i < SYMBOL_TABLE_LENGTH; i++)
-	{
-		strset(symTable.token[i].string, ' ');
-		symTable.token[i].ID = 0;
-	}
-	
-	return symTable;
-}
+    /* Create and initialize a new token */ 
+    token newToken;
+    newToken.string = input->buffer + input->position;
+    newToken.length = 0;
+    newToken.index = 0;
+    newToken.value = 0;
 
-/*-----------------------------------------------------------------------------
-* constructTokenTable function:
-* Input: a pointer to a character containing the file name
-* Output: a tokenTable object
-* Purpose: Builds a tokenTable object using input from a text file. The text 
-* file must be of the format "TokenString TokenID" with one token per line and 
-* and a maximum TokenString length of TOKEN_LENGTH.
------------------------------------------------------------------------------*/
+    char *string = input->buffer;
+    size_t index = input->position;
 
-tokenTable constructTokenTable(char* tokenTableFilename)
-{
-    /* Open file containing token table and check for errors */
-    FILE *tokenFile;    
-    tokenTable table;
-    if ((tokenFile = fopen(tokenTableFilename, "r")) == NULL) {
-        printf("Error: Token file could not be opened.");
-        exit(1);
+    /* Identifiers and integers are measured in one step */
+    if (buildRunToken(context, &newToken) == true)
+    {
+        return newToken;
     }
-    
-    /* Construct token table */ 
-    int i = 0;
-    for (i = 0; i < TOKEN_TABLE_LENGTH; i++)
+
+    int currentClass = table->charClass[(unsigned char)string[index]];
+    bool stop = false;
+
+    while (stop != true)
     {
-        fscanf(tokenFile, "%s %d", table.token[i].string, &table.token[i].ID);
+        int nextClass = table->charClass[(unsigned char)string[index + 1]];
+
+        if (newToken.index < TOKEN_LENGTH)
+        {
+            newToken.length = newToken.index + 1;
+        }
+
+        switch (table->action[currentClass][nextClass])
+        {
+            case ACTION_CONTINUE:
+                newToken.index++;
+                index++;
+                break;
+            case ACTION_STOP:
+                newToken.index++;
+                index++;
+                stop = true;
+                break;
+            case ACTION_STOP_BEFORE:
+                stop = true;
+                break;
+            case ACTION_ERROR:
+                reportDiagnosticAt(context, SCANNER_ERROR_CHARACTER, index, 
+                        "*ERROR: CHARACTER '%c' NOT ALLOWED IN LANGUAGE*", 
+                        string[index]);
+                newToken.index++;
+                index++;
+                break;
+            case ACTION_JOIN:
+                if (newToken.index + 1 < TOKEN_LENGTH)
+                {
+                    newToken.length = newToken.index + 2;
+                }
+                newToken.index += 2;
+                index += 2;
+                stop = true;
+                break;
+            case ACTION_DOT:
+                newToken.index++;
+                index++;
+                stop = true;
+                break;
+            case ACTION_DOT_SWALLOW:
+                newToken.index += 2;
+                index += 2;
+                stop = true;
+                break;
+            case ACTION_COMMENT:
+                /* Enter comment mode */
+                newToken.length = newToken.index;
+                input->position = index + 1;
+                ignoreComment(context);
+                index = input->position;
+                if (string[index] != ' ' && string[index] != '\n')
+                {
+                    newToken.index++;
+                    index++;
+                }
+                stop = true;
+                break;
+        }
+
+        currentClass = table->charClass[(unsigned char)string[index]];
+
+        if (newToken.index >= TOKEN_LENGTH && 
+            (currentClass == CLASS_LETTER || currentClass == CLASS_DIGIT))
+        {
+            reportDiagnosticAt(context, SCANNER_ERROR_TOKEN_LENGTH, index, 
+                               "*ERROR: TOO MANY CHARACTERS IN"
+                               " FOLLOWING TOKEN. MAX IS 12 CHARACTERS*");
+            stop = true;
+        }
     }
 
-    /* Close file and return newly constructed token table */
-    fclose(tokenFile);
-    return table;
+    input->position = index;
+    return newToken;
 }
 
 /*-----------------------------------------------------------------------------
-* formatLine function:
-* Input: a pointer to a line object.
-* Output: void
-* Purpose: Converts all characters in the line's string to uppercase, removes 
-*   leading whitespace from the line, and appends '\n' if the string does 
-*   not have one.
+* checkDocumentSymbols function:
+* Input: a pointer to a scannerDocument object, the index of the first line 
+*   whose symbol checks may have changed, and the index of the first line 
+*   after it that was not lexed again
+* Output: a boolean that is false if memory ran out
+* Purpose: Re-runs the symbol checks from the checkpoint at the start of 
+*   firstLine (or from the beginning of the document when firstLine is the 
+*   first line). The symbol table at a line's start is rebuilt from the first 
+*   symbolCount identifiers in the document's declared list, which holds 
+*   them in the order they were added. Each line's checkpoint and symbol 
+*   errors are replaced as the checks go. From stableLine on, the checks 
+*   stop at the first line whose old checkpoint matches the new state, as 
+*   long as every identifier declared on the way matched the declared list, 
+*   since every later check would then give the same result as before. The 
+*   names in the declared list are interned in the document's arena, since 
+*   the lines they were found on may be edited away.
 -----------------------------------------------------------------------------*/
 
-void formatLine(line *currentLine)
+bool checkDocumentSymbols(scannerDocument *document, int firstLine, int stableLine)
 {
-    /* Ensures that all letters are treated as uppercase */
-    int k = 0;
-    while(currentLine->string[k])
-    {
-        currentLine->string[k] = toupper(currentLine->string[k]);
-        k++;
-    }
-
-    /* Removes leading whitespace from string */
-    int i, j;
-    for(i = 0; currentLine->string[i] == ' ' 
-            || currentLine->string[i] == '\t'; i++);
+    scannerContext context;
+    initContext(&context, document->table, NULL, false);
+    context.diagnosticHandler = keepSymbolDiagnostic;
 
-    for(j = 0; currentLine->string[i]; i++)
+    bool success = true;
+    bool declaredChanged = false;
+    if (firstLine > 0 && firstLine < document->lineCount)
     {
-        currentLine->string[j++] = currentLine->string[i];
+        documentLine *first = &document->lines[firstLine];
+        context.beginReached = first->beginReached;
+
+        int i = 0;
+        for (i = 0; i < first->symbolCount; i++)
+        {
+            addSymbol(&context, &document->declared[i]);
+        }
+        if (context.beginReached == true)
+        {
+            freezeSymbolTable(&context.symTable);
+        }
     }
-    currentLine->string[j] = '\0';  
 
-    /*
-    * Appends a new line to any line that does 
-    * not have one, such as the last line of a file
-    */
-    if (!strchr(currentLine->string, '\n'))
+    int i = firstLine;
+    for (i = firstLine; i < document->lineCount && success == true; i++)
+    {
+        documentLine *current = &document->lines[i];
+        if (i >= stableLine && declaredChanged == false && 
+            current->beginReached == context.beginReached && 
+            current->symbolCount == context.symTable.count)
+        {
+            break;
+        }
+
+        current->beginReached = context.beginReached;
+        current->symbolCount = context.symTable.count;
+        free(current->symbolDiagnostics);
+        current->symbolDiagnostics = NULL;
+        current->symbolDiagnosticCount = 0;
+        context.diagnosticData = current;
+
+        int t = 0;
+        for (t = 0; t < current->tokenCount; t++)
+        {
+            int count = context.symTable.count;
+            checkSymbol(&context, &current->tokens[t]);
+            if (context.symTable.count == count)
+            {
+                continue;
+            }
+
+            /* Record the new identifier, noting whether the list changed */
+            if (count == document->declaredCapacity)
+            {
+                int capacity = document->declaredCapacity * 2 + 64;
+                token *grown = realloc(document->declared, 
+                                       capacity * sizeof(token));
+                if (grown == NULL)
+                {
+                    success = false;
+                    break;
+                }
+                document->declared = grown;
+                document->declaredCapacity = capacity;
+            }
+            token *declared = &document->declared[count];
+            char *name = NULL;
+            if (count < document->declaredCount && 
+                declared->length == current->tokens[t].length && 
+                memcmp(declared->string, current->tokens[t].string, 
+                       declared->length) == 0)
+            {
+                name = declared->string;
+            }
+            else
+            {
+                declaredChanged = true;
+                name = internString(&document->names, current->tokens[t].string, 
+                                    current->tokens[t].length);
+                if (name == NULL)
+                {
+                    success = false;
+                    break;
+                }
+            }
+            *declared = current->tokens[t];
+            declared->string = name;
+        }
+    }
+
+    /* Checks that ran to the end decide how many identifiers are declared */
+    if (i == document->lineCount)
     {
-        strcat(currentLine->string, "\n");
+        document->declaredCount = context.symTable.count;
+        compactDocumentNames(document);
     }
+
+    freeSymbolTable(&context.symTable);
+    return success;
 }
 
 /*-----------------------------------------------------------------------------
-* getHash function:
-* Input: a pointer to a token obbject
-* Output: an integer representing the hashed value of the token
-* Purpose: This function accepts a token as input. The ASCII values of each 
-*		character in the token string are summed, then the modulo function is 
-*		applied with the symbol table length to create a hash value for the 
-*		token. The hash value is returned.
+* checkOutputFilenames function:
+* Input: a pointer to a batchJob object
+* Output: a boolean that is false if two files of the batch would be written 
+*   to the same output, or the names could not be made
+* Purpose: Output files are named after the input's base name alone, so 
+*   "a/x.txt" and "b/x.txt", or one file named twice, would both be written 
+*   to "x.out" by different threads at once. The output names are sorted 
+*   and compared before the batch starts, and the first clash is reported.
 -----------------------------------------------------------------------------*/
 
-int getHash(token *currentToken)
+bool checkOutputFilenames(batchJob *job)
 {
-	int hash = 0;
-	int i = 0;
+    if (job->fileCount < 2)
+    {
+        return true;
+    }
+
+    batchOutput *outputs = calloc(job->fileCount, sizeof(batchOutput));
+    bool unique = outputs != NULL;
+
+    int i = 0;
+    for (i = 0; i < job->fileCount && unique == true; i++)
+    {
+        outputs[i].inputFilename = job->inputFilenames[i];
+        outputs[i].outputFilename = getOutputFilename(job->outputDirectory, 
+                                                      job->inputFilenames[i], 
+                                                      job->options->binaryOutput 
+                                                      ? "tok" : "out");
+        unique = outputs[i].outputFilename != NULL;
+    }
+    if (unique == false)
+    {
+        printf("Error: The output file names could not be made.\n");
+    }
+    else
+    {
+        qsort(outputs, job->fileCount, sizeof(batchOutput), compareBatchOutputs);
+        for (i = 1; i < job->fileCount && unique == true; i++)
+        {
+            if (strcmp(outputs[i - 1].outputFilename, 
+                       outputs[i].outputFilename) == 0)
+            {
+                printf("Error: %s and %s would both be written to %s.\n", 
+                       outputs[i - 1].inputFilename, outputs[i].inputFilename, 
+                       outputs[i].outputFilename);
+                unique = false;
+            }
+        }
+    }
+
+    for (i = 0; outputs != NULL && i < job->fileCount; i++)
+    {
+        free(outputs[i].outputFilename);
+    }
+    free(outputs);
+    return unique;
+}
+
+/*-----------------------------------------------------------------------------
+* checkSymbol function:
+* Input: a pointer to a scannerContext object and a pointer to a token object
+* Output: void
+* Purpose: This program determines whether a symbol needs to be added to the 
+*		symbol table or searched for in the symbol table. If the symbol is an 
+*		identifier and comes before the BEGIN token, then it is added to the 
+*		symbol table. If the identifier 
+*		comes after the BEGIN token, then the identifier is searched for in 
+*		the symbol table, and added to its uses if the table keeps a 
+*		cross-reference index. If the symbol is the BEGIN token, then the 
+*		context's beginReached boolean is set to true, and the symbol table 
+*		is frozen, since nothing more is added to it.
+-----------------------------------------------------------------------------*/
+
+void checkSymbol(scannerContext *context, token *currentToken)
+{
+	/*
+	* If BEGIN token is found, mark beginReached as true
+	*/
+	if (currentToken->length == 5 && matchFolded(currentToken->string, "BEGIN", 5))
+    {
+    	context->beginReached = true;
+    	freezeSymbolTable(&context->symTable);
+	}
 	
-	for (i = 0; i < TOKEN_LENGTH; i++)
+	/*
+	* If identifier is found before BEGIN is found, 
+	* add identifier to symbol table
+	*/
+	else if ((currentToken->ID == context->table->idID) && 
+	         (context->beginReached == false))
 	{
-		hash += currentToken->string[i];
+		addSymbol(context, currentToken);
 	}
 	
-	hash = hash % SYMBOL_TABLE_LENGTH;
-	
-	return hash;
+	/*
+	* If identifier is found after BEGIN is found, 
+	* check for identifier in symbol table
+	*/
+	else if ((currentToken->ID == context->table->idID) && 
+	         (context->beginReached == true))
+	{
+		int tableSlot = findSymbol(currentToken, &context->symTable);
+		
+		if (tableSlot < 0)
+		{
+			locateToken(context, currentToken);
+			reportDiagnostic(context, SCANNER_ERROR_NOT_DECLARED, 
+				currentToken->lineNumber, currentToken->column, 
+				"*ERROR: TOKEN %.*s WAS NOT DECLARED", currentToken->length, 
+				currentToken->string);
+		}
+		else if (context->symTable.uses != NULL)
+		{
+			locateToken(context, currentToken);
+			addUse(&context->symTable, tableSlot, currentToken);
+		}
+	}
 }
 
+#ifdef SCANNER_STATS
 /*-----------------------------------------------------------------------------
-* getNewLine function:
-* Input: a pointer to an input file, a pointer to a line object.
+* collectStats function:
+* Input: a pointer to the total statistics and a pointer to a scannerContext 
+*   object that has finished its scan
 * Output: void
-* Purpose: Increments the lineNumber of the line object, assigns a new line 
-*   from the file to the line object's string member, and resets the line's 
-*   index to zero. 
+* Purpose: Stops the context's phase timer, notes how full its symbol table 
+*   ended up, and adds its statistics to the total.
 -----------------------------------------------------------------------------*/
 
-void getNewLine(FILE *inputFile, line *currentLine)
+void collectStats(scanStats *total, scannerContext *context)
 {
-    currentLine->lineNumber = currentLine->lineNumber + 1;
-    fgets(currentLine->string, LINE_LENGTH, inputFile);
-    currentLine->index = 0;
+	scanStats *stats = context->stats;
+	if (stats == NULL)
+	{
+		return;
+	}
+
+	enterPhase(stats, PHASE_IDLE);
+	stats->symbolCount = context->symTable.count;
+	stats->symbolCapacity = context->symTable.capacity;
+	mergeStats(total, stats);
 }
+#endif
 
 /*-----------------------------------------------------------------------------
-* getToken function:
-* Input: a pointer to an input file, a pointer to the current line, a pointer 
-*   to an output file, and a pointer to a table object.
-* Output: void
-* Purpose: Gets a new line from the input file as needed, then calls functions 
-*   to build tokens from the line. Once a token is built, it is assigned a 
-*   token ID by comparison to the token table and is printed to the output file.
+* closeOutput function:
+* Input: a pointer to an outputBuffer object
+* Output: a boolean that is false if any of the output could not be stored
+*   or written
+* Purpose: Flushes whatever is left in a buffer with a file and releases the 
+*   buffer. The file itself is left open.
 -----------------------------------------------------------------------------*/
 
-token getToken (FILE *inputFile, line *currentLine, 
-				tokenTable *table, FILE *outputFile) 
+bool closeOutput(outputBuffer *output)
 {
-    /* Get new line from input file if needed */
-    if ((currentLine->lineNumber == 0) || 
-        (currentLine->string[currentLine->index] == '\n'))
+    if (output->file != NULL)
     {
-        getNewLine(inputFile, currentLine);  
-        formatLine(currentLine);
-        printLine(outputFile, currentLine);
-	}
+        flushOutput(output, NULL, 0);
+    }
 
-	token currentToken = buildToken(inputFile, currentLine, outputFile);
-	assignID(table, &currentToken);
-	
-	return currentToken;
+    free(output->data);
+    output->data = NULL;
+    return output->failed == false;
 }
 
 /*-----------------------------------------------------------------------------
-* ignoreComment function:
-* Input: a pointer to an input file, a pointer to an output file, a pointer to 
-*   a line object.
+* closeSource function:
+* Input: a pointer to a source object
 * Output: void
-* Purpose: Ignores all characters within a comment. If a comment passes over 
-*   multiple lines, a new line is read from the file.
+* Purpose: Releases the buffer holding the input file, unmapping it if it was 
+*		memory-mapped and freeing it otherwise. The file__close probe gives 
+*		the number of bytes that were loaded.
 -----------------------------------------------------------------------------*/
 
-void ignoreComment(FILE *inputFile, line *currentLine, FILE *outputFile)
+void closeSource(source *input)
 {
-    bool stop = false;
+#ifdef SCANNER_PROBES
+	DTRACE_PROBE1(scanner, file__close, input->length);
+#endif
+#ifdef SCANNER_POSIX
+	if (input->mapped == true)
+	{
+		munmap(input->buffer, input->length);
+		input->buffer = NULL;
+		return;
+	}
+#endif
+	free(input->buffer);
+	input->buffer = NULL;
+}
+
+/*-----------------------------------------------------------------------------
+* compactDocumentNames function:
+* Input: a pointer to a scannerDocument object
+* Output: void
+* Purpose: Names are interned in the document's arena whenever an edit 
+*   changes the declared list, and the names they replace are left behind. 
+*   Once most of the arena is left behind, the declared names are copied to 
+*   a fresh arena and the old one is released, so a document that is edited 
+*   for a long time does not keep growing. Nothing changes if memory runs 
+*   out part way.
+-----------------------------------------------------------------------------*/
+
+void compactDocumentNames(scannerDocument *document)
+{
+    size_t used = 0;
+    arenaBlock *block = document->names;
+    for (block = document->names; block != NULL; block = block->next)
+    {
+        used = used + block->used;
+    }
+
+    size_t live = 0;
+    int i = 0;
+    for (i = 0; i < document->declaredCount; i++)
+    {
+        live = live + document->declared[i].length + 1;
+    }
+    if (used <= 2 * live + ARENA_BLOCK_SIZE)
+    {
+        return;
+    }
 
-    while (stop == false && !feof(inputFile))
+    arenaBlock *names = NULL;
+    char **strings = malloc((document->declaredCount + 1) * sizeof(char *));
+    for (i = 0; strings != NULL && i < document->declaredCount; i++)
     {
-        /* Stopping condition, "*)" */
-        if (currentLine->string[currentLine->index] == '*' && 
-            currentLine->string[currentLine->index + 1] == ')')
+        strings[i] = internString(&names, document->declared[i].string, 
+                                  document->declared[i].length);
+        if (strings[i] == NULL)
         {
-            stop = true;
+            break;
         }
-        /* Gets a new line if needed */
-        else if (currentLine->string[currentLine->index] == '\n' || 
-                (currentLine->index) == LINE_LENGTH)
-        {
-            getNewLine(inputFile, currentLine); 
-            formatLine(currentLine);
-            printLine(outputFile, currentLine);
+    }
 
+    if (strings != NULL && i == document->declaredCount)
+    {
+        for (i = 0; i < document->declaredCount; i++)
+        {
+            document->declared[i].string = strings[i];
         }
-        
-        currentLine->index++;
+        freeArena(&document->names);
+        document->names = names;
+    }
+    else
+    {
+        freeArena(&names);
     }
+    free(strings);
 }
 
 /*-----------------------------------------------------------------------------
-* printLine function:
-* Input: a pointer to an output file, a pointer to a line object.
-* Output: void
-* Purpose: Writes the line's lineNumber and string to the output file, 
-*   including whitespace between lines.
+* compareBatchOutputs function:
+* Input: pointers to two batchOutput objects
+* Output: a negative number, zero or a positive number as the first output 
+*   name sorts before, with, or after the second
+* Purpose: Orders the files of a batch by output name for qsort, so files 
+*   that would share an output end up next to each other.
+-----------------------------------------------------------------------------*/
+
+int compareBatchOutputs(const void *left, const void *right)
+{
+    return strcmp(((const batchOutput *)left)->outputFilename, 
+                  ((const batchOutput *)right)->outputFilename);
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* compareCacheEntries function:
+* Input: pointers to two cacheEntry objects
+* Output: a number below, equal to or above zero as the first entry was used 
+*   before, at the same time as, or after the second
+* Purpose: Orders cache entries from least to most recently used for qsort.
 -----------------------------------------------------------------------------*/
 
-void printLine(FILE *outputFile, line *currentLine)
+int compareCacheEntries(const void *left, const void *right)
 {
-    if (currentLine->lineNumber > 1)
+    const cacheEntry *first = left;
+    const cacheEntry *second = right;
+    return (first->used > second->used) - (first->used < second->used);
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* compareIndexSymbols function:
+* Input: pointers to two scannerIndexSymbol objects
+* Output: a negative number, zero or a positive number as the first name 
+*   sorts before, with, or after the second
+* Purpose: Orders the identifiers of a cross-reference index by name for 
+*   qsort and bsearch. Names are uppercase and NUL padded, so comparing 
+*   their bytes is enough.
+-----------------------------------------------------------------------------*/
+
+int compareIndexSymbols(const void *left, const void *right)
+{
+    return memcmp(((const scannerIndexSymbol *)left)->name, 
+                  ((const scannerIndexSymbol *)right)->name, 
+                  SCANNER_STREAM_NAME_LENGTH);
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* connectServer function:
+* Input: a pointer to a character containing the path of a server's socket
+* Output: a connected socket, or -1 if no server is taking connections there
+* Purpose: Opens a connection to a scan server. It is used to tell whether a 
+*   server is already running before a new one takes over the path, and to 
+*   wake the threads of a server that is stopping.
+-----------------------------------------------------------------------------*/
+
+int connectServer(char *socketPath)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path))
     {
-        /* Add space between lines */
-        fprintf(outputFile, "\n");
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection >= 0 && 
+        connect(connection, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(connection);
+        connection = -1;
     }
-    fprintf(outputFile, "%d\t%s", currentLine->lineNumber, 
-                                  currentLine->string);
+    return connection;
 }
+#endif
 
 /*-----------------------------------------------------------------------------
-* printSymbolTable function:
-* Input: a pointer to a symbol table object and a pointer to an output file
-* Output: void
-* Purpose: This function prints to a given file an entire symbol table, one 
-*		item per line. Each line starts with the index of the identifier in 
-*		the table and ends with the string of the identifier.
+* constructSymbolTable function:
+* Input: None
+* Output: a symbolTable with SYMBOL_TABLE_LENGTH blank slots
+* Purpose: This function creates an empty symbol table. Every slot starts 
+*			with a blank token string and a token ID of zero, which marks 
+*			the slot as free. The table grows as identifiers are added.
 -----------------------------------------------------------------------------*/
 
-void printSymbolTable(symbolTable *symTable, FILE *outputFile)
-{	
-	fprintf(outputFile, "\n\nSYMBOL TABLE:\n");
+symbolTable constructSymbolTable()
+{
+	symbolTable symTable;
 	
-	int i = 0;
-	for (i = 0; i < SYMBOL_TABLE_LENGTH; i++)
+	symTable.capacity = SYMBOL_TABLE_LENGTH;
+	symTable.count = 0;
+	symTable.token = calloc(symTable.capacity, sizeof(token));
+	symTable.names = NULL;
+	symTable.frozen = NULL;
+	symTable.keys = NULL;
+	symTable.tags = NULL;
+	symTable.slots = NULL;
+	symTable.groupMask = 0;
+	symTable.uses = NULL;
+#ifdef SCANNER_STATS
+	symTable.stats = NULL;
+#endif
+	if (symTable.token == NULL)
 	{
-		fprintf(outputFile, "%d\t%s\n", i + 1, symTable->token[i].string);
+		printf("Error: Symbol table could not be allocated.");
+		exit(1);
 	}
+	
+	return symTable;
 }
 
 /*-----------------------------------------------------------------------------
-* printToken function:
-* Input: a pointer to an input file, a pointer to a token object.
-* Output: void
-* Purpose: Writes the token's ID and string to the output file. This function 
-*   only writes tokens with valid IDs, and inserts '^' before the string for 
-*   variable tokens and '#' for integers.
+* constructTokenTable function:
+* Input: a pointer to a character containing the file name
+* Output: a tokenTable object
+* Purpose: Builds a tokenTable object using input from a text file, read by 
+* readTokenTable. The keyword hash used by assignID and the tables used by 
+* buildTokenFromTable are built once the table has been read. The program 
+* ends with an error if the file cannot be opened, is not a valid token 
+* table, or cannot be hashed.
 -----------------------------------------------------------------------------*/
 
-void printToken(FILE *outputFile, token *currentToken)
+tokenTable constructTokenTable(char* tokenTableFilename)
 {
-    if (currentToken->ID == 0)
+    /* Read token table and check for errors */
+    tokenTable table;
+    char error[MESSAGE_LENGTH];
+    if (readTokenTable(tokenTableFilename, &table, error) == false) {
+        printf("Error: %s\n", error);
+        exit(1);
+    }
+
+    if (buildKeywordHash(&table) == false) {
+        printf("Error: Token table could not be hashed.\n");
+        exit(1);
+    }
+    buildLexerTables(&table);
+    return table;
+}
+
+#ifdef SCANNER_SIMD
+/*-----------------------------------------------------------------------------
+* countRunAVX2 function:
+* Input: a pointer to a string, the number of bytes that may be read, the 
+*   lowest and highest characters in the run, and bits to OR into each byte 
+*   before comparing
+* Output: the number of leading characters that are in the run
+* Purpose: AVX2 version of countRunScalar, testing 32 bytes at a time.
+-----------------------------------------------------------------------------*/
+
+__attribute__((target("avx2")))
+int countRunAVX2(char *string, int length, char low, char high, char fold)
+{
+    __m256i below = _mm256_set1_epi8((char)(low - 1));
+    __m256i above = _mm256_set1_epi8((char)(high + 1));
+    __m256i foldBits = _mm256_set1_epi8(fold);
+
+    int i = 0;
+    for (i = 0; i + 32 <= length; i += 32)
     {
-        /*
-        * Intentionally blank to prevent printing 
-        * tokens without valid IDs, such as forbidden characters.
-        */
+        __m256i bytes = _mm256_or_si256(
+            _mm256_loadu_si256((__m256i *)(string + i)), foldBits);
+        __m256i inRun = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, below), 
+                                         _mm256_cmpgt_epi8(above, bytes));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(inRun);
+        if (mask != 0xFFFFFFFFu)
+        {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+
+    return i + countRunScalar(string + i, length - i, low, high, fold);
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* countRunScalar function:
+* Input: a pointer to a string, the number of bytes that may be read, the 
+*   lowest and highest characters in the run, and bits to OR into each byte 
+*   before comparing
+* Output: the number of leading characters that are in the run
+* Purpose: Counts how many characters at the start of the string fall in the 
+*   range low to high. Letters of either case are counted by folding them 
+*   with 0x20 and comparing against 'a' to 'z'. Only ASCII characters are 
+*   ever in a run.
+-----------------------------------------------------------------------------*/
+
+int countRunScalar(char *string, int length, char low, char high, char fold)
+{
+    int i = 0;
+    while (i < length && (char)(string[i] | fold) >= low && 
+                         (char)(string[i] | fold) <= high)
+    {
+        i++;
     }
-    else if (currentToken->ID == 22)
+
+    return i;
+}
+
+#ifdef SCANNER_SIMD
+/*-----------------------------------------------------------------------------
+* countRunSSE2 function:
+* Input: a pointer to a string, the number of bytes that may be read, the 
+*   lowest and highest characters in the run, and bits to OR into each byte 
+*   before comparing
+* Output: the number of leading characters that are in the run
+* Purpose: SSE2 version of countRunScalar, testing 16 bytes at a time.
+-----------------------------------------------------------------------------*/
+
+__attribute__((target("sse2")))
+int countRunSSE2(char *string, int length, char low, char high, char fold)
+{
+    __m128i below = _mm_set1_epi8((char)(low - 1));
+    __m128i above = _mm_set1_epi8((char)(high + 1));
+    __m128i foldBits = _mm_set1_epi8(fold);
+
+    int i = 0;
+    for (i = 0; i + 16 <= length; i += 16)
     {
-        /* Adds a '^' to id tokens */
-        fprintf(outputFile, "\t\t%d\t\t^%s\n", 
-                currentToken->ID, currentToken->string);
+        __m128i bytes = _mm_or_si128(
+            _mm_loadu_si128((__m128i *)(string + i)), foldBits);
+        __m128i inRun = _mm_and_si128(_mm_cmpgt_epi8(bytes, below), 
+                                      _mm_cmpgt_epi8(above, bytes));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(inRun);
+        if (mask != 0xFFFFu)
+        {
+            return i + __builtin_ctz(~mask);
+        }
     }
-    else if (currentToken->ID == 23)
+
+    return i + countRunScalar(string + i, length - i, low, high, fold);
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* decodeUses function:
+* Input: a pointer to a list of use sites packed by addUse, its length in 
+*   bytes, a pointer to an array for the sites, and how many it can hold
+* Output: the number of sites in the list, of which the first capacity are 
+*   stored, or -1 if the list ends in the middle of a site
+* Purpose: Unpacks a list of uses, adding up the line and column deltas.
+-----------------------------------------------------------------------------*/
+
+int decodeUses(const unsigned char *data, size_t length, scannerUseSite *sites, 
+               int capacity)
+{
+    int count = 0;
+    int lineNumber = 0;
+    int column = 0;
+    size_t position = 0;
+    while (position < length)
     {
-        /* Adds a '#' to integer tokens */
-        fprintf(outputFile, "\t\t%d\t\t#%s\n", 
-                currentToken->ID, currentToken->string);
+        unsigned int value[2];
+        int i = 0;
+        for (i = 0; i < 2; i++)
+        {
+            unsigned int shift = 0;
+            unsigned char byte = 0x80;
+            value[i] = 0;
+            while ((byte & 0x80) != 0)
+            {
+                if (position >= length || shift > 28)
+                {
+                    return -1;
+                }
+                byte = data[position];
+                position++;
+                value[i] = value[i] | (unsigned int)(byte & 0x7F) << shift;
+                shift = shift + 7;
+            }
+        }
+
+        lineNumber = lineNumber + (int)value[0];
+        column = value[0] == 0 ? column + (int)value[1] : (int)value[1];
+        if (count < capacity)
+        {
+            sites[count].lineNumber = lineNumber;
+            sites[count].column = column;
+        }
+        count++;
     }
-    else
+
+    return count;
+}
+
+/*-----------------------------------------------------------------------------
+* endOfSource function:
+* Input: a pointer to a scannerContext object
+* Output: a boolean that is true once every token in the input has been read
+* Purpose: The input is exhausted when the lexer has reached the '\n' that 
+*   ends its last line. Before the first token is read, while the input has 
+*   no line index yet, the input is never considered exhausted.
+-----------------------------------------------------------------------------*/
+
+bool endOfSource(scannerContext *context)
+{
+    if (context->lines.newline == NULL)
     {
-        fprintf(outputFile, "\t\t%d\t\t%s\n", 
-                currentToken->ID, currentToken->string);
-    }  
+        return false;
+    }
+
+    return context->input.position + 1 >= context->input.length;
 }
 
+#ifdef SCANNER_STATS
 /*-----------------------------------------------------------------------------
-* searchForSymbol function:
-* Input: a pointer to a token, a pointer to a symbolTable
-* Output: a boolean representing whether or not the token is an element of the 
-*		symbol table
-* Purpose: This function returns a boolean with the true value if the token is 
-*		in the symbol table, and the false value if the token is not. This 
-*		function uses a hash to search the table efficiently.
+* enterPhase function:
+* Input: a pointer to a scanStats object (or NULL), and the phase the scan 
+*   is moving on to
+* Output: the phase the scan was in
+* Purpose: Charges the time since the last change of phase to the phase 
+*   that is ending and starts timing the new one. PHASE_IDLE stops the 
+*   timer. Does nothing when the scan keeps no statistics.
 -----------------------------------------------------------------------------*/
 
-bool searchForSymbol(token *currentToken, symbolTable *symTable)
+int enterPhase(scanStats *stats, int phase)
 {
-	int i = 0;
-	int count = 0;
-	bool isInTable = false;
-	bool emptySpot = false;
-	
-	/* Calculate hash */
-	int tableSlot = getHash(currentToken);
-	
-	while ((count < SYMBOL_TABLE_LENGTH) && (emptySpot == false))
+	if (stats == NULL)
 	{
-		if (tableSlot == SYMBOL_TABLE_LENGTH)
-		{
-			tableSlot = 0;
-		}
-		
-		if (symTable->token[tableSlot].ID == 0)
-		{
-			/* Empty spot reached, loop can be exited */
-			emptySpot = true;
-		}
-		
-		if (strcmp(symTable->token[tableSlot].string, 
-			currentToken->string) == 0)
-		{
-			isInTable = true;
-		}
-		
-		tableSlot = tableSlot + 1;
-		count = count + 1;
+		return PHASE_IDLE;
 	}
-	
-	return isInTable;
+
+	int previous = stats->currentPhase;
+	uint64_t now = 0;
+	if (previous != PHASE_IDLE || phase != PHASE_IDLE)
+	{
+		now = readTimer();
+	}
+	if (previous != PHASE_IDLE)
+	{
+		stats->phaseTicks[previous] = stats->phaseTicks[previous] + 
+		                              (now - stats->mark);
+	}
+
+	stats->currentPhase = phase;
+	stats->mark = now;
+	return previous;
+}
+#endif
+
+#ifdef SCANNER_SIMD
+/*-----------------------------------------------------------------------------
+* findCommentEndAVX2 function:
+* Input: a pointer to a string and its length
+* Output: the index of the first "*)" in the string, or its length
+* Purpose: AVX2 version of findCommentEndScalar. Each 32 bytes are compared 
+*   with '*' and, one byte further on, with ')', so a block is searched 
+*   with two compares and a test.
+-----------------------------------------------------------------------------*/
+
+__attribute__((target("avx2")))
+size_t findCommentEndAVX2(const char *string, size_t length)
+{
+    __m256i star = _mm256_set1_epi8('*');
+    __m256i close = _mm256_set1_epi8(')');
+
+    size_t i = 0;
+    for (i = 0; i + 32 <= length; i += 32)
+    {
+        __m256i first = _mm256_loadu_si256((const __m256i *)(string + i));
+        __m256i second = _mm256_loadu_si256((const __m256i *)(string + i + 1));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, star), 
+                             _mm256_cmpeq_epi8(second, close)));
+        if (mask != 0)
+        {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+
+    return i + findCommentEndScalar(string + i, length - i);
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* findCommentEndScalar function:
+* Input: a pointer to a string and its length
+* Output: the index of the first "*)" in the string, or its length
+* Purpose: Finds where a comment ends, looking for each '*' with memchr. 
+*   The byte after the string is read, so a "*)" can start at its last byte.
+-----------------------------------------------------------------------------*/
+
+size_t findCommentEndScalar(const char *string, size_t length)
+{
+    const char *end = string + length;
+    const char *next = memchr(string, '*', length);
+    while (next != NULL && next[1] != ')')
+    {
+        next = memchr(next + 1, '*', (size_t)(end - next - 1));
+    }
+
+    return next != NULL ? (size_t)(next - string) : length;
+}
+
+#ifdef SCANNER_SIMD
+/*-----------------------------------------------------------------------------
+* findCommentEndSSE2 function:
+* Input: a pointer to a string and its length
+* Output: the index of the first "*)" in the string, or its length
+* Purpose: SSE2 version of findCommentEndScalar, searching 16 bytes at a 
+*   time.
+-----------------------------------------------------------------------------*/
+
+__attribute__((target("sse2")))
+size_t findCommentEndSSE2(const char *string, size_t length)
+{
+    __m128i star = _mm_set1_epi8('*');
+    __m128i close = _mm_set1_epi8(')');
+
+    size_t i = 0;
+    for (i = 0; i + 16 <= length; i += 16)
+    {
+        __m128i first = _mm_loadu_si128((const __m128i *)(string + i));
+        __m128i second = _mm_loadu_si128((const __m128i *)(string + i + 1));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, star), 
+                          _mm_cmpeq_epi8(second, close)));
+        if (mask != 0)
+        {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+
+    return i + findCommentEndScalar(string + i, length - i);
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* findFrozenSymbolScalar function:
+* Input: a pointer to a token object of fewer than SYMBOL_KEY_LENGTH 
+*   characters, a pointer to a frozen symbolTable, and a pointer to the 
+*   number of groups looked at
+* Output: the slot holding the token, or -1 if it is not in the symbol 
+*   table
+* Purpose: Searches the frozen layout built by freezeSymbolTable. The token's 
+*   hash picks the group to start at and gives the tag to look for. Only 
+*   keys whose tag matches are compared, and the search ends at the first 
+*   group that still has an empty slot, since a name is only ever placed 
+*   in a later group when every slot of the earlier ones is taken.
+-----------------------------------------------------------------------------*/
+
+int findFrozenSymbolScalar(token *currentToken, symbolTable *symTable, 
+                            int *probes)
+{
+    symbolKey key;
+    memset(&key, 0, sizeof(key));
+    int i = 0;
+    for (i = 0; i < currentToken->length; i++)
+    {
+        key.name[i] = foldCharacter(currentToken->string[i]);
+    }
+
+    unsigned int hash = getHash(currentToken);
+    unsigned char tag = (unsigned char)(0x80 | (hash & 0x7F));
+    unsigned int group = (hash >> 7) & symTable->groupMask;
+    *probes = 0;
+    while (true)
+    {
+        unsigned char *tags = symTable->tags + group * SYMBOL_GROUP_SIZE;
+        symbolKey *keys = symTable->keys + group * SYMBOL_GROUP_SIZE;
+        bool open = false;
+        *probes = *probes + 1;
+
+        for (i = 0; i < SYMBOL_GROUP_SIZE; i++)
+        {
+            if (tags[i] == tag && 
+                memcmp(keys[i].name, key.name, SYMBOL_KEY_LENGTH) == 0)
+            {
+                return symTable->slots[group * SYMBOL_GROUP_SIZE + i];
+            }
+            open = open || tags[i] == SYMBOL_TAG_EMPTY;
+        }
+
+        if (open == true)
+        {
+            return -1;
+        }
+        group = (group + 1) & symTable->groupMask;
+    }
+}
+
+#ifdef SCANNER_SIMD
+/*-----------------------------------------------------------------------------
+* findFrozenSymbolSSE2 function:
+* Input: a pointer to a token object of fewer than SYMBOL_KEY_LENGTH 
+*   characters, a pointer to a frozen symbolTable, and a pointer to the 
+*   number of groups looked at
+* Output: the slot holding the token, or -1 if it is not in the symbol 
+*   table
+* Purpose: SSE2 version of findFrozenSymbolScalar. The sixteen tags of a 
+*   group are matched against the token's tag in one compare, and each 
+*   candidate key against the token's key in one more, so a name that is 
+*   found in its first group costs a load of its tags and of its key.
+-----------------------------------------------------------------------------*/
+
+__attribute__((target("sse2")))
+int findFrozenSymbolSSE2(token *currentToken, symbolTable *symTable, 
+                          int *probes)
+{
+    symbolKey key;
+    memset(&key, 0, sizeof(key));
+    int i = 0;
+    for (i = 0; i < currentToken->length; i++)
+    {
+        key.name[i] = foldCharacter(currentToken->string[i]);
+    }
+
+    unsigned int hash = getHash(currentToken);
+    __m128i wanted = _mm_loadu_si128((__m128i *)key.name);
+    __m128i tag = _mm_set1_epi8((char)(0x80 | (hash & 0x7F)));
+    __m128i empty = _mm_set1_epi8(SYMBOL_TAG_EMPTY);
+    unsigned int group = (hash >> 7) & symTable->groupMask;
+    *probes = 0;
+    while (true)
+    {
+        __m128i tags = _mm_load_si128(
+            (__m128i *)(symTable->tags + group * SYMBOL_GROUP_SIZE));
+        symbolKey *keys = symTable->keys + group * SYMBOL_GROUP_SIZE;
+        unsigned int candidates = 
+            (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(tags, tag));
+        *probes = *probes + 1;
+
+        while (candidates != 0)
+        {
+            i = __builtin_ctz(candidates);
+            __m128i name = _mm_load_si128((__m128i *)keys[i].name);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(name, wanted)) == 0xFFFF)
+            {
+                return symTable->slots[group * SYMBOL_GROUP_SIZE + i];
+            }
+            candidates = candidates & (candidates - 1);
+        }
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(tags, empty)) != 0)
+        {
+            return -1;
+        }
+        group = (group + 1) & symTable->groupMask;
+    }
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* findLine function:
+* Input: a pointer to a lineIndex object and an offset in its input
+* Output: the line holding the offset, counting the input's first line as 0
+* Purpose: Finds the first line whose '\n' is at or after the offset by 
+*   binary search. Tokens are mostly located in the order they are read, so 
+*   the line found last, and the one after it, are tried first.
+-----------------------------------------------------------------------------*/
+
+int findLine(lineIndex *lines, size_t offset)
+{
+    int found = lines->lastFound;
+    if (found < lines->count && lines->newline[found] < offset)
+    {
+        found++;
+    }
+    if (found < lines->count && lines->newline[found] >= offset && 
+        (found == 0 || lines->newline[found - 1] < offset))
+    {
+        lines->lastFound = found;
+        return found;
+    }
+
+    int low = 0;
+    int high = lines->count - 1;
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        if (lines->newline[middle] < offset)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    lines->lastFound = low;
+    return low;
+}
+
+#ifdef SCANNER_SIMD
+/*-----------------------------------------------------------------------------
+* findNewlinesAVX2 function:
+* Input: a pointer to a string, its length, the offset of the string in its 
+*   input, and a pointer to an array with room for a '\n' at every byte
+* Output: the number of '\n' characters found
+* Purpose: AVX2 version of findNewlinesScalar, testing 64 bytes at a time in 
+*   two compares whose masks are joined into one 64-bit word.
+-----------------------------------------------------------------------------*/
+
+__attribute__((target("avx2")))
+size_t findNewlinesAVX2(const char *string, size_t length, size_t base, 
+                        size_t *newline)
+{
+    __m256i wanted = _mm256_set1_epi8('\n');
+
+    size_t count = 0;
+    size_t i = 0;
+    for (i = 0; i + 64 <= length; i += 64)
+    {
+        __m256i low = _mm256_loadu_si256((const __m256i *)(string + i));
+        __m256i high = _mm256_loadu_si256((const __m256i *)(string + i + 32));
+        uint64_t mask = (uint64_t)(unsigned int)_mm256_movemask_epi8(
+                            _mm256_cmpeq_epi8(low, wanted)) | 
+                        (uint64_t)(unsigned int)_mm256_movemask_epi8(
+                            _mm256_cmpeq_epi8(high, wanted)) << 32;
+        while (mask != 0)
+        {
+            newline[count] = base + i + (size_t)__builtin_ctzll(mask);
+            count++;
+            mask = mask & (mask - 1);
+        }
+    }
+
+    return count + findNewlinesScalar(string + i, length - i, base + i, 
+                                      newline + count);
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* findNewlinesScalar function:
+* Input: a pointer to a string, its length, the offset of the string in its 
+*   input, and a pointer to an array with room for a '\n' at every byte
+* Output: the number of '\n' characters found
+* Purpose: Stores the offset in the input of each '\n' in the string, in 
+*   order, finding each one with memchr.
+-----------------------------------------------------------------------------*/
+
+size_t findNewlinesScalar(const char *string, size_t length, size_t base, 
+                          size_t *newline)
+{
+    size_t count = 0;
+    const char *end = string + length;
+    const char *next = memchr(string, '\n', length);
+    while (next != NULL)
+    {
+        newline[count] = base + (size_t)(next - string);
+        count++;
+        next = memchr(next + 1, '\n', (size_t)(end - next - 1));
+    }
+
+    return count;
+}
+
+#ifdef SCANNER_SIMD
+/*-----------------------------------------------------------------------------
+* findNewlinesSSE2 function:
+* Input: a pointer to a string, its length, the offset of the string in its 
+*   input, and a pointer to an array with room for a '\n' at every byte
+* Output: the number of '\n' characters found
+* Purpose: SSE2 version of findNewlinesScalar. Each block of 64 bytes is 
+*   compared with '\n' sixteen bytes at a time and the four masks are joined 
+*   into one 64-bit word, whose set bits are then taken lowest first, so a 
+*   block without a line end costs four compares and a test.
+-----------------------------------------------------------------------------*/
+
+__attribute__((target("sse2")))
+size_t findNewlinesSSE2(const char *string, size_t length, size_t base, 
+                        size_t *newline)
+{
+    __m128i wanted = _mm_set1_epi8('\n');
+
+    size_t count = 0;
+    size_t i = 0;
+    for (i = 0; i + 64 <= length; i += 64)
+    {
+        uint64_t mask = 0;
+        int part = 0;
+        for (part = 0; part < 4; part++)
+        {
+            __m128i bytes = _mm_loadu_si128(
+                (const __m128i *)(string + i + part * 16));
+            mask = mask | (uint64_t)(unsigned int)_mm_movemask_epi8(
+                              _mm_cmpeq_epi8(bytes, wanted)) << (part * 16);
+        }
+        while (mask != 0)
+        {
+            newline[count] = base + i + (size_t)__builtin_ctzll(mask);
+            count++;
+            mask = mask & (mask - 1);
+        }
+    }
+
+    return count + findNewlinesScalar(string + i, length - i, base + i, 
+                                      newline + count);
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* findSymbol function:
+* Input: a pointer to a token, a pointer to a symbolTable
+* Output: the slot holding the token, or -1 if it is not in the symbol table
+* Purpose: Searches the table using the token's hash. A frozen table is 
+*		searched in its frozen layout, where the statistics count each 
+*		group of keys looked at as one probe.
+-----------------------------------------------------------------------------*/
+
+int findSymbol(token *currentToken, symbolTable *symTable)
+{
+	if (symTable->frozen != NULL && currentToken->length < SYMBOL_KEY_LENGTH)
+	{
+		int probes = 0;
+		int tableSlot = findFrozenSymbol(currentToken, symTable, &probes);
+#ifdef SCANNER_PROBES
+		DTRACE_PROBE4(scanner, symbol__lookup, currentToken->string, 
+		              currentToken->length, tableSlot, probes);
+#endif
+#ifdef SCANNER_STATS
+		if (symTable->stats != NULL)
+		{
+			if (probes > PROBE_HISTOGRAM_LENGTH)
+			{
+				probes = PROBE_HISTOGRAM_LENGTH;
+			}
+			symTable->stats->probeCount[probes - 1]++;
+		}
+#endif
+		return tableSlot;
+	}
+
+	int probes = 0;
+	int tableSlot = getSymbolSlot(currentToken, symTable, &probes);
+	if (symTable->token[tableSlot].ID == 0)
+	{
+		tableSlot = -1;
+	}
+#ifdef SCANNER_PROBES
+	DTRACE_PROBE4(scanner, symbol__lookup, currentToken->string, 
+	              currentToken->length, tableSlot, probes);
+#endif
+	
+	return tableSlot;
+}
+
+/*-----------------------------------------------------------------------------
+* flushOutput function:
+* Input: a pointer to an outputBuffer object with a file, a pointer to some 
+*   bytes (or NULL), and the number of bytes
+* Output: a boolean that is false if the output could not be written
+* Purpose: Writes the buffered output to the file, followed by the given 
+*   bytes, and empties the buffer. On POSIX systems both go out in one 
+*   writev call on the file's descriptor, repeated until everything has 
+*   been written. Nothing else writes to the file through stdio, so there 
+*   is no stdio buffer to keep in step with.
+-----------------------------------------------------------------------------*/
+
+bool flushOutput(outputBuffer *output, const char *bytes, size_t length)
+{
+    if (output->failed == true)
+    {
+        output->length = 0;
+        return false;
+    }
+#ifdef SCANNER_STATS
+    output->written = output->written + output->length + length;
+#endif
+
+#ifdef SCANNER_POSIX
+    struct iovec parts[2];
+    parts[0].iov_base = output->data;
+    parts[0].iov_len = output->length;
+    parts[1].iov_base = (char *)bytes;
+    parts[1].iov_len = length;
+
+    int descriptor = fileno(output->file);
+    int first = 0;
+    while (first < 2)
+    {
+        if (parts[first].iov_len == 0)
+        {
+            first++;
+            continue;
+        }
+
+        ssize_t written = writev(descriptor, parts + first, 2 - first);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            output->failed = true;
+            break;
+        }
+
+        /* Step past whatever was written, which may end partway through */
+        while (written > 0)
+        {
+            size_t step = (size_t)written < parts[first].iov_len 
+                        ? (size_t)written : parts[first].iov_len;
+            parts[first].iov_base = (char *)parts[first].iov_base + step;
+            parts[first].iov_len = parts[first].iov_len - step;
+            written = written - (ssize_t)step;
+            if (parts[first].iov_len == 0)
+            {
+                first++;
+            }
+        }
+    }
+#else
+    if (fwrite(output->data, 1, output->length, output->file) != output->length || 
+        (length > 0 && fwrite(bytes, 1, length, output->file) != length))
+    {
+        output->failed = true;
+    }
+#endif
+
+    output->length = 0;
+    return output->failed == false;
+}
+
+#ifdef SCANNER_SIMD
+/*-----------------------------------------------------------------------------
+* foldCaseAVX2 function:
+* Input: a pointer to a string and its length
+* Output: void
+* Purpose: AVX2 version of foldCaseScalar, converting 32 bytes at a time.
+-----------------------------------------------------------------------------*/
+
+__attribute__((target("avx2")))
+void foldCaseAVX2(char *string, int length)
+{
+    __m256i below = _mm256_set1_epi8('a' - 1);
+    __m256i above = _mm256_set1_epi8('z' + 1);
+    __m256i caseBit = _mm256_set1_epi8(0x20);
+
+    int i = 0;
+    for (i = 0; i + 32 <= length; i += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((__m256i *)(string + i));
+        __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, below), 
+                                         _mm256_cmpgt_epi8(above, bytes));
+        bytes = _mm256_sub_epi8(bytes, _mm256_and_si256(lower, caseBit));
+        _mm256_storeu_si256((__m256i *)(string + i), bytes);
+    }
+
+    foldCaseScalar(string + i, length - i);
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* foldCaseScalar function:
+* Input: a pointer to a string and its length
+* Output: void
+* Purpose: Converts the letters 'a' to 'z' in the string to uppercase, one 
+*   byte at a time. Other bytes are left alone, as toupper does.
+-----------------------------------------------------------------------------*/
+
+void foldCaseScalar(char *string, int length)
+{
+    int i = 0;
+    for (i = 0; i < length; i++)
+    {
+        if (string[i] >= 'a' && string[i] <= 'z')
+        {
+            string[i] = string[i] - 0x20;
+        }
+    }
+}
+
+#ifdef SCANNER_SIMD
+/*-----------------------------------------------------------------------------
+* foldCaseSSE2 function:
+* Input: a pointer to a string and its length
+* Output: void
+* Purpose: SSE2 version of foldCaseScalar, converting 16 bytes at a time.
+-----------------------------------------------------------------------------*/
+
+__attribute__((target("sse2")))
+void foldCaseSSE2(char *string, int length)
+{
+    __m128i below = _mm_set1_epi8('a' - 1);
+    __m128i above = _mm_set1_epi8('z' + 1);
+    __m128i caseBit = _mm_set1_epi8(0x20);
+
+    int i = 0;
+    for (i = 0; i + 16 <= length; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((__m128i *)(string + i));
+        __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(bytes, below), 
+                                      _mm_cmpgt_epi8(above, bytes));
+        bytes = _mm_sub_epi8(bytes, _mm_and_si128(lower, caseBit));
+        _mm_storeu_si128((__m128i *)(string + i), bytes);
+    }
+
+    foldCaseScalar(string + i, length - i);
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* foldCharacter function:
+* Input: a character
+* Output: the character in uppercase
+* Purpose: Converts one of the letters 'a' to 'z' to uppercase and returns 
+*   any other character as it is, so that hashes and comparisons of names 
+*   can ignore case without changing the text they read.
+-----------------------------------------------------------------------------*/
+
+char foldCharacter(char character)
+{
+    if (character >= 'a' && character <= 'z')
+    {
+        return character - 0x20;
+    }
+    return character;
+}
+
+/*-----------------------------------------------------------------------------
+* freeArena function:
+* Input: a pointer to an arena
+* Output: void
+* Purpose: Releases every block of the arena at once and leaves it empty.
+-----------------------------------------------------------------------------*/
+
+void freeArena(arenaBlock **arena)
+{
+    while (*arena != NULL)
+    {
+        arenaBlock *next = (*arena)->next;
+        free(*arena);
+        *arena = next;
+    }
+}
+
+/*-----------------------------------------------------------------------------
+* freeDocumentLine function:
+* Input: a pointer to a documentLine object
+* Output: void
+* Purpose: Releases a line of a scannerDocument with its tokens and errors.
+-----------------------------------------------------------------------------*/
+
+void freeDocumentLine(documentLine *current)
+{
+    free(current->text);
+    free(current->tokens);
+    free(current->diagnostics);
+    free(current->symbolDiagnostics);
+    memset(current, 0, sizeof(documentLine));
+}
+
+/*-----------------------------------------------------------------------------
+* freeLineIndex function:
+* Input: a pointer to a lineIndex object
+* Output: void
+* Purpose: Releases the index, so that the next token read builds a new one 
+*   for whatever input the context then holds. The line number the input 
+*   starts at is kept.
+-----------------------------------------------------------------------------*/
+
+void freeLineIndex(lineIndex *lines)
+{
+    free(lines->newline);
+    lines->newline = NULL;
+    lines->count = 0;
+    lines->passed = 0;
+    lines->lastFound = 0;
+}
+
+/*-----------------------------------------------------------------------------
+* freeLiteralPool function:
+* Input: a pointer to a literalPool object
+* Output: void
+* Purpose: Releases the values and hash of a literal pool and empties it.
+-----------------------------------------------------------------------------*/
+
+void freeLiteralPool(literalPool *pool)
+{
+    free(pool->value);
+    free(pool->slot);
+    memset(pool, 0, sizeof(literalPool));
+}
+
+/*-----------------------------------------------------------------------------
+* freeSymbolTable function:
+* Input: a pointer to a symbol table object
+* Output: void
+* Purpose: Releases the slots of a symbol table, its frozen layout and lists 
+*		of uses if it has them, and the arena holding the names of its 
+*		identifiers.
+-----------------------------------------------------------------------------*/
+
+void freeSymbolTable(symbolTable *symTable)
+{
+	freeUses(symTable);
+	free(symTable->token);
+	free(symTable->frozen);
+	freeArena(&symTable->names);
+	symTable->token = NULL;
+	symTable->frozen = NULL;
+	symTable->keys = NULL;
+	symTable->tags = NULL;
+	symTable->slots = NULL;
+	symTable->capacity = 0;
+	symTable->count = 0;
+}
+
+/*-----------------------------------------------------------------------------
+* freeUses function:
+* Input: a pointer to a symbol table object
+* Output: void
+* Purpose: Releases the lists of uses of a symbol table, which stops it 
+*		from keeping a cross-reference index.
+-----------------------------------------------------------------------------*/
+
+void freeUses(symbolTable *symTable)
+{
+	if (symTable->uses == NULL)
+	{
+		return;
+	}
+
+	int i = 0;
+	for (i = 0; i < symTable->capacity; i++)
+	{
+		free(symTable->uses[i].data);
+	}
+	free(symTable->uses);
+	symTable->uses = NULL;
+}
+
+/*-----------------------------------------------------------------------------
+* freezeSymbolTable function:
+* Input: a pointer to a symbol table object
+* Output: a boolean that is false if the frozen layout could not be built, 
+*   in which case the table is still searched through its slots
+* Purpose: Lays the table out for lookups once nothing more will be added to 
+*   it. Each name is stored in uppercase as a key of SYMBOL_KEY_LENGTH bytes, 
+*   so four keys fill a cache line, in groups of SYMBOL_GROUP_SIZE keys. 
+*   Each slot also gets a tag byte, kept in an array of its own: the top 
+*   bit marks the slot as taken and the low seven bits come from the 
+*   name's hash, so a search only compares the keys whose tags match. The 
+*   rest of the hash picks the group a name goes in; a full group passes 
+*   it on to the next, and the number of each key's slot is kept so a 
+*   search can return it. There are enough groups to keep the layout at 
+*   most seven eighths full. Freezing a table that is already frozen does 
+*   nothing.
+-----------------------------------------------------------------------------*/
+
+bool freezeSymbolTable(symbolTable *symTable)
+{
+	if (symTable->frozen != NULL)
+	{
+		return true;
+	}
+
+	unsigned int groupCount = 1;
+	while ((size_t)symTable->count * 8 > 
+	       (size_t)groupCount * SYMBOL_GROUP_SIZE * 7)
+	{
+		groupCount = groupCount * 2;
+	}
+
+	/* The keys start on a cache line, and the tags and slots follow them */
+	size_t slots = (size_t)groupCount * SYMBOL_GROUP_SIZE;
+	char *block = calloc(slots * (SYMBOL_KEY_LENGTH + 1 + sizeof(int)) + 
+	                     CACHE_LINE_SIZE, 1);
+	if (block == NULL)
+	{
+		return false;
+	}
+	uintptr_t start = ((uintptr_t)block + CACHE_LINE_SIZE - 1) & 
+	                  ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+	symbolKey *keys = (symbolKey *)start;
+	unsigned char *tags = (unsigned char *)(keys + slots);
+	int *keySlots = (int *)(tags + slots);
+
+	int i = 0;
+	for (i = 0; i < symTable->capacity; i++)
+	{
+		token *current = &symTable->token[i];
+		if (current->ID == 0)
+		{
+			continue;
+		}
+		if (current->length >= SYMBOL_KEY_LENGTH)
+		{
+			free(block);
+			return false;
+		}
+
+		unsigned int hash = getHash(current);
+		unsigned int group = (hash >> 7) & (groupCount - 1);
+		size_t slot = (size_t)group * SYMBOL_GROUP_SIZE;
+		while (tags[slot] != SYMBOL_TAG_EMPTY)
+		{
+			slot = (slot + 1) & (slots - 1);
+		}
+
+		tags[slot] = (unsigned char)(0x80 | (hash & 0x7F));
+		keySlots[slot] = i;
+		int c = 0;
+		for (c = 0; c < current->length; c++)
+		{
+			keys[slot].name[c] = foldCharacter(current->string[c]);
+		}
+	}
+
+	symTable->frozen = block;
+	symTable->keys = keys;
+	symTable->tags = tags;
+	symTable->slots = keySlots;
+	symTable->groupMask = groupCount - 1;
+	return true;
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* getCacheHeader function:
+* Input: a pointer to a tokenTable object, a pointer to a loaded source 
+*   object, a pointer to the scan options, and a pointer to the cacheHeader 
+*   object to fill in
+* Output: void
+* Purpose: Works out the key of an input's cache entry. The input is hashed 
+*   with hashBytes, and everything else that changes the output is hashed 
+*   into the settings: every string and ID of the token table and the 
+*   options that change what is written. Options such as --split only change 
+*   how the output is produced, so they are left out.
+-----------------------------------------------------------------------------*/
+
+void getCacheHeader(tokenTable *table, source *input, scanOptions *options, 
+                    cacheHeader *header)
+{
+    memset(header, 0, sizeof(cacheHeader));
+    memcpy(header->magic, CACHE_MAGIC, 4);
+    header->version = CACHE_VERSION;
+    header->inputLength = input->length;
+    header->inputHash = hashBytes(input->buffer, input->length, 0);
+
+    uint64_t settings = hashBytes(&header->version, sizeof(header->version), 0);
+    int i = 0;
+    for (i = 0; i < TOKEN_TABLE_LENGTH; i++)
+    {
+        settings = hashBytes(table->token[i].string, table->token[i].length, 
+                             settings);
+        settings = hashBytes(&table->token[i].ID, sizeof(int), settings);
+    }
+
+    char flags[3];
+    flags[0] = options->tokensOnly;
+    flags[1] = options->binaryOutput;
+    flags[2] = options->preserveCase;
+    header->settingsHash = hashBytes(flags, sizeof(flags), settings);
+}
+
+/*-----------------------------------------------------------------------------
+* getCachePath function:
+* Input: a pointer to a character containing the cache folder, and a 
+*   pointer to a cacheHeader object
+* Output: a newly allocated path of the entry, or NULL if it could not be 
+*   allocated
+* Purpose: Names a cache entry after both of its hashes, so that an entry 
+*   can be found without reading the folder.
+-----------------------------------------------------------------------------*/
+
+char *getCachePath(char *cacheDirectory, cacheHeader *header)
+{
+    int size = strlen(cacheDirectory) + 2 * 16 + strlen(CACHE_EXTENSION) + 2;
+    char *path = malloc(size);
+    if (path != NULL)
+    {
+        snprintf(path, size, "%s/%016llx%016llx%s", cacheDirectory, 
+                 (unsigned long long)header->inputHash, 
+                 (unsigned long long)header->settingsHash, CACHE_EXTENSION);
+    }
+    return path;
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* getHash function:
+* Input: a pointer to a token obbject
+* Output: an unsigned integer representing the hashed value of the token
+* Purpose: This function accepts a token as input and returns the 32-bit 
+*		FNV-1a hash of its string. Each character is XORed into the hash, 
+*		which is then multiplied by the FNV prime, so the order of the 
+*		characters matters and anagrams do not collide. Characters are 
+*		hashed in uppercase, so names that differ only in case share a 
+*		hash. The caller masks the hash down to a slot in the symbol table.
+-----------------------------------------------------------------------------*/
+
+unsigned int getHash(token *currentToken)
+{
+	unsigned int hash = FNV_OFFSET_BASIS;
+	int i = 0;
+	
+	for (i = 0; i < currentToken->length; i++)
+	{
+		hash = hash ^ (unsigned char)foldCharacter(currentToken->string[i]);
+		hash = hash * FNV_PRIME;
+	}
+	
+	return hash;
+}
+
+/*-----------------------------------------------------------------------------
+* getKeywordHash function:
+* Input: a pointer to a string, the string's length, and a hash seed
+* Output: an integer slot in the keyword hash
+* Purpose: Packs the length and the first, middle and last characters of the 
+*		string into one key and multiplies it by the seed. The top bits of 
+*		the product give the slot. Only these few characters are read, so 
+*		the cost does not depend on the length of the token. They are read 
+*		in uppercase, so the slot does not depend on case.
+-----------------------------------------------------------------------------*/
+
+int getKeywordHash(char *string, int length, unsigned int seed)
+{
+	unsigned int key = (unsigned int)length 
+	                 | ((unsigned int)(unsigned char)foldCharacter(string[0]) << 8) 
+	                 | ((unsigned int)(unsigned char)foldCharacter(string[length / 2]) << 16) 
+	                 | ((unsigned int)(unsigned char)foldCharacter(string[length - 1]) << 24);
+	
+	key = key ^ (key >> 15);
+	
+	return (int)((key * seed) >> (32 - KEYWORD_HASH_BITS));
+}
+
+/*-----------------------------------------------------------------------------
+* getOutputFilename function:
+* Input: a pointer to the output directory name, a pointer to an input file 
+*   name, and the extension to give the output file
+* Output: a newly allocated output file name
+* Purpose: Names the output file for an input scanned in batch. The input's 
+*   folder and extension are dropped and the new extension is added, so 
+*   "tests/allTokens.txt" is written to "<outputDirectory>/allTokens.out" 
+*   for the extension "out". Standard input is written to "stdin.out".
+-----------------------------------------------------------------------------*/
+
+char *getOutputFilename(char *outputDirectory, char *inputFilename, 
+                        char *extension)
+{
+    char *name = inputFilename;
+    if (strcmp(inputFilename, "-") == 0)
+    {
+        name = "stdin";
+    }
+
+    /* Drop the folder */
+    char *separator = strrchr(name, '/');
+    if (separator != NULL)
+    {
+        name = separator + 1;
+    }
+#ifdef _WIN32
+    separator = strrchr(name, '\\');
+    if (separator != NULL)
+    {
+        name = separator + 1;
+    }
+#endif
+
+    /* Drop the extension */
+    int nameLength = strlen(name);
+    char *dot = strrchr(name, '.');
+    if (dot != NULL && dot != name)
+    {
+        nameLength = dot - name;
+    }
+
+    int size = strlen(outputDirectory) + nameLength + strlen(extension) + 3;
+    char *outputFilename = malloc(size);
+    if (outputFilename != NULL)
+    {
+        snprintf(outputFilename, size, "%s/%.*s.%s", 
+                 outputDirectory, nameLength, name, extension);
+    }
+
+    return outputFilename;
+}
+
+/*-----------------------------------------------------------------------------
+* getSymbolSlot function:
+* Input: a pointer to a token object, a pointer to a symbol table object, 
+*		and a pointer to the number of slots looked at
+* Output: the slot holding the token, or the free slot where it belongs
+* Purpose: Follows the linear probe sequence that starts at the token's hash. 
+*		The first slot that is either free or holds the same string, 
+*		ignoring case, ends the search. The table is never full, so a free 
+*		slot is always reached.
+-----------------------------------------------------------------------------*/
+
+int getSymbolSlot(token *currentToken, symbolTable *symTable, int *probes)
+{
+	unsigned int mask = (unsigned int)symTable->capacity - 1;
+	unsigned int tableSlot = getHash(currentToken) & mask;
+	*probes = 1;
+	
+	while (symTable->token[tableSlot].ID != 0 && 
+	       (symTable->token[tableSlot].length != currentToken->length || 
+	        matchFolded(symTable->token[tableSlot].string, currentToken->string, 
+	                    currentToken->length) == false))
+	{
+		tableSlot = (tableSlot + 1) & mask;
+		*probes = *probes + 1;
+	}
+	
+#ifdef SCANNER_STATS
+	if (symTable->stats != NULL)
+	{
+		int length = *probes < PROBE_HISTOGRAM_LENGTH ? *probes 
+		                                              : PROBE_HISTOGRAM_LENGTH;
+		symTable->stats->probeCount[length - 1]++;
+	}
+#endif
+	return (int)tableSlot;
+}
+
+/*-----------------------------------------------------------------------------
+* getToken function:
+* Input: a pointer to a scannerContext object
+* Output: a token object
+* Purpose: Skips the blanks up to the next token, then calls functions to 
+*   build it from the input at the lexer's position. The input's lines are 
+*   indexed before its first token, and the lines the lexer has reached are 
+*   passed to the line handler once the token is built. Only the token's 
+*   offset is taken; its line and column are left to locateToken. Once a 
+*   token is built, it is assigned a token ID by comparison to the token 
+*   table. A token read when only blanks are left is empty.
+-----------------------------------------------------------------------------*/
+
+token getToken(scannerContext *context) 
+{
+    if (context->lines.newline == NULL)
+    {
+        indexLines(context);
+    }
+#ifdef SCANNER_STATS
+    enterPhase(context->stats, PHASE_LEX);
+#endif
+
+	bool found = skipBlanks(context);
+	size_t offset = context->input.position;
+
+	token currentToken;
+	if (found == false)
+	{
+		currentToken.string = context->input.buffer + offset;
+		currentToken.length = 0;
+		currentToken.index = 0;
+		currentToken.value = 0;
+	}
+	else if (context->tableDriven == true)
+	{
+		currentToken = buildTokenFromTable(context);
+	}
+	else
+	{
+		currentToken = buildToken(context);
+	}
+	currentToken.lineNumber = 0;
+	currentToken.column = 0;
+	currentToken.offset = offset;
+	passLines(context);
+#ifdef SCANNER_STATS
+	enterPhase(context->stats, PHASE_ASSIGN);
+#endif
+	assignID(context->table, &currentToken);
+#ifdef SCANNER_STATS
+	if (context->stats != NULL && currentToken.ID < STATS_TOKEN_IDS)
+	{
+		context->stats->tokenCount[currentToken.ID]++;
+	}
+#endif
+#ifdef SCANNER_PROBES
+	DTRACE_PROBE4(scanner, token, currentToken.ID, currentToken.offset, 
+	              currentToken.string, currentToken.length);
+#endif
+	
+	return currentToken;
+}
+
+/*-----------------------------------------------------------------------------
+* growSymbolTable function:
+* Input: a pointer to a symbol table object
+* Output: a boolean that is false if the larger table could not be allocated
+* Purpose: Doubles the number of slots in the symbol table and re-inserts 
+*		every identifier at its slot in the larger table, moving its list 
+*		of uses along with it.
+-----------------------------------------------------------------------------*/
+
+bool growSymbolTable(symbolTable *symTable)
+{
+	symbolTable grown;
+	grown.capacity = symTable->capacity * 2;
+	grown.count = symTable->count;
+	grown.token = calloc(grown.capacity, sizeof(token));
+	grown.names = NULL;
+	grown.frozen = NULL;
+	grown.keys = NULL;
+	grown.tags = NULL;
+	grown.slots = NULL;
+	grown.groupMask = 0;
+	grown.uses = NULL;
+#ifdef SCANNER_STATS
+	grown.stats = NULL;
+#endif
+	if (grown.token == NULL)
+	{
+		return false;
+	}
+	if (symTable->uses != NULL)
+	{
+		grown.uses = calloc(grown.capacity, sizeof(postingList));
+		if (grown.uses == NULL)
+		{
+			free(grown.token);
+			return false;
+		}
+	}
+	
+	int i = 0;
+	for (i = 0; i < symTable->capacity; i++)
+	{
+		if (symTable->token[i].ID != 0)
+		{
+			int probes = 0;
+			int tableSlot = getSymbolSlot(&symTable->token[i], &grown, &probes);
+			grown.token[tableSlot] = symTable->token[i];
+			if (grown.uses != NULL)
+			{
+				grown.uses[tableSlot] = symTable->uses[i];
+			}
+		}
+	}
+	
+	free(symTable->token);
+	free(symTable->uses);
+	grown.names = symTable->names;
+#ifdef SCANNER_STATS
+	grown.stats = symTable->stats;
+#endif
+	*symTable = grown;
+	return true;
+}
+
+/*-----------------------------------------------------------------------------
+* hashBytes function:
+* Input: a pointer to some bytes, the number of bytes, and a seed (such as 
+*   the hash of bytes hashed before them)
+* Output: a 64-bit hash of the bytes
+* Purpose: Hashes whole inputs for the cache, so it reads eight bytes at a 
+*   time. Each word is scrambled with two multiplications and a rotation 
+*   and folded into the hash, as in MurmurHash3, and the last few bytes 
+*   are packed into one final word. The length is mixed in at the end.
+-----------------------------------------------------------------------------*/
+
+uint64_t hashBytes(const void *bytes, size_t length, uint64_t seed)
+{
+    const unsigned char *next = bytes;
+    uint64_t hash = seed;
+    uint64_t word = 0;
+    size_t i = 0;
+
+    for (i = 0; i + 8 <= length; i += 8)
+    {
+        memcpy(&word, next + i, 8);
+        word = word * HASH_PRIME_1;
+        word = (word << 31) | (word >> 33);
+        word = word * HASH_PRIME_2;
+        hash = hash ^ word;
+        hash = ((hash << 27) | (hash >> 37)) * 5 + 0x52DCE729;
+    }
+
+    word = 0;
+    memcpy(&word, next + i, length - i);
+    word = word * HASH_PRIME_1;
+    word = (word << 31) | (word >> 33);
+    hash = hash ^ (word * HASH_PRIME_2) ^ length;
+
+    /* Spread every bit of the hash over all of the others */
+    hash = (hash ^ (hash >> 33)) * 0xFF51AFD7ED558CCDull;
+    hash = (hash ^ (hash >> 33)) * 0xC4CEB9FE1A85EC53ull;
+    return hash ^ (hash >> 33);
+}
+
+/*-----------------------------------------------------------------------------
+* ignoreComment function:
+* Input: a pointer to a scannerContext object
+* Output: void
+* Purpose: Ignores all characters within a comment, which may pass over 
+*   any number of lines. The body is searched for "*)" with the 
+*   findCommentEnd kernel, without looking at its lines, which are passed 
+*   to the line handler from the line index once the next token is found. 
+*   On return the lexer's position is on the ')' that closes the comment, 
+*   or on the final '\n' of the input if the comment is never closed, in 
+*   which case the source is marked as ending inside a comment.
+-----------------------------------------------------------------------------*/
+
+void ignoreComment(scannerContext *context)
+{
+    source *input = &context->input;
+    size_t last = input->length - 1;
+    size_t index = input->position;
+
+    /* The final '\n' can be read past the end of the search */
+    index = index + findCommentEnd(input->buffer + index, last - index);
+    if (index < last)
+    {
+        index++;
+    }
+    else
+    {
+        input->commentOpen = true;
+    }
+
+    input->position = index;
+}
+
+/*-----------------------------------------------------------------------------
+* indexLines function:
+* Input: a pointer to a scannerContext object
+* Output: void
+* Purpose: Builds the line index of the context's input in one pass, with 
+*   the findNewlines kernel. The input is handed to the kernel 
+*   LINE_INDEX_BLOCK bytes at a time, and the array is grown beforehand, 
+*   with the lines found so far, to have room for a '\n' at every byte of 
+*   the next block; once the input is done, it is cut down to the lines 
+*   found. The program ends with an error if the array cannot be 
+*   allocated, as it does for the symbol table.
+-----------------------------------------------------------------------------*/
+
+void indexLines(scannerContext *context)
+{
+    source *input = &context->input;
+    lineIndex *lines = &context->lines;
+#ifdef SCANNER_STATS
+    int previous = enterPhase(context->stats, PHASE_READ);
+#endif
+
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t done = 0;
+    while (done < input->length)
+    {
+        size_t block = input->length - done;
+        if (block > LINE_INDEX_BLOCK)
+        {
+            block = LINE_INDEX_BLOCK;
+        }
+        if (capacity - count < block)
+        {
+            capacity = count * 2 + block;
+            size_t *grown = realloc(lines->newline, capacity * sizeof(size_t));
+            if (grown == NULL)
+            {
+                printf("Error: Line index could not be allocated.\n");
+                exit(1);
+            }
+            lines->newline = grown;
+        }
+
+        count = count + findNewlines(input->buffer + done, block, done, 
+                                     lines->newline + count);
+        done = done + block;
+    }
+
+    if (count > 0 && count < capacity)
+    {
+        size_t *fitted = realloc(lines->newline, count * sizeof(size_t));
+        if (fitted != NULL)
+        {
+            lines->newline = fitted;
+        }
+    }
+    lines->count = (int)count;
+    lines->passed = 0;
+    lines->lastFound = 0;
+#ifdef SCANNER_PROBES
+    DTRACE_PROBE2(scanner, lines__indexed, lines->count, input->length);
+#endif
+
+#ifdef SCANNER_STATS
+    if (context->stats != NULL)
+    {
+        context->stats->lineCount = context->stats->lineCount + count;
+    }
+    enterPhase(context->stats, previous);
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+* initContext function:
+* Input: a pointer to a scannerContext object, a pointer to a tokenTable 
+*   object, a pointer to a source object (or NULL for a context with no 
+*   input), and a bool selecting the table-driven lexer
+* Output: void
+* Purpose: Sets up a context to scan the given input from its first line, 
+*   with an empty symbol table and no handlers. The source is copied into 
+*   the context, which scans from the source's buffer.
+-----------------------------------------------------------------------------*/
+
+void initContext(scannerContext *context, tokenTable *table, source *input, 
+                 bool tableDriven)
+{
+    memset(context, 0, sizeof(scannerContext));
+    context->table = table;
+    if (input != NULL)
+    {
+        context->input = *input;
+    }
+    context->symTable = constructSymbolTable();
+    context->beginReached = false;
+    context->tableDriven = tableDriven;
+}
+
+/*-----------------------------------------------------------------------------
+* internLiteral function:
+* Input: a pointer to a literalPool object and the value of an integer 
+*   literal
+* Output: the value's number in the pool, or -1 if the pool could not grow
+* Purpose: Finds the value in the pool's hash, adding it at the end of the 
+*   pool the first time it is seen, so each different value is kept once 
+*   however often it is written. The pool doubles when it is full, and its 
+*   hash is rebuilt at twice its new size so it stays at most half full.
+-----------------------------------------------------------------------------*/
+
+int internLiteral(literalPool *pool, int value)
+{
+    if (pool->count == pool->capacity)
+    {
+        int capacity = pool->capacity == 0 ? 64 : pool->capacity * 2;
+        int *values = realloc(pool->value, capacity * sizeof(int));
+        if (values == NULL)
+        {
+            return -1;
+        }
+        pool->value = values;
+
+        int *slots = calloc((size_t)capacity * 2, sizeof(int));
+        if (slots == NULL)
+        {
+            return -1;
+        }
+        free(pool->slot);
+        pool->slot = slots;
+        pool->capacity = capacity;
+
+        int i = 0;
+        for (i = 0; i < pool->count; i++)
+        {
+            unsigned int mask = (unsigned int)capacity * 2 - 1;
+            unsigned int slot = ((unsigned int)pool->value[i] * 2654435761u) & mask;
+            while (pool->slot[slot] != 0)
+            {
+                slot = (slot + 1) & mask;
+            }
+            pool->slot[slot] = i + 1;
+        }
+    }
+
+    unsigned int mask = (unsigned int)pool->capacity * 2 - 1;
+    unsigned int slot = ((unsigned int)value * 2654435761u) & mask;
+    while (pool->slot[slot] != 0)
+    {
+        if (pool->value[pool->slot[slot] - 1] == value)
+        {
+            return pool->slot[slot] - 1;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    pool->value[pool->count] = value;
+    pool->slot[slot] = pool->count + 1;
+    pool->count = pool->count + 1;
+    return pool->count - 1;
+}
+
+/*-----------------------------------------------------------------------------
+* internString function:
+* Input: a pointer to an arena, a pointer to a string and its length
+* Output: a pointer to the arena's NUL-terminated copy of the string, or 
+*   NULL if a block could not be allocated
+* Purpose: Copies a string into the newest block of the arena by bumping the 
+*   block's used count, starting a new block of ARENA_BLOCK_SIZE bytes (or 
+*   larger, for a long string) when it does not fit.
+-----------------------------------------------------------------------------*/
+
+char *internString(arenaBlock **arena, const char *string, int length)
+{
+    arenaBlock *block = *arena;
+    size_t size = (size_t)length + 1;
+
+    if (block == NULL || block->capacity - block->used < size)
+    {
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(arenaBlock) + capacity);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        block->next = *arena;
+        block->used = 0;
+        block->capacity = capacity;
+        *arena = block;
+    }
+
+    char *copy = block->data + block->used;
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+    block->used = block->used + size;
+    return copy;
+}
+
+/*-----------------------------------------------------------------------------
+* keepDiagnostic function:
+* Input: a pointer to a documentLine object, the kind of error, the line and 
+*   column it was found at, and its message
+* Output: void
+* Purpose: Diagnostic handler used while lexing a line of a scannerDocument. 
+*   Keeps the error with the line; the line number is filled in when the 
+*   error is read back, since lines move as the document is edited.
+-----------------------------------------------------------------------------*/
+
+void keepDiagnostic(void *current, int kind, int lineNumber, int column, 
+                    const char *message)
+{
+    documentLine *owner = current;
+    (void)lineNumber;
+
+    addDocumentDiagnostic(&owner->diagnostics, &owner->diagnosticCount, 
+                          kind, column, message);
+}
+
+/*-----------------------------------------------------------------------------
+* keepSymbolDiagnostic function:
+* Input: a pointer to a documentLine object, the kind of error, the line and 
+*   column it was found at, and its message
+* Output: void
+* Purpose: Diagnostic handler used by checkDocumentSymbols. Symbol errors are 
+*   kept apart from the line's lexing errors so they can be replaced without 
+*   lexing the line again.
+-----------------------------------------------------------------------------*/
+
+void keepSymbolDiagnostic(void *current, int kind, int lineNumber, int column, 
+                          const char *message)
+{
+    documentLine *owner = current;
+    (void)lineNumber;
+
+    addDocumentDiagnostic(&owner->symbolDiagnostics, 
+                          &owner->symbolDiagnosticCount, kind, column, message);
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* lexChunk function:
+* Input: a pointer to a tokenTable object, a pointer to the scan options, a 
+*   pointer to a chunk object, and the state the chunk is lexed from (0 if 
+*   it starts outside a comment, 1 if it starts inside one)
+* Output: a boolean that is false if the chunk's text could not be stored
+* Purpose: Lexes one chunk of a split input into memory. The listing is 
+*   written to the chunk's text exactly as scanSource would write it, except 
+*   that identifiers and BEGIN tokens are not checked against the symbol 
+*   table. They are recorded as symbol events, with the place in the text 
+*   where the check's output belongs, and checked when the chunks are 
+*   stitched together. Whether the chunk ends inside a comment is recorded 
+*   so the stitch can tell which starting state the next chunk needs.
+-----------------------------------------------------------------------------*/
+
+bool lexChunk(tokenTable *table, scanOptions *options, chunk *part, int state)
+{
+    outputBuffer *output = &part->text[state];
+    if (openOutput(output, NULL) == false)
+    {
+        return false;
+    }
+    output->upperCase = options->preserveCase == false;
+
+    scannerContext context;
+    initContext(&context, table, &part->input, options->tableDriven);
+    if (options->tokensOnly == false)
+    {
+        context.lineHandler = printLine;
+        context.lineData = output;
+    }
+    context.diagnosticHandler = printDiagnostic;
+    context.diagnosticData = output;
+#ifdef SCANNER_STATS
+    attachStats(&context, options->stats != NULL ? &part->stats[state] : NULL);
+#endif
+
+    context.lines.lineBase = part->firstLine - 1;
+
+    /* Finish the comment left open by an earlier chunk */
+    if (state == 1)
+    {
+        ignoreComment(&context);
+        if (context.input.buffer[context.input.position] != '\n')
+        {
+            context.input.position++;
+        }
+    }
+
+    int capacity = 0;
+    bool success = true;
+    while (!endOfSource(&context) && success == true)
+    {
+        token currentToken = getToken(&context);
+#ifdef SCANNER_STATS
+        enterPhase(context.stats, PHASE_OUTPUT);
+#endif
+        printToken(output, table, &currentToken);
+
+        if (currentToken.ID == table->idID || 
+            (currentToken.length == 5 && matchFolded(currentToken.string, "BEGIN", 5)))
+        {
+            /* The check runs after this chunk's line index is gone */
+            locateToken(&context, &currentToken);
+            if (part->eventCount[state] == capacity)
+            {
+                capacity = capacity * 2 + 64;
+                symbolEvent *grown = realloc(part->events[state], 
+                                             capacity * sizeof(symbolEvent));
+                if (grown == NULL)
+                {
+                    success = false;
+                    break;
+                }
+                part->events[state] = grown;
+            }
+
+            symbolEvent *event = &part->events[state][part->eventCount[state]];
+            event->offset = output->length;
+            event->token = currentToken;
+            part->eventCount[state] = part->eventCount[state] + 1;
+        }
+    }
+
+    part->endsInComment[state] = context.input.commentOpen;
+#ifdef SCANNER_STATS
+    enterPhase(context.stats, PHASE_IDLE);
+#endif
+    freeLineIndex(&context.lines);
+    freeSymbolTable(&context.symTable);
+    return success == true && output->failed == false;
+}
+
+/*-----------------------------------------------------------------------------
+* lexChunks function:
+* Input: a pointer to a splitJob object
+* Output: NULL
+* Purpose: Thread body for split scanning. Repeatedly claims the next chunk 
+*   and starting state to lex until none are left. The first chunk always 
+*   starts outside a comment, so it is only lexed from that state. A chunk 
+*   that fails is marked by releasing its text.
+-----------------------------------------------------------------------------*/
+
+void *lexChunks(void *argument)
+{
+    splitJob *job = argument;
+
+    while (true)
+    {
+        pthread_mutex_lock(&job->lock);
+        int task = job->nextTask;
+        job->nextTask = job->nextTask + 1;
+        pthread_mutex_unlock(&job->lock);
+
+        /* Task 0 is the first chunk; after it each chunk has two */
+        int part = (task + 1) / 2;
+        int state = (task + 1) % 2;
+        if (part >= job->chunkCount)
+        {
+            return NULL;
+        }
+
+        chunk *current = &job->chunks[part];
+        if (lexChunk(job->table, job->options, current, state) == false)
+        {
+            free(current->text[state].data);
+            current->text[state].data = NULL;
+        }
+    }
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* lexDocumentLine function:
+* Input: a pointer to a scannerDocument object, a pointer to one of its 
+*   lines, and a bool that is true if the line starts inside a comment
+* Output: a boolean that is false if the line's tokens could not be stored
+* Purpose: Lexes one line of a document on its own, replacing the tokens and 
+*   lexing errors kept for it. The only lexer state carried between lines is 
+*   whether a comment is open, so a line that starts inside one is handled 
+*   as lexChunk handles a chunk: the comment is finished first. Whether the 
+*   line ends inside a comment is recorded for the line after it. The line 
+*   text belongs to the document, so it is scanned where it is.
+-----------------------------------------------------------------------------*/
+
+bool lexDocumentLine(scannerDocument *document, documentLine *current, 
+                     bool startsInComment)
+{
+    free(current->tokens);
+    free(current->diagnostics);
+    current->tokens = NULL;
+    current->tokenCount = 0;
+    current->diagnostics = NULL;
+    current->diagnosticCount = 0;
+    current->startsInComment = startsInComment;
+
+    source input = {0};
+    input.buffer = current->text;
+    input.length = current->length;
+
+    scannerContext context;
+    initContext(&context, document->table, &input, false);
+    context.diagnosticHandler = keepDiagnostic;
+    context.diagnosticData = current;
+
+    /* Finish the comment left open by an earlier line */
+    if (startsInComment == true)
+    {
+        ignoreComment(&context);
+        if (context.input.buffer[context.input.position] != '\n')
+        {
+            context.input.position++;
+        }
+    }
+
+    int capacity = 0;
+    bool success = true;
+    while (!endOfSource(&context) && success == true)
+    {
+        token currentToken = getToken(&context);
+        if (currentToken.ID == 0)
+        {
+            continue;
+        }
+        locateToken(&context, &currentToken);
+
+        if (current->tokenCount == capacity)
+        {
+            capacity = capacity * 2 + 8;
+            token *grown = realloc(current->tokens, capacity * sizeof(token));
+            if (grown == NULL)
+            {
+                success = false;
+                break;
+            }
+            current->tokens = grown;
+        }
+        current->tokens[current->tokenCount] = currentToken;
+        current->tokenCount = current->tokenCount + 1;
+    }
+
+    current->endsInComment = context.input.commentOpen;
+    freeLineIndex(&context.lines);
+    freeSymbolTable(&context.symTable);
+    return success;
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* lexPipeline function:
+* Input: a pointer to a pipelineJob object
+* Output: NULL
+* Purpose: Thread body for the lexing stage of a pipeline. Takes each block 
+*   from the reader in turn and scans it with the job's context, which keeps 
+*   the line number, symbol table and comment state from one block to the 
+*   next, so the blocks are scanned exactly as one input would be. Each 
+*   block gets a line index of its own, numbered on from the last block. 
+*   The lines, tokens and errors found are added to the block as events, 
+*   and the block is passed on to the writer.
+-----------------------------------------------------------------------------*/
+
+void *lexPipeline(void *argument)
+{
+    pipelineJob *job = argument;
+    scannerContext *context = &job->context;
+    bool last = false;
+
+    while (last == false)
+    {
+        pipelineBlock *block = popRing(&job->readBlocks);
+        last = block->last;
+        block->eventCount = 0;
+        block->messageLength = 0;
+        block->failed = false;
+
+        /* The block's lines are numbered on from the previous block's */
+        context->lines.lineBase = context->lines.lineBase + context->lines.count;
+        freeLineIndex(&context->lines);
+        context->input.buffer = block->data;
+        context->input.length = block->length;
+        context->input.position = 0;
+        context->lineData = block;
+        context->diagnosticData = block;
+
+        /* Finish a comment left open at the end of the previous block */
+        if (context->input.commentOpen == true && block->length > 0)
+        {
+            context->input.commentOpen = false;
+            ignoreComment(context);
+            if (context->input.buffer[context->input.position] != '\n')
+            {
+                context->input.position++;
+            }
+        }
+
+        while (block->length > 0 && !endOfSource(context))
+        {
+            token currentToken = getToken(context);
+#ifdef SCANNER_STATS
+            enterPhase(context->stats, PHASE_OUTPUT);
+#endif
+            if (currentToken.ID != 0 && 
+                addPipelineEvent(block, EVENT_TOKEN, 0, currentToken.ID, 
+                                 currentToken.string, 
+                                 currentToken.length) == false)
+            {
+                block->failed = true;
+            }
+#ifdef SCANNER_STATS
+            enterPhase(context->stats, PHASE_SYMBOL);
+#endif
+            checkSymbol(context, &currentToken);
+        }
+
+        pushRing(&job->lexedBlocks, block);
+    }
+
+    freeLineIndex(&context->lines);
+#ifdef SCANNER_STATS
+    enterPhase(context->stats, PHASE_IDLE);
+#endif
+    return NULL;
+}
+#endif
+
+#ifndef SCANNER_TABLE_GENERATOR
+/*-----------------------------------------------------------------------------
+* loadBuiltinTokenTable function:
+* Input: a pointer to a tokenTable object
+* Output: void
+* Purpose: Fills in the table from the one compiled into the program from 
+*   tokenTable.h, with the keyword hash and the lexer tables already built, 
+*   so nothing is read or hashed. The strings are the header's own, so the 
+*   table has no arena to release.
+-----------------------------------------------------------------------------*/
+
+void loadBuiltinTokenTable(tokenTable *table)
+{
+    int i = 0;
+    for (i = 0; i < TOKEN_TABLE_LENGTH; i++)
+    {
+        memset(&table->token[i], 0, sizeof(token));
+        table->token[i].string = (char *)builtinTokenString[i];
+        table->token[i].length = builtinTokenLength[i];
+        table->token[i].ID = builtinTokenID[i];
+    }
+
+    table->names = NULL;
+    memcpy(table->slot, builtinKeywordSlot, sizeof(table->slot));
+    table->seed = builtinKeywordSeed;
+    table->idID = builtinIdID;
+    table->intID = builtinIntID;
+    memcpy(table->charClass, builtinCharClass, sizeof(table->charClass));
+    memcpy(table->action, builtinAction, sizeof(table->action));
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* locateOffset function:
+* Input: a pointer to a scannerContext object whose input has been indexed, 
+*   an offset in the input, and pointers to the line number and column to 
+*   fill in
+* Output: void
+* Purpose: Finds the line and column of an offset in the line index. 
+*   Columns count from 1 at the first character of the line as it is in 
+*   the input, leading whitespace included.
+-----------------------------------------------------------------------------*/
+
+void locateOffset(scannerContext *context, size_t offset, int *lineNumber, 
+                  int *column)
+{
+    lineIndex *lines = &context->lines;
+    int found = findLine(lines, offset);
+    size_t start = found == 0 ? 0 : lines->newline[found - 1] + 1;
+
+    *lineNumber = lines->lineBase + found + 1;
+    *column = (int)(offset - start) + 1;
+}
+
+/*-----------------------------------------------------------------------------
+* locateToken function:
+* Input: a pointer to a scannerContext object and a pointer to a token 
+*   object read from its input
+* Output: void
+* Purpose: Fills in the token's line and column from its offset, unless 
+*   they are already known. Only the scans that report or keep where a 
+*   token is look it up, so a listing without errors never does.
+-----------------------------------------------------------------------------*/
+
+void locateToken(scannerContext *context, token *currentToken)
+{
+    if (currentToken->lineNumber == 0)
+    {
+        locateOffset(context, currentToken->offset, &currentToken->lineNumber, 
+                     &currentToken->column);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+* mapFile function:
+* Input: a pointer to a character containing the file name, the fewest 
+*   bytes the file may hold, and a pointer to the length of the file
+* Output: a pointer to the contents of the file, or NULL if it could not be 
+*   read or is too short
+* Purpose: Maps a file read only, or reads it into memory where mmap is not 
+*   available, for the readers of token streams and indexes. The contents 
+*   are released with munmap, or with free without mmap.
+-----------------------------------------------------------------------------*/
+
+void *mapFile(const char *filename, size_t minimumLength, size_t *length)
+{
+#ifdef SCANNER_POSIX
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    struct stat fileInfo;
+    if (fstat(fd, &fileInfo) != 0 || 
+        (size_t)fileInfo.st_size < minimumLength || fileInfo.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    size_t fileLength = (size_t)fileInfo.st_size;
+    void *mapping = mmap(NULL, fileLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return NULL;
+    }
+#else
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    size_t fileLength = size > 0 ? (size_t)size : 0;
+    void *mapping = fileLength >= minimumLength && fileLength > 0 
+                  ? malloc(fileLength) : NULL;
+    if (mapping == NULL || 
+        fread(mapping, 1, fileLength, file) != fileLength)
+    {
+        free(mapping);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+#endif
+
+    *length = fileLength;
+    return mapping;
+}
+
+/*-----------------------------------------------------------------------------
+* matchFolded function:
+* Input: pointers to two strings and the number of characters to compare
+* Output: a boolean that is true if the strings match when case is ignored
+* Purpose: Compares keywords and names the way the language does, treating 
+*   "begin", "Begin" and "BEGIN" as the same word. Neither string is 
+*   changed, so tokens can be compared where they sit in the input.
+-----------------------------------------------------------------------------*/
+
+bool matchFolded(const char *left, const char *right, int length)
+{
+    int i = 0;
+    for (i = 0; i < length; i++)
+    {
+        if (left[i] != right[i] && 
+            foldCharacter(left[i]) != foldCharacter(right[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef SCANNER_STATS
+/*-----------------------------------------------------------------------------
+* mergeStats function:
+* Input: a pointer to the total statistics (or NULL) and a pointer to the 
+*   statistics of part of a scan (or NULL)
+* Output: void
+* Purpose: Adds every counter and timer of the part to the total. Scans on 
+*   different threads share the total, so it is locked while it is changed.
+-----------------------------------------------------------------------------*/
+
+void mergeStats(scanStats *total, scanStats *part)
+{
+	if (total == NULL || part == NULL)
+	{
+		return;
+	}
+
+#ifdef SCANNER_POSIX
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	pthread_mutex_lock(&lock);
+#endif
+	int i = 0;
+	for (i = 0; i < PHASE_COUNT; i++)
+	{
+		total->phaseTicks[i] = total->phaseTicks[i] + part->phaseTicks[i];
+	}
+	for (i = 0; i < STATS_TOKEN_IDS; i++)
+	{
+		total->tokenCount[i] = total->tokenCount[i] + part->tokenCount[i];
+	}
+	for (i = 0; i < STATS_ERROR_KINDS; i++)
+	{
+		total->errorCount[i] = total->errorCount[i] + part->errorCount[i];
+	}
+	for (i = 0; i < PROBE_HISTOGRAM_LENGTH; i++)
+	{
+		total->probeCount[i] = total->probeCount[i] + part->probeCount[i];
+	}
+	total->fileCount = total->fileCount + part->fileCount;
+	total->lineCount = total->lineCount + part->lineCount;
+	total->bytesIn = total->bytesIn + part->bytesIn;
+	total->bytesOut = total->bytesOut + part->bytesOut;
+	total->symbolCount = total->symbolCount + part->symbolCount;
+	total->symbolCapacity = total->symbolCapacity + part->symbolCapacity;
+	total->cacheHits = total->cacheHits + part->cacheHits;
+	total->cacheMisses = total->cacheMisses + part->cacheMisses;
+#ifdef SCANNER_POSIX
+	pthread_mutex_unlock(&lock);
+#endif
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* openOutput function:
+* Input: a pointer to an outputBuffer object, a pointer to an output file (or 
+*   NULL to keep the output in memory)
+* Output: a boolean that is false if the buffer could not be allocated
+* Purpose: Sets up an empty buffer of OUTPUT_BUFFER_SIZE bytes for output to 
+*   the given file, or a smaller one that grows for output kept in memory. 
+*   Program text is written in uppercase until upperCase is cleared.
+-----------------------------------------------------------------------------*/
+
+bool openOutput(outputBuffer *output, FILE *outputFile)
+{
+    output->capacity = outputFile != NULL ? OUTPUT_BUFFER_SIZE : READ_BLOCK_SIZE;
+    output->length = 0;
+    output->file = outputFile;
+    output->upperCase = true;
+#ifdef SCANNER_STATS
+    output->written = 0;
+#endif
+    output->data = malloc(output->capacity);
+    output->failed = output->data == NULL;
+    return output->failed == false;
+}
+
+/*-----------------------------------------------------------------------------
+* openSource function:
+* Input: a pointer to a character containing the file name, a pointer to a 
+*   source object
+* Output: a boolean that is false if the file could not be read
+* Purpose: Loads the whole input file into a single buffer. Regular files are 
+*   memory-mapped read-only when they already end in '\n', since scanning 
+*   never writes to the input. Everything else, including pipes, standard 
+*   input (named "-") and files missing a final newline, is read into an 
+*   allocated buffer and given a '\n' at the end. The file__open probe 
+*   fires before the file is loaded, so a trace of a file's time includes 
+*   loading it.
+-----------------------------------------------------------------------------*/
+
+bool openSource(char *inputFilename, source *input)
+{
+    input->buffer = NULL;
+    input->length = 0;
+    input->position = 0;
+    input->mapped = false;
+    input->commentOpen = false;
+    input->newlineAdded = false;
+#ifdef SCANNER_PROBES
+    DTRACE_PROBE1(scanner, file__open, inputFilename);
+#endif
+
+    if (strcmp(inputFilename, "-") == 0)
+    {
+        return readSource(stdin, input);
+    }
+
+#ifdef SCANNER_POSIX
+    int fd = open(inputFilename, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat fileInfo;
+    if (fstat(fd, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) && 
+        fileInfo.st_size > 0)
+    {
+        char *mapping = mmap(NULL, (size_t)fileInfo.st_size, 
+                             PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            if (mapping[fileInfo.st_size - 1] == '\n')
+            {
+                madvise(mapping, (size_t)fileInfo.st_size, MADV_SEQUENTIAL);
+                close(fd);
+                input->buffer = mapping;
+                input->length = (size_t)fileInfo.st_size;
+                input->mapped = true;
+                return true;
+            }
+            munmap(mapping, (size_t)fileInfo.st_size);
+        }
+    }
+
+    /* Not mappable, fall back to reading it */
+    FILE *inputFile = fdopen(fd, "rb");
+    if (inputFile == NULL)
+    {
+        close(fd);
+        return false;
+    }
+#else
+    FILE *inputFile = fopen(inputFilename, "rb");
+    if (inputFile == NULL)
+    {
+        return false;
+    }
+#endif
+
+    bool success = readSource(inputFile, input);
+    fclose(inputFile);
+    return success;
+}
+
+/*-----------------------------------------------------------------------------
+* parseInteger function:
+* Input: a pointer to the digits of an integer literal and how many there 
+*   are (at most TOKEN_LENGTH)
+* Output: the value of the digits, which may be more than SCANNER_MAX_INTEGER
+* Purpose: Converts a literal eight digits at a time. The eight characters 
+*   are loaded as one 64-bit word and combined in place (SWAR): each pair 
+*   of digits with one multiply and shift, then the pairs into fours and 
+*   the fours into the eight-digit value with one more multiply. Fewer than 
+*   eight digits, and machines whose words are not little endian, take the 
+*   digits one at a time. Only digits the lexer has already measured are 
+*   read, so nothing past the literal is touched.
+-----------------------------------------------------------------------------*/
+
+uint64_t parseInteger(const char *digits, int count)
+{
+    uint64_t value = 0;
+    int i = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (i = 0; i + 8 <= count; i = i + 8)
+    {
+        uint64_t word = 0;
+        memcpy(&word, digits + i, 8);
+        word = word - 0x3030303030303030ull;
+        word = word * 10 + (word >> 8);
+        word = ((word & 0x000000FF000000FFull) * (100 + (1000000ull << 32)) + 
+                ((word >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32))) 
+               >> 32;
+        value = value * 100000000ull + (word & 0xFFFFFFFFull);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        value = value * 10 + (uint64_t)(digits[i] - '0');
+    }
+    return value;
+}
+
+/*-----------------------------------------------------------------------------
+* passDiagnostic function:
+* Input: a pointer to a scannerContext object with a diagnostic handler, the 
+*   kind of error, the line and column it was found at, and a printf format 
+*   with its list of arguments
+* Output: void
+* Purpose: Formats an error message and passes it to the context's 
+*   diagnostic handler, after passing on the lines the lexer has reached, 
+*   so an error always follows the line it was found on.
+-----------------------------------------------------------------------------*/
+
+void passDiagnostic(scannerContext *context, int kind, int lineNumber, 
+                    int column, const char *format, va_list arguments)
+{
+    char message[MESSAGE_LENGTH];
+    vsnprintf(message, MESSAGE_LENGTH, format, arguments);
+
+    passLines(context);
+    context->diagnosticHandler(context->diagnosticData, kind, lineNumber, 
+                               column, message);
+}
+
+/*-----------------------------------------------------------------------------
+* passLines function:
+* Input: a pointer to a scannerContext object
+* Output: void
+* Purpose: Passes each line the lexer has reached since the last call, that 
+*   is each line starting at or before its position, to the context's line 
+*   handler if one is set. The lines come from the line index, so lexing 
+*   does nothing for them. Leading whitespace is left out of the line 
+*   passed, and the '\n' that ends it is kept.
+-----------------------------------------------------------------------------*/
+
+void passLines(scannerContext *context)
+{
+    lineIndex *lines = &context->lines;
+    if (context->lineHandler == NULL || lines->passed >= lines->count || 
+        (lines->passed > 0 && 
+         lines->newline[lines->passed - 1] >= context->input.position))
+    {
+        return;
+    }
+#ifdef SCANNER_STATS
+    int previous = enterPhase(context->stats, PHASE_OUTPUT);
+#endif
+
+    do
+    {
+        size_t start = lines->passed == 0 
+                       ? 0 : lines->newline[lines->passed - 1] + 1;
+        char *string = context->input.buffer + start;
+        int length = (int)(lines->newline[lines->passed] - start) + 1;
+        while (string[0] == ' ' || string[0] == '\t')
+        {
+            string++;
+            length--;
+        }
+
+#ifdef SCANNER_PROBES
+        DTRACE_PROBE3(scanner, line, lines->lineBase + lines->passed + 1, 
+                      string, length);
+#endif
+        context->lineHandler(context->lineData, 
+                             lines->lineBase + lines->passed + 1, 
+                             string, length);
+        lines->passed = lines->passed + 1;
+    } while (lines->passed < lines->count && 
+             lines->newline[lines->passed - 1] < context->input.position);
+
+#ifdef SCANNER_STATS
+    enterPhase(context->stats, previous);
+#endif
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* popRing function:
+* Input: a pointer to a ringBuffer object
+* Output: the oldest item in the ring
+* Purpose: Takes an item off a ring buffer, waiting for the producer when it 
+*   is empty. Only the consumer calls this function, and only it moves the 
+*   head, so the head is released after the slot has been read and the 
+*   producer never sees the slot as free too early.
+-----------------------------------------------------------------------------*/
+
+void *popRing(ringBuffer *ring)
+{
+    unsigned int head = ring->head;
+    int attempts = 0;
+    while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head)
+    {
+        waitForRing(&attempts);
+    }
+
+    void *item = ring->slot[head % PIPELINE_DEPTH];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return item;
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* printDiagnostic function:
+* Input: a pointer to an outputBuffer object, the kind of error, the line and 
+*   column it was found at, and its message
+* Output: void
+* Purpose: Diagnostic handler used for the listing. Writes the message on its 
+*   own line, indented under the tokens of the line it belongs to.
+-----------------------------------------------------------------------------*/
+
+void printDiagnostic(void *output, int kind, int lineNumber, int column, 
+                     const char *message)
+{
+    /* The listing places errors under their line, so only the text is used */
+    (void)kind;
+    (void)lineNumber;
+    (void)column;
+
+    appendBytes(output, "\t\t", 2);
+    appendFolded(output, message, strlen(message));
+    appendBytes(output, "\n", 1);
+}
+
+/*-----------------------------------------------------------------------------
+* printLine function:
+* Input: a pointer to an outputBuffer object, a line number, and a pointer to 
+*   the line's string and its length.
+* Output: void
+* Purpose: Line handler used for the listing. Writes the line's lineNumber and 
+*   string to the output, including whitespace between lines. The string is 
+*   written as it appears in the input, or in uppercase.
+-----------------------------------------------------------------------------*/
+
+void printLine(void *output, int lineNumber, const char *string, int length)
+{
+    if (lineNumber > 1)
+    {
+        /* Add space between lines */
+        appendBytes(output, "\n", 1);
+    }
+    appendInteger(output, lineNumber);
+    appendBytes(output, "\t", 1);
+    appendFolded(output, string, length);
+}
+
+/*-----------------------------------------------------------------------------
+* printSymbolTable function:
+* Input: a pointer to a symbol table object and a pointer to an outputBuffer 
+*		object
+* Output: void
+* Purpose: This function prints to a given file an entire symbol table, one 
+*		item per line. Each line starts with the index of the identifier in 
+*		the table and ends with the string of the identifier.
+-----------------------------------------------------------------------------*/
+
+void printSymbolTable(symbolTable *symTable, outputBuffer *output)
+{	
+	char heading[] = "\n\nSYMBOL TABLE:\n";
+	appendBytes(output, heading, sizeof(heading) - 1);
+	
+	int i = 0;
+	for (i = 0; i < symTable->capacity; i++)
+	{
+		appendInteger(output, i + 1);
+		appendBytes(output, "\t", 1);
+		if (symTable->token[i].ID != 0)
+		{
+			appendFolded(output, symTable->token[i].string, 
+				symTable->token[i].length);
+		}
+		appendBytes(output, "\n", 1);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+* printToken function:
+* Input: a pointer to an outputBuffer object, a pointer to the tokenTable 
+*   the token was read with, a pointer to a token object.
+* Output: void
+* Purpose: Writes the token's ID and string to the output. This function 
+*   only writes tokens with valid IDs, and inserts '^' before the string for 
+*   variable tokens and '#' for integers, as the table numbers them.
+-----------------------------------------------------------------------------*/
+
+void printToken(outputBuffer *output, tokenTable *table, token *currentToken)
+{
+    if (currentToken->ID == 0)
+    {
+        /*
+        * Intentionally blank to prevent printing 
+        * tokens without valid IDs, such as forbidden characters.
+        */
+        return;
+    }
+
+    appendBytes(output, "\t\t", 2);
+    appendInteger(output, currentToken->ID);
+    appendBytes(output, "\t\t", 2);
+
+    if (currentToken->ID == table->idID)
+    {
+        /* Adds a '^' to id tokens */
+        appendBytes(output, "^", 1);
+    }
+    else if (currentToken->ID == table->intID)
+    {
+        /* Adds a '#' to integer tokens */
+        appendBytes(output, "#", 1);
+    }
+
+    appendFolded(output, currentToken->string, currentToken->length);
+    appendBytes(output, "\n", 1);
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* pushRing function:
+* Input: a pointer to a ringBuffer object and the item to add
+* Output: void
+* Purpose: Adds an item to a ring buffer, waiting for the consumer when it 
+*   is full. Only the producer calls this function, and only it moves the 
+*   tail, which is released after the slot is filled in.
+-----------------------------------------------------------------------------*/
+
+void pushRing(ringBuffer *ring, void *item)
+{
+    unsigned int tail = ring->tail;
+    int attempts = 0;
+    while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == PIPELINE_DEPTH)
+    {
+        waitForRing(&attempts);
+    }
+
+    ring->slot[tail % PIPELINE_DEPTH] = item;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+#endif
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* readCacheEntry function:
+* Input: a pointer to a character containing the cache folder, a pointer to 
+*   the cacheHeader object of the input, a pointer to the source object it 
+*   was made from, a pointer to the output file, and a pointer to the scan 
+*   options
+* Output: a boolean that is true if the stored output was written
+* Purpose: Looks up the input's entry in the cache and, if its header 
+*   matches, copies the stored output to the output file and marks the 
+*   entry as just used by updating its modification time, which trimCache 
+*   goes by. If the entry turns out to be short, whatever was copied is 
+*   removed again, so the caller can scan the input as if there were no 
+*   entry.
+-----------------------------------------------------------------------------*/
+
+bool readCacheEntry(char *cacheDirectory, cacheHeader *header, source *input, 
+                    FILE *outputFile, scanOptions *options)
+{
+    char *path = getCachePath(cacheDirectory, header);
+    FILE *entry = path != NULL ? fopen(path, "rb") : NULL;
+    free(path);
+    if (entry == NULL)
+    {
+        return false;
+    }
+
+    cacheHeader stored;
+    bool found = fread(&stored, sizeof(stored), 1, entry) == 1;
+    if (found == true)
+    {
+        header->outputLength = stored.outputLength;
+        found = memcmp(&stored, header, sizeof(stored)) == 0;
+    }
+
+    outputBuffer output;
+    char *block = malloc(READ_BLOCK_SIZE);
+    if (found == false || block == NULL || openOutput(&output, outputFile) == false)
+    {
+        free(block);
+        fclose(entry);
+        return false;
+    }
+
+    uint64_t copied = 0;
+    size_t count = 0;
+    while ((count = fread(block, 1, READ_BLOCK_SIZE, entry)) > 0)
+    {
+        appendBytes(&output, block, count);
+        copied = copied + count;
+    }
+    bool written = ferror(entry) == 0 && copied == stored.outputLength;
+#ifdef SCANNER_STATS
+    if (written == true && options->stats != NULL)
+    {
+        scanStats fileStats;
+        memset(&fileStats, 0, sizeof(fileStats));
+        fileStats.fileCount = 1;
+        fileStats.bytesIn = input->length - (input->newlineAdded ? 1 : 0);
+        fileStats.bytesOut = copied;
+        fileStats.cacheHits = 1;
+        mergeStats(options->stats, &fileStats);
+    }
+#else
+    (void)input;
+    (void)options;
+#endif
+
+    written = closeOutput(&output) == true && written == true;
+    if (written == true)
+    {
+        futimens(fileno(entry), NULL);
+    }
+    else if (copied > 0 && ftruncate(fileno(outputFile), 0) == 0)
+    {
+        lseek(fileno(outputFile), 0, SEEK_SET);
+    }
+
+    free(block);
+    fclose(entry);
+    return written;
+}
+#endif
+
+#ifdef SCANNER_STATS
+/*-----------------------------------------------------------------------------
+* readClock function:
+* Input: None
+* Output: the current time in seconds
+* Purpose: Reads a monotonic clock where the platform has one, and the 
+*   processor clock otherwise. It is used to find the rate of readTimer.
+-----------------------------------------------------------------------------*/
+
+double readClock()
+{
+#ifdef SCANNER_POSIX
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* readFileList function:
+* Input: a pointer to the name of a file list, a pointer to an array of input 
+*   file names, and a pointer to the number of names in the array
+* Output: a boolean that is false if the list could not be read
+* Purpose: Appends each non-empty line of the file list to the array of input 
+*   file names, growing the array as needed.
+-----------------------------------------------------------------------------*/
+
+bool readFileList(char *fileListFilename, char ***inputFilenames, int *fileCount)
+{
+    FILE *listFile;
+    if ((listFile = fopen(fileListFilename, "r")) == NULL)
+    {
+        return false;
+    }
+
+    int capacity = *fileCount;
+    char path[MAX_PATH_LENGTH];
+    while (fgets(path, MAX_PATH_LENGTH, listFile) != NULL)
+    {
+        /* Remove the line ending */
+        int length = strcspn(path, "\r\n");
+        path[length] = '\0';
+        if (length == 0)
+        {
+            continue;
+        }
+
+        if (*fileCount == capacity)
+        {
+            capacity = capacity * 2 + 16;
+            char **grown = realloc(*inputFilenames, capacity * sizeof(char *));
+            if (grown == NULL)
+            {
+                fclose(listFile);
+                return false;
+            }
+            *inputFilenames = grown;
+        }
+
+        char *copy = malloc(length + 1);
+        if (copy == NULL)
+        {
+            fclose(listFile);
+            return false;
+        }
+        memcpy(copy, path, length + 1);
+        (*inputFilenames)[*fileCount] = copy;
+        *fileCount = *fileCount + 1;
+    }
+
+    fclose(listFile);
+    return true;
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* readPipeline function:
+* Input: a pointer to a pipelineJob object
+* Output: NULL
+* Purpose: Thread body for the reading stage of a pipeline. Fills free blocks 
+*   from the input file and passes each one on to the lexer once it holds 
+*   whole lines, carrying a partial last line over to the start of the next 
+*   block. A block is grown until a line fits in it. As with readSource, a 
+*   '\n' is added after a last line that lacks one. The last block is marked, 
+*   and is passed on even if reading fails, so the other stages always stop.
+-----------------------------------------------------------------------------*/
+
+void *readPipeline(void *argument)
+{
+    pipelineJob *job = argument;
+    pipelineBlock *current = popRing(&job->freeBlocks);
+    current->length = 0;
+
+    while (true)
+    {
+        /* Keep one byte free for the final '\n' */
+        if (current->capacity - current->length < 2)
+        {
+            size_t capacity = current->capacity * 2;
+            char *grown = realloc(current->data, capacity);
+            if (grown == NULL)
+            {
+                __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+                current->last = true;
+                pushRing(&job->readBlocks, current);
+                return NULL;
+            }
+            current->data = grown;
+            current->capacity = capacity;
+        }
+
+        size_t previous = current->length;
+        size_t count = fread(current->data + current->length, 1, 
+                             current->capacity - current->length - 1, 
+                             job->inputFile);
+        current->length = current->length + count;
+        job->bytesRead = job->bytesRead + count;
+
+        if (count == 0)
+        {
+            if (ferror(job->inputFile))
+            {
+                __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            }
+            if (job->bytesRead == 0 || 
+                (current->length > 0 && current->data[current->length - 1] != '\n'))
+            {
+                current->data[current->length] = '\n';
+                current->length = current->length + 1;
+            }
+            current->last = true;
+            pushRing(&job->readBlocks, current);
+            return NULL;
+        }
+
+        /* Only the new bytes can hold the first '\n' of the block's tail */
+        size_t end = current->length;
+        while (end > previous && current->data[end - 1] != '\n')
+        {
+            end--;
+        }
+        if (end == previous)
+        {
+            continue;
+        }
+
+        pipelineBlock *next = popRing(&job->freeBlocks);
+        size_t carried = current->length - end;
+        if (next->capacity < carried + 2)
+        {
+            char *grown = realloc(next->data, carried + 2);
+            if (grown == NULL)
+            {
+                __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+                carried = 0;
+            }
+            else
+            {
+                next->data = grown;
+                next->capacity = carried + 2;
+            }
+        }
+        memcpy(next->data, current->data + end, carried);
+        next->length = carried;
+
+        current->length = end;
+        current->last = false;
+        pushRing(&job->readBlocks, current);
+        current = next;
+    }
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* readSource function:
+* Input: a pointer to an open input file, a pointer to a source object
+* Output: a boolean that is false if the file could not be read
+* Purpose: Reads an input file to its end into a growing buffer, for inputs 
+*   that cannot be memory-mapped. A '\n' is appended if the last line does not 
+*   have one, so every line in the buffer is terminated.
+-----------------------------------------------------------------------------*/
+
+bool readSource(FILE *inputFile, source *input)
+{
+    size_t capacity = READ_BLOCK_SIZE;
+    input->buffer = malloc(capacity);
+    input->length = 0;
+
+    while (input->buffer != NULL)
+    {
+        /* Keep one byte free for the final '\n' */
+        if (capacity - input->length < READ_BLOCK_SIZE + 1)
+        {
+            capacity = capacity * 2;
+            char *grown = realloc(input->buffer, capacity);
+            if (grown == NULL)
+            {
+                break;
+            }
+            input->buffer = grown;
+        }
+
+        size_t count = fread(input->buffer + input->length, 1, 
+                             READ_BLOCK_SIZE, inputFile);
+        input->length = input->length + count;
+
+        if (count < READ_BLOCK_SIZE)
+        {
+            if (ferror(inputFile))
+            {
+                break;
+            }
+            input->newlineAdded = input->length == 0 || 
+                                  input->buffer[input->length - 1] != '\n';
+            if (input->newlineAdded == true)
+            {
+                input->buffer[input->length] = '\n';
+                input->length = input->length + 1;
+            }
+            return true;
+        }
+    }
+
+    free(input->buffer);
+    input->buffer = NULL;
+    return false;
+}
+
+#ifdef SCANNER_STATS
+/*-----------------------------------------------------------------------------
+* readTimer function:
+* Input: None
+* Output: the current reading of the phase timer, in ticks
+* Purpose: Reads the processor's time stamp counter where there is one, 
+*   since phases change several times per token and the counter is much 
+*   cheaper to read than the clock. Elsewhere the ticks are nanoseconds of 
+*   the monotonic clock, or processor clock ticks.
+-----------------------------------------------------------------------------*/
+
+uint64_t readTimer()
+{
+#if defined(SCANNER_SIMD)
+	return __builtin_ia32_rdtsc();
+#elif defined(SCANNER_POSIX)
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#else
+	return (uint64_t)clock();
+#endif
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* readTokenTable function:
+* Input: a pointer to a character containing the file name, a pointer to a 
+*   tokenTable object, and a buffer of MESSAGE_LENGTH characters for an error
+* Output: a boolean that is false if the file could not be opened or is not 
+*   a valid token table, in which case the buffer says why
+* Purpose: Reads the token strings and IDs into the table. The text file must 
+*   be of the format "TokenString TokenID" with one token per line; blank 
+*   lines are skipped. It must list exactly TOKEN_TABLE_LENGTH tokens, 
+*   including the "id" and "int" rows, with strings of at most TOKEN_LENGTH 
+*   characters that differ in more than case, and IDs from 1 to 65535 (the 
+*   largest a binary token stream can hold) that are all different. The 
+*   strings are interned in the table's arena.
+-----------------------------------------------------------------------------*/
+
+bool readTokenTable(char *tokenTableFilename, tokenTable *table, char *error)
+{
+    /* Open file containing token table and check for errors */
+    FILE *tokenFile;    
+    if ((tokenFile = fopen(tokenTableFilename, "r")) == NULL)
+    {
+        snprintf(error, MESSAGE_LENGTH, "%s could not be opened.", 
+                 tokenTableFilename);
+        return false;
+    }
+    
+    /* Construct token table */ 
+    table->names = NULL;
+    bool success = true;
+    int count = 0;
+    int lineNumber = 0;
+    char text[256];
+    while (success == true && fgets(text, sizeof(text), tokenFile) != NULL)
+    {
+        char string[64];
+        char extra[2];
+        int ID = 0;
+        lineNumber++;
+        int fields = sscanf(text, "%63s %d %1s", string, &ID, extra);
+        if (fields <= 0)
+        {
+            continue;
+        }
+
+        int length = (int)strlen(string);
+        success = false;
+        if (fields != 2)
+        {
+            snprintf(error, MESSAGE_LENGTH, "Line %d of %s is not of the form "
+                     "\"TokenString TokenID\".", lineNumber, tokenTableFilename);
+        }
+        else if (length > TOKEN_LENGTH)
+        {
+            snprintf(error, MESSAGE_LENGTH, "Token %.*s on line %d of %s is "
+                     "longer than %d characters.", TOKEN_LENGTH, string, 
+                     lineNumber, tokenTableFilename, TOKEN_LENGTH);
+        }
+        else if (ID < 1 || ID > UINT16_MAX)
+        {
+            snprintf(error, MESSAGE_LENGTH, "Token ID %d on line %d of %s is "
+                     "not from 1 to %d.", ID, lineNumber, tokenTableFilename, 
+                     UINT16_MAX);
+        }
+        else if (count == TOKEN_TABLE_LENGTH)
+        {
+            snprintf(error, MESSAGE_LENGTH, "%s lists more than %d tokens.", 
+                     tokenTableFilename, TOKEN_TABLE_LENGTH);
+        }
+        else
+        {
+            success = true;
+        }
+
+        int i = 0;
+        for (i = 0; i < count && success == true; i++)
+        {
+            if (table->token[i].length == length && 
+                matchFolded(table->token[i].string, string, length) == true)
+            {
+                snprintf(error, MESSAGE_LENGTH, "Token %s on line %d of %s is "
+                         "listed twice.", string, lineNumber, tokenTableFilename);
+                success = false;
+            }
+            else if (table->token[i].ID == ID)
+            {
+                snprintf(error, MESSAGE_LENGTH, "Token ID %d on line %d of %s "
+                         "is used twice.", ID, lineNumber, tokenTableFilename);
+                success = false;
+            }
+        }
+        if (success == false)
+        {
+            break;
+        }
+
+        memset(&table->token[count], 0, sizeof(token));
+        table->token[count].ID = ID;
+        table->token[count].length = length;
+        table->token[count].string = internString(&table->names, string, length);
+        if (table->token[count].string == NULL)
+        {
+            snprintf(error, MESSAGE_LENGTH, "%s could not be stored.", 
+                     tokenTableFilename);
+            success = false;
+        }
+        count++;
+    }
+
+    /* The lexers rely on the id and int rows being there */
+    bool classesListed[2] = {false, false};
+    int i = 0;
+    for (i = 0; i < count && success == true; i++)
+    {
+        classesListed[0] = classesListed[0] || strcmp(table->token[i].string, "id") == 0;
+        classesListed[1] = classesListed[1] || strcmp(table->token[i].string, "int") == 0;
+    }
+    if (success == true && ferror(tokenFile))
+    {
+        snprintf(error, MESSAGE_LENGTH, "%s could not be read.", 
+                 tokenTableFilename);
+        success = false;
+    }
+    else if (success == true && count < TOKEN_TABLE_LENGTH)
+    {
+        snprintf(error, MESSAGE_LENGTH, "%s lists %d tokens instead of %d.", 
+                 tokenTableFilename, count, TOKEN_TABLE_LENGTH);
+        success = false;
+    }
+    else if (success == true && 
+             (classesListed[0] == false || classesListed[1] == false))
+    {
+        snprintf(error, MESSAGE_LENGTH, "%s does not list both the id and "
+                 "int tokens.", tokenTableFilename);
+        success = false;
+    }
+
+    fclose(tokenFile);
+    if (success == false)
+    {
+        freeArena(&table->names);
+    }
+    return success;
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* recordDiagnostic function:
+* Input: a pointer to a pipelineBlock object, the kind of error, the line and 
+*   column it was found at, and its message
+* Output: void
+* Purpose: Diagnostic handler used by the lexer of a pipeline. Keeps the 
+*   message as an event of the block being lexed, for the writer to print.
+-----------------------------------------------------------------------------*/
+
+void recordDiagnostic(void *block, int kind, int lineNumber, int column, 
+                      const char *message)
+{
+    (void)kind;
+    (void)column;
+
+    if (addPipelineEvent(block, EVENT_DIAGNOSTIC, lineNumber, 0, message, 
+                         strlen(message)) == false)
+    {
+        ((pipelineBlock *)block)->failed = true;
+    }
+}
+
+/*-----------------------------------------------------------------------------
+* recordLine function:
+* Input: a pointer to a pipelineBlock object, a line number, and a pointer to 
+*   the line's string and its length
+* Output: void
+* Purpose: Line handler used by the lexer of a pipeline. Keeps the line as an 
+*   event of the block being lexed, for the writer to print.
+-----------------------------------------------------------------------------*/
+
+void recordLine(void *block, int lineNumber, const char *string, int length)
+{
+    if (addPipelineEvent(block, EVENT_LINE, lineNumber, 0, string, 
+                         length) == false)
+    {
+        ((pipelineBlock *)block)->failed = true;
+    }
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* reportDiagnostic function:
+* Input: a pointer to a scannerContext object, the kind of error, the line 
+*   and column it was found at, and a printf format with its arguments
+* Output: void
+* Purpose: Formats an error message and passes it to the context's diagnostic 
+*   handler. Nothing is formatted when no handler is set.
+-----------------------------------------------------------------------------*/
+
+void reportDiagnostic(scannerContext *context, int kind, int lineNumber, 
+                      int column, const char *format, ...)
+{
+#ifdef SCANNER_STATS
+    if (context->stats != NULL && kind < STATS_ERROR_KINDS)
+    {
+        context->stats->errorCount[kind]++;
+    }
+#endif
+    if (context->diagnosticHandler == NULL)
+    {
+        return;
+    }
+
+    va_list arguments;
+    va_start(arguments, format);
+    passDiagnostic(context, kind, lineNumber, column, format, arguments);
+    va_end(arguments);
+}
+
+/*-----------------------------------------------------------------------------
+* reportDiagnosticAt function:
+* Input: a pointer to a scannerContext object, the kind of error, the offset 
+*   in the input it was found at, and a printf format with its arguments
+* Output: void
+* Purpose: Reports an error found by the lexer, like reportDiagnostic. The 
+*   line and column are looked up from the offset only when there is a 
+*   handler to pass them to.
+-----------------------------------------------------------------------------*/
+
+void reportDiagnosticAt(scannerContext *context, int kind, size_t offset, 
+                        const char *format, ...)
+{
+#ifdef SCANNER_STATS
+    if (context->stats != NULL && kind < STATS_ERROR_KINDS)
+    {
+        context->stats->errorCount[kind]++;
+    }
+#endif
+    if (context->diagnosticHandler == NULL)
+    {
+        return;
+    }
+
+    int lineNumber = 0;
+    int column = 0;
+    locateOffset(context, offset, &lineNumber, &column);
+
+    va_list arguments;
+    va_start(arguments, format);
+    passDiagnostic(context, kind, lineNumber, column, format, arguments);
+    va_end(arguments);
+}
+
+/*-----------------------------------------------------------------------------
+* runBatch function:
+* Input: a pointer to a batchJob object, the number of threads to use (0 for 
+*   one per processor)
+* Output: the number of files that could not be scanned
+* Purpose: Starts a pool of threads that each take the next unscanned file 
+*   from the job until none are left, then waits for them to finish. Without 
+*   POSIX threads the files are scanned one after another.
+-----------------------------------------------------------------------------*/
+
+int runBatch(batchJob *job, int threadCount)
+{
+#ifdef SCANNER_POSIX
+    if (threadCount <= 0)
+    {
+        threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threadCount > job->fileCount)
+    {
+        threadCount = job->fileCount;
+    }
+    if (threadCount < 1)
+    {
+        threadCount = 1;
+    }
+
+    pthread_mutex_init(&job->lock, NULL);
+
+    pthread_t *threads = malloc(threadCount * sizeof(pthread_t));
+    int started = 0;
+    while (threads != NULL && started < threadCount && 
+           pthread_create(&threads[started], NULL, scanBatchFiles, job) == 0)
+    {
+        started++;
+    }
+
+    /* If no thread could be started, do the work on this one */
+    if (started == 0)
+    {
+        scanBatchFiles(job);
+    }
+
+    int i = 0;
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    pthread_mutex_destroy(&job->lock);
+#else
+    scanBatchFiles(job);
+#endif
+
+    return job->failures;
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* runServer function:
+* Input: a pointer to a tokenTable object, a pointer to a character 
+*   containing the path of the socket, and a pointer to the scan options
+* Output: a boolean that is false if the socket could not be opened
+* Purpose: Serves scan requests on a Unix domain socket until a client asks 
+*   the server to stop. A pool of threads (one per processor unless "-j" 
+*   gives the number) each take the next connection and answer it, so the 
+*   requests of many clients are scanned at once with the one token table. 
+*   A socket left behind by a server that has gone is replaced, but not one 
+*   that a server is still answering on. The socket is made with mode 0600, 
+*   since FILE requests are opened with the server's privileges and any 
+*   user who could connect could read whatever the server can. A client 
+*   that hangs up must not end the program, so the SIGPIPE signal is 
+*   ignored.
+-----------------------------------------------------------------------------*/
+
+bool runServer(tokenTable *table, char *socketPath, scanOptions *options)
+{
+    int running = connectServer(socketPath);
+    if (running >= 0)
+    {
+        close(running);
+        return false;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+
+    serverJob job;
+    job.table = table;
+    job.options = options;
+    job.socketPath = socketPath;
+    job.stopping = 0;
+    job.threadCount = options->threadCount > 0 
+                    ? options->threadCount 
+                    : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (job.threadCount < 1)
+    {
+        job.threadCount = 1;
+    }
+
+    job.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (job.listener < 0)
+    {
+        return false;
+    }
+
+    /* Only the user running the server may connect */
+    mode_t mask = umask(0177);
+    bool bound = bind(job.listener, (struct sockaddr *)&address, 
+                      sizeof(address)) == 0;
+    umask(mask);
+    if (bound == false || listen(job.listener, SERVER_BACKLOG) != 0)
+    {
+        close(job.listener);
+        return false;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    printf("Serving scan requests on %s\n", socketPath);
+    fflush(stdout);
+
+    pthread_t *threads = malloc(job.threadCount * sizeof(pthread_t));
+    int started = 0;
+    while (threads != NULL && started < job.threadCount && 
+           pthread_create(&threads[started], NULL, serveConnections, &job) == 0)
+    {
+        started++;
+    }
+
+    /* If no thread could be started, serve on this one */
+    if (started == 0)
+    {
+        serveConnections(&job);
+    }
+
+    int i = 0;
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    close(job.listener);
+    unlink(socketPath);
+    return true;
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* scanBatchFiles function:
+* Input: a pointer to a batchJob object
+* Output: NULL
+* Purpose: Thread body for batch scanning. Repeatedly claims the next file in 
+*   the job and scans it into its file in the output directory, counting 
+*   the files that fail. The token table is only read, so it is shared by 
+*   all threads; everything else a scan changes belongs to that scan.
+-----------------------------------------------------------------------------*/
+
+void *scanBatchFiles(void *argument)
+{
+    batchJob *job = argument;
+
+    while (true)
+    {
+#ifdef SCANNER_POSIX
+        pthread_mutex_lock(&job->lock);
+#endif
+        int file = job->nextFile;
+        job->nextFile = job->nextFile + 1;
+#ifdef SCANNER_POSIX
+        pthread_mutex_unlock(&job->lock);
+#endif
+
+        if (file >= job->fileCount)
+        {
+            return NULL;
+        }
+
+        char *outputFilename = getOutputFilename(job->outputDirectory, 
+                                                 job->inputFilenames[file], 
+                                                 job->options->binaryOutput 
+                                                 ? "tok" : "out");
+        char *indexFilename = NULL;
+        if (job->options->crossReference == true)
+        {
+            indexFilename = getOutputFilename(job->outputDirectory, 
+                                              job->inputFilenames[file], "idx");
+        }
+        bool success = outputFilename != NULL && 
+                       (job->options->crossReference == false || 
+                        indexFilename != NULL) && 
+                       scanFile(job->table, job->inputFilenames[file], 
+                                outputFilename, indexFilename, job->options);
+        free(outputFilename);
+        free(indexFilename);
+
+        if (success == false)
+        {
+#ifdef SCANNER_POSIX
+            pthread_mutex_lock(&job->lock);
+#endif
+            job->failures = job->failures + 1;
+#ifdef SCANNER_POSIX
+            pthread_mutex_unlock(&job->lock);
+#endif
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------
+* scanFile function:
+* Input: a pointer to a tokenTable object, pointers to the input and output 
+*   file names, a pointer to the name of the index file (or NULL for no 
+*   index), and a pointer to the scan options
+* Output: a boolean that is false if any of the files could not be opened, 
+*   or the output or index could not be written
+* Purpose: Loads the input file, opens the output file, and scans one into 
+*   the other. When a pipeline is wanted for a listing, the input file is 
+*   only opened, and scanned by scanPipeline as it is read. With a cache, 
+*   the output stored for the same input and settings is copied instead of 
+*   scanning, and the output of a scan is stored for next time; the input 
+*   has to be loaded to be hashed, so the cache takes the place of the 
+*   pipeline. A cross-reference index is built by the scan itself, so 
+*   files that get one are not looked up in the cache. Errors opening the 
+*   files are reported and the file is skipped rather than ending the 
+*   program, so one bad file does not stop a batch.
+-----------------------------------------------------------------------------*/
+
+bool scanFile(tokenTable *table, char *inputFilename, char *outputFilename, 
+              char *indexFilename, scanOptions *options)
+{
+    scanOptions fileOptions = *options;
+    if (indexFilename != NULL)
+    {
+        fileOptions.cacheDirectory = NULL;
+        if ((fileOptions.indexFile = fopen(indexFilename, "wb")) == NULL)
+        {
+            printf("Error: %s could not be opened.\n", indexFilename);
+            return false;
+        }
+    }
+    options = &fileOptions;
+
+    source input = {0};
+    FILE *inputFile = NULL;
+    bool opened = false;
+#ifdef SCANNER_POSIX
+    if (options->pipeline == true && options->binaryOutput == false && 
+        options->cacheDirectory == NULL)
+    {
+#ifdef SCANNER_PROBES
+        DTRACE_PROBE1(scanner, file__open, inputFilename);
+#endif
+        inputFile = strcmp(inputFilename, "-") == 0 ? stdin 
+                                                    : fopen(inputFilename, "rb");
+        opened = inputFile != NULL;
+    }
+    else
+#endif
+    {
+        opened = openSource(inputFilename, &input);
+    }
+    if (opened == false)
+    {
+        printf("Error: %s could not be opened.\n", inputFilename);
+        if (fileOptions.indexFile != NULL)
+        {
+            fclose(fileOptions.indexFile);
+        }
+        return false;
+    }
+
+    FILE *outputFile;
+    bool written = false;
+#ifdef SCANNER_POSIX
+    cacheHeader header;
+    bool cached = false;
+    if (options->cacheDirectory != NULL)
+    {
+        getCacheHeader(table, &input, options, &header);
+    }
+#endif
+    if ((outputFile = fopen(outputFilename, options->binaryOutput ? "wb" : "w")) == NULL)
+    {
+        printf("Error: %s could not be opened.\n", outputFilename);
+    }
+#ifdef SCANNER_POSIX
+    else if (inputFile != NULL)
+    {
+        written = scanPipeline(table, inputFile, outputFile, options);
+    }
+    else if (options->cacheDirectory != NULL && 
+             readCacheEntry(options->cacheDirectory, &header, &input, 
+                            outputFile, options) == true)
+    {
+        written = true;
+        cached = true;
+    }
+#endif
+    else
+    {
+        written = scanSource(table, &input, outputFile, options);
+#if defined(SCANNER_POSIX) && defined(SCANNER_STATS)
+        if (options->cacheDirectory != NULL && options->stats != NULL)
+        {
+            scanStats fileStats;
+            memset(&fileStats, 0, sizeof(fileStats));
+            fileStats.cacheMisses = 1;
+            mergeStats(options->stats, &fileStats);
+        }
+#endif
+    }
+
+    /* close files */
+#ifdef SCANNER_PROBES
+    if (inputFile != NULL)
+    {
+        DTRACE_PROBE1(scanner, file__close, 0);
+    }
+#endif
+    if (inputFile != NULL && inputFile != stdin)
+    {
+        fclose(inputFile);
+    }
+    else if (inputFile == NULL)
+    {
+        closeSource(&input);
+    }
+    bool indexed = fileOptions.indexFile == NULL || 
+                   fclose(fileOptions.indexFile) == 0;
+    if (outputFile == NULL)
+    {
+        return false;
+    }
+    if (fclose(outputFile) != 0 || written == false)
+    {
+        printf("Error: %s could not be written.\n", outputFilename);
+        return false;
+    }
+    if (indexed == false)
+    {
+        printf("Error: %s could not be written.\n", indexFilename);
+        return false;
+    }
+#ifdef SCANNER_POSIX
+    if (options->cacheDirectory != NULL && cached == false)
+    {
+        storeCacheEntry(options->cacheDirectory, &header, outputFilename);
+    }
+#endif
+    return true;
+}
+
+#ifndef SCANNER_TABLE_GENERATOR
+/*-----------------------------------------------------------------------------
+* scanner_builtin_token_table function:
+* Input: None
+* Output: a pointer to a new tokenTable object, or NULL if it could not be 
+*   allocated
+* Purpose: Library version of loadBuiltinTokenTable. Gives the token table 
+*   compiled into the scanner without reading a file, to be released with 
+*   scanner_free_token_table like a loaded one. The first call of either 
+*   function also selects the SIMD kernels.
+-----------------------------------------------------------------------------*/
+
+tokenTable *scanner_builtin_token_table(void)
+{
+    selectKernelsOnce();
+
+    tokenTable *table = malloc(sizeof(tokenTable));
+    if (table != NULL)
+    {
+        loadBuiltinTokenTable(table);
+    }
+    return table;
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* scanner_close_index function:
+* Input: a pointer to a scannerIndex object
+* Output: void
+* Purpose: Releases a cross-reference index opened with scanner_open_index. 
+*   None of its arrays may be used afterwards.
+-----------------------------------------------------------------------------*/
+
+void scanner_close_index(scannerIndex *index)
+{
+#ifdef SCANNER_POSIX
+    if (index->mapping != NULL)
+    {
+        munmap(index->mapping, index->mappingLength);
+    }
+#else
+    free(index->mapping);
+#endif
+    memset(index, 0, sizeof(scannerIndex));
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_close_token_stream function:
+* Input: a pointer to a scannerTokenStream object
+* Output: void
+* Purpose: Releases a token stream opened with scanner_open_token_stream. 
+*   None of its arrays may be used afterwards.
+-----------------------------------------------------------------------------*/
+
+void scanner_close_token_stream(scannerTokenStream *stream)
+{
+#ifdef SCANNER_POSIX
+    if (stream->mapping != NULL)
+    {
+        munmap(stream->mapping, stream->mappingLength);
+    }
+#else
+    free(stream->mapping);
+#endif
+    memset(stream, 0, sizeof(scannerTokenStream));
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_create function:
+* Input: a pointer to a tokenTable object, a pointer to the text to scan, and 
+*   the text's length
+* Output: a pointer to a new scannerContext object, or NULL if it could not 
+*   be allocated
+* Purpose: Creates a context that scans its own copy of the text, so the 
+*   caller's text is left unchanged and may be freed at once. A '\n' is added 
+*   if the text does not end in one.
+-----------------------------------------------------------------------------*/
+
+scannerContext *scanner_create(tokenTable *table, const char *text, size_t length)
+{
+    source input = {0};
+    input.buffer = malloc(length + 1);
+    if (input.buffer == NULL)
+    {
+        return NULL;
+    }
+    memcpy(input.buffer, text, length);
+    input.length = length;
+    input.newlineAdded = length == 0 || text[length - 1] != '\n';
+    if (input.newlineAdded == true)
+    {
+        input.buffer[input.length] = '\n';
+        input.length = input.length + 1;
+    }
+
+    scannerContext *context = malloc(sizeof(scannerContext));
+    if (context == NULL)
+    {
+        closeSource(&input);
+        return NULL;
+    }
+    initContext(context, table, &input, false);
+    return context;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_create_from_file function:
+* Input: a pointer to a tokenTable object, a pointer to a character 
+*   containing the file name ("-" for standard input)
+* Output: a pointer to a new scannerContext object, or NULL if the file could 
+*   not be read
+* Purpose: Creates a context that scans a file, loaded with openSource.
+-----------------------------------------------------------------------------*/
+
+scannerContext *scanner_create_from_file(tokenTable *table, const char *inputFilename)
+{
+    source input;
+    if (openSource((char *)inputFilename, &input) == false)
+    {
+        return NULL;
+    }
+
+    scannerContext *context = malloc(sizeof(scannerContext));
+    if (context == NULL)
+    {
+        closeSource(&input);
+        return NULL;
+    }
+    initContext(context, table, &input, false);
+    return context;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_destroy function:
+* Input: a pointer to a scannerContext object
+* Output: void
+* Purpose: Releases a context's input, line index, symbol table and literal 
+*   pool, and the context.
+-----------------------------------------------------------------------------*/
+
+void scanner_destroy(scannerContext *context)
+{
+    if (context == NULL)
+    {
+        return;
+    }
+    closeSource(&context->input);
+    freeLineIndex(&context->lines);
+    freeSymbolTable(&context->symTable);
+    freeLiteralPool(&context->literals);
+    free(context);
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_document_create function:
+* Input: a pointer to a tokenTable object, a pointer to the text of the 
+*   document, and the text's length
+* Output: a pointer to a new scannerDocument object, or NULL if it could not 
+*   be allocated
+* Purpose: Creates a document holding its own copy of the text, split into 
+*   lines, and scans every line, recording a checkpoint at the start of each.
+-----------------------------------------------------------------------------*/
+
+scannerDocument *scanner_document_create(tokenTable *table, const char *text, 
+                                         size_t length)
+{
+    scannerDocument *document = calloc(1, sizeof(scannerDocument));
+    if (document == NULL)
+    {
+        return NULL;
+    }
+    document->table = table;
+
+    if (scanner_document_edit(document, 1, 0, text, length) < 0)
+    {
+        scanner_document_destroy(document);
+        return NULL;
+    }
+    return document;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_document_destroy function:
+* Input: a pointer to a scannerDocument object
+* Output: void
+* Purpose: Releases a document with all of its lines.
+-----------------------------------------------------------------------------*/
+
+void scanner_document_destroy(scannerDocument *document)
+{
+    if (document == NULL)
+    {
+        return;
+    }
+
+    int i = 0;
+    for (i = 0; i < document->lineCount; i++)
+    {
+        freeDocumentLine(&document->lines[i]);
+    }
+    free(document->lines);
+    free(document->declared);
+    freeArena(&document->names);
+    free(document);
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_document_diagnostic function:
+* Input: a pointer to a scannerDocument object, a line number, the index of 
+*   an error on that line, and a pointer to a scannerDiagnostic object to 
+*   fill in
+* Output: a boolean that is false if there is no such error
+* Purpose: Reads back one error found on a line. A line's lexing errors come 
+*   first, in the order they were found, followed by its symbol errors.
+-----------------------------------------------------------------------------*/
+
+bool scanner_document_diagnostic(scannerDocument *document, int lineNumber, 
+                                 int index, scannerDiagnostic *result)
+{
+    if (index < 0 || index >= scanner_document_diagnostic_count(document, lineNumber))
+    {
+        return false;
+    }
+
+    documentLine *current = &document->lines[lineNumber - 1];
+    documentDiagnostic *found = index < current->diagnosticCount 
+        ? &current->diagnostics[index] 
+        : &current->symbolDiagnostics[index - current->diagnosticCount];
+
+    result->kind = found->kind;
+    result->lineNumber = lineNumber;
+    result->column = found->column;
+    memcpy(result->message, found->message, MESSAGE_LENGTH);
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_document_diagnostic_count function:
+* Input: a pointer to a scannerDocument object and a line number
+* Output: the number of errors found on the line (0 if there is no such line)
+* Purpose: Counts a line's lexing and symbol errors together.
+-----------------------------------------------------------------------------*/
+
+int scanner_document_diagnostic_count(scannerDocument *document, int lineNumber)
+{
+    if (lineNumber < 1 || lineNumber > document->lineCount)
+    {
+        return 0;
+    }
+
+    documentLine *current = &document->lines[lineNumber - 1];
+    return current->diagnosticCount + current->symbolDiagnosticCount;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_document_edit function:
+* Input: a pointer to a scannerDocument object, the number of the first line 
+*   to replace, the number of lines to replace (0 to insert), and a pointer 
+*   to the new text for those lines and its length
+* Output: the number of lines that were lexed, or -1 if the edit is outside 
+*   the document or memory ran out
+* Purpose: Replaces a range of lines and rescans as little as possible. The 
+*   new lines are lexed starting from the comment state at the end of the 
+*   line before them. Lexing then carries on through the following lines 
+*   only until one is reached whose recorded starting state matches the new 
+*   state, after which every line is lexed exactly as before and its tokens 
+*   are kept. The symbol checks are re-run from around the first new line 
+*   by checkDocumentSymbols, which also stops as soon as the symbol table 
+*   state matches the old checkpoints again.
+-----------------------------------------------------------------------------*/
+
+int scanner_document_edit(scannerDocument *document, int firstLine, int lineCount, 
+                          const char *text, size_t length)
+{
+    int first = firstLine - 1;
+    if (first < 0 || lineCount < 0 || first + lineCount > document->lineCount)
+    {
+        return -1;
+    }
+
+    documentLine *newLines = NULL;
+    int newCount = 0;
+    if (splitDocumentLines(text, length, &newLines, &newCount) == false)
+    {
+        return -1;
+    }
+
+    /* Make room for the new lines, then swap them in for the old ones */
+    int total = document->lineCount - lineCount + newCount;
+    if (total > document->lineCapacity)
+    {
+        int capacity = total * 2;
+        documentLine *grown = realloc(document->lines, 
+                                      capacity * sizeof(documentLine));
+        if (grown == NULL)
+        {
+            int i = 0;
+            for (i = 0; i < newCount; i++)
+            {
+                freeDocumentLine(&newLines[i]);
+            }
+            free(newLines);
+            return -1;
+        }
+        document->lines = grown;
+        document->lineCapacity = capacity;
+    }
+
+    int i = 0;
+    for (i = first; i < first + lineCount; i++)
+    {
+        freeDocumentLine(&document->lines[i]);
+    }
+    int following = document->lineCount - first - lineCount;
+    if (following > 0)
+    {
+        memmove(&document->lines[first + newCount], 
+                &document->lines[first + lineCount], 
+                following * sizeof(documentLine));
+    }
+    if (newCount > 0)
+    {
+        memcpy(&document->lines[first], newLines, newCount * sizeof(documentLine));
+    }
+    free(newLines);
+    document->lineCount = total;
+
+    /* Lex the new lines, then any later lines whose starting state changed */
+    bool success = true;
+    bool inComment = first > 0 && document->lines[first - 1].endsInComment;
+    int lexed = 0;
+    for (i = first; i < total && success == true; i++)
+    {
+        if (i >= first + newCount && document->lines[i].startsInComment == inComment)
+        {
+            break;
+        }
+        success = lexDocumentLine(document, &document->lines[i], inComment);
+        inComment = document->lines[i].endsInComment;
+        lexed++;
+    }
+
+    /* Line starts after the edit have moved */
+    size_t start = first > 0 ? document->lines[first - 1].start + 
+                               document->lines[first - 1].length : 0;
+    int j = 0;
+    for (j = first; j < total; j++)
+    {
+        document->lines[j].start = start;
+        start = start + document->lines[j].length;
+    }
+
+    /* 
+    * The checkpoint at the first new line was lost with the old lines, so 
+    * the symbol checks restart from the line before it, which is unchanged.
+    */
+    if (success == false || 
+        checkDocumentSymbols(document, first > 0 ? first - 1 : 0, i) == false)
+    {
+        return -1;
+    }
+    return lexed;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_document_line_count function:
+* Input: a pointer to a scannerDocument object
+* Output: the number of lines in the document
+* Purpose: Tells the caller how many lines can be read back.
+-----------------------------------------------------------------------------*/
+
+int scanner_document_line_count(scannerDocument *document)
+{
+    return document->lineCount;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_document_token function:
+* Input: a pointer to a scannerDocument object, a line number, the index of 
+*   a token on that line, and a pointer to a scannerToken object to fill in
+* Output: a boolean that is false if there is no such token
+* Purpose: Reads back one token with a valid ID from a line, as 
+*   scanner_next_token would have returned it.
+-----------------------------------------------------------------------------*/
+
+bool scanner_document_token(scannerDocument *document, int lineNumber, int index, 
+                            scannerToken *result)
+{
+    if (index < 0 || index >= scanner_document_token_count(document, lineNumber))
+    {
+        return false;
+    }
+
+    documentLine *current = &document->lines[lineNumber - 1];
+    token *found = &current->tokens[index];
+
+    result->kind = found->ID;
+    result->text = found->string;
+    result->length = found->length;
+    result->lineNumber = lineNumber;
+    result->column = found->column;
+    result->offset = current->start + found->offset;
+    result->value = found->value;
+    result->literal = -1;
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_document_token_count function:
+* Input: a pointer to a scannerDocument object and a line number
+* Output: the number of tokens with valid IDs on the line (0 if there is no 
+*   such line)
+* Purpose: Tells the caller how many tokens a line has. A token that follows 
+*   a comment spanning several lines belongs to the line the comment ends on.
+-----------------------------------------------------------------------------*/
+
+int scanner_document_token_count(scannerDocument *document, int lineNumber)
+{
+    if (lineNumber < 1 || lineNumber > document->lineCount)
+    {
+        return 0;
+    }
+    return document->lines[lineNumber - 1].tokenCount;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_free_token_table function:
+* Input: a pointer to a tokenTable object
+* Output: void
+* Purpose: Releases a table loaded with scanner_load_token_table or given by 
+*   scanner_builtin_token_table. No context using the table may be scanned 
+*   afterwards.
+-----------------------------------------------------------------------------*/
+
+void scanner_free_token_table(tokenTable *table)
+{
+    if (table != NULL)
+    {
+        freeArena(&table->names);
+    }
+    free(table);
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_index_uses function:
+* Input: a pointer to an open scannerIndex object, a pointer to the name of 
+*   an identifier and its length, a pointer to an array for its use sites, 
+*   and how many the array can hold
+* Output: the number of sites where the identifier is declared or used, of 
+*   which the first capacity are stored in order, or -1 if the identifier 
+*   is not in the index
+* Purpose: Finds the identifier by a binary search of the index's sorted 
+*   names, ignoring case, and unpacks its list of uses. Passing a capacity 
+*   of 0 gives the number of sites without storing any.
+-----------------------------------------------------------------------------*/
+
+int scanner_index_uses(scannerIndex *index, const char *name, int length, 
+                       scannerUseSite *sites, int capacity)
+{
+    if (index->symbolCount == 0 || length <= 0 || 
+        length > SCANNER_STREAM_NAME_LENGTH)
+    {
+        return -1;
+    }
+
+    scannerIndexSymbol key;
+    memset(&key, 0, sizeof(key));
+    int i = 0;
+    for (i = 0; i < length; i++)
+    {
+        key.name[i] = foldCharacter(name[i]);
+    }
+
+    const scannerIndexSymbol *symbol = bsearch(&key, index->symbol, 
+                                               index->symbolCount, 
+                                               sizeof(scannerIndexSymbol), 
+                                               compareIndexSymbols);
+    if (symbol == NULL)
+    {
+        return -1;
+    }
+    return decodeUses(index->postings + symbol->postingOffset, 
+                      (size_t)symbol->postingLength, sites, capacity);
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_literals function:
+* Input: a pointer to a scannerContext object and a pointer to the number 
+*   of values
+* Output: a pointer to the values in the context's literal pool
+* Purpose: Gives the different values of the integers the context has 
+*   returned so far, in the order they first appeared, so the literal 
+*   number of a scannerToken indexes this array. The array may move when 
+*   the next token is read.
+-----------------------------------------------------------------------------*/
+
+const int *scanner_literals(scannerContext *context, int *count)
+{
+    *count = context->literals.count;
+    return context->literals.value;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_load_token_table function:
+* Input: a pointer to a character containing the file name
+* Output: a pointer to a new tokenTable object, or NULL if the file could not 
+*   be read or hashed
+* Purpose: Library version of constructTokenTable, which reports failure to 
+*   the caller instead of ending the program. The first call also selects 
+*   the SIMD kernels. The table is only read after this, so one table can 
+*   be shared by every context.
+-----------------------------------------------------------------------------*/
+
+tokenTable *scanner_load_token_table(const char *tokenTableFilename)
+{
+    selectKernelsOnce();
+
+    tokenTable *table = malloc(sizeof(tokenTable));
+    if (table == NULL)
+    {
+        return NULL;
+    }
+
+    char error[MESSAGE_LENGTH];
+    if (readTokenTable((char *)tokenTableFilename, table, error) == false)
+    {
+        free(table);
+        return NULL;
+    }
+    if (buildKeywordHash(table) == false)
+    {
+        scanner_free_token_table(table);
+        return NULL;
+    }
+    buildLexerTables(table);
+    return table;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_next_token function:
+* Input: a pointer to a scannerContext object, a pointer to a scannerToken 
+*   object to fill in
+* Output: a boolean that is false once the input is exhausted
+* Purpose: Scans up to the next token with a valid ID and describes it in 
+*   result. Comments and characters that are not allowed are skipped, after 
+*   reporting any errors. Identifiers are checked against the context's 
+*   symbol table as in the listing, so symbol errors for a token are 
+*   reported before the token is returned. Integers come with their value 
+*   and their number in the context's literal pool.
+-----------------------------------------------------------------------------*/
+
+bool scanner_next_token(scannerContext *context, scannerToken *result)
+{
+    while (!endOfSource(context))
+    {
+        token currentToken = getToken(context);
+        checkSymbol(context, &currentToken);
+
+        if (currentToken.ID != 0)
+        {
+            locateToken(context, &currentToken);
+            result->kind = currentToken.ID;
+            result->text = currentToken.string;
+            result->length = currentToken.length;
+            result->lineNumber = currentToken.lineNumber;
+            result->column = currentToken.column;
+            result->offset = currentToken.offset;
+            result->value = currentToken.value;
+            result->literal = -1;
+            if (currentToken.ID == context->table->intID)
+            {
+                result->literal = internLiteral(&context->literals, 
+                                                currentToken.value);
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_open_index function:
+* Input: a pointer to a character containing the file name, a pointer to a 
+*   scannerIndex object to fill in
+* Output: a boolean that is false if the file could not be read, or is not 
+*   a cross-reference index of this version
+* Purpose: Maps a cross-reference index written with "--index" or 
+*   scanner_write_index (or reads it, where mmap is not available) and 
+*   points the index at its identifiers and lists of uses. The header is 
+*   checked, and every section and list must lie inside the file, so the 
+*   index can be searched without checking it again.
+-----------------------------------------------------------------------------*/
+
+bool scanner_open_index(const char *indexFilename, scannerIndex *index)
+{
+    memset(index, 0, sizeof(scannerIndex));
+
+    size_t fileLength = 0;
+    void *mapping = mapFile(indexFilename, sizeof(scannerIndexHeader), 
+                            &fileLength);
+    if (mapping == NULL)
+    {
+        return false;
+    }
+
+    index->mapping = mapping;
+    index->mappingLength = fileLength;
+
+    const scannerIndexHeader *header = mapping;
+    uint64_t symbols = header->symbolCount;
+    bool valid = memcmp(header->magic, SCANNER_INDEX_MAGIC, 4) == 0 && 
+                 header->version == SCANNER_INDEX_VERSION && 
+                 symbols <= fileLength && 
+                 header->symbolSection % 8 == 0 && 
+                 header->symbolSection <= fileLength && 
+                 symbols * sizeof(scannerIndexSymbol) <= 
+                 fileLength - header->symbolSection && 
+                 header->postingSection <= fileLength && 
+                 header->postingLength <= fileLength - header->postingSection;
+
+    const char *base = mapping;
+    const scannerIndexSymbol *symbol = 
+        (const scannerIndexSymbol *)(base + header->symbolSection);
+    uint64_t i = 0;
+    for (i = 0; i < symbols && valid == true; i++)
+    {
+        valid = symbol[i].postingOffset <= header->postingLength && 
+                symbol[i].postingLength <= 
+                header->postingLength - symbol[i].postingOffset;
+    }
+
+    if (valid == false)
+    {
+        scanner_close_index(index);
+        return false;
+    }
+
+    index->header = header;
+    index->symbol = symbol;
+    index->postings = (const uint8_t *)(base + header->postingSection);
+    index->symbolCount = (size_t)symbols;
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_open_token_stream function:
+* Input: a pointer to a character containing the file name, a pointer to a 
+*   scannerTokenStream object to fill in
+* Output: a boolean that is false if the file could not be read, or is not 
+*   a token stream of this version
+* Purpose: Maps a binary token stream written with "--binary" (or reads it, 
+*   where mmap is not available) and points the stream's arrays at its 
+*   sections. The header is checked, every section must lie inside the 
+*   file and be aligned for its type, and every token's literal number must 
+*   be UINT32_MAX or name an entry of the pool, so the arrays, and the pool 
+*   through the literal numbers, can be indexed directly.
+-----------------------------------------------------------------------------*/
+
+bool scanner_open_token_stream(const char *streamFilename, scannerTokenStream *stream)
+{
+    memset(stream, 0, sizeof(scannerTokenStream));
+
+    size_t fileLength = 0;
+    void *mapping = mapFile(streamFilename, sizeof(scannerStreamHeader), 
+                            &fileLength);
+    if (mapping == NULL)
+    {
+        return false;
+    }
+
+    stream->mapping = mapping;
+    stream->mappingLength = fileLength;
+
+    const scannerStreamHeader *header = mapping;
+    uint64_t count = header->tokenCount;
+    uint64_t symbols = header->symbolCount;
+    bool valid = memcmp(header->magic, SCANNER_STREAM_MAGIC, 4) == 0 && 
+                 header->version == SCANNER_STREAM_VERSION && 
+                 count <= fileLength && symbols <= fileLength;
+
+    uint64_t literals = header->literalCount;
+    valid = valid == true && literals <= fileLength;
+
+    /* Each section must be aligned and end inside the file */
+    uint64_t section[7] = { header->kindSection, header->offsetSection, 
+                            header->lengthSection, header->lineSection, 
+                            header->symbolSection, header->literalSection, 
+                            header->poolSection };
+    uint64_t sectionSize[7] = { count * sizeof(uint16_t), count * sizeof(uint64_t), 
+                                count * sizeof(uint8_t), count * sizeof(uint32_t), 
+                                symbols * sizeof(scannerStreamSymbol), 
+                                count * sizeof(uint32_t), 
+                                literals * sizeof(int32_t) };
+    int i = 0;
+    for (i = 0; i < 7 && valid == true; i++)
+    {
+        valid = section[i] % 8 == 0 && section[i] <= fileLength && 
+                sectionSize[i] <= fileLength - section[i];
+    }
+
+    /* A token's literal number must name an entry of the pool */
+    const uint32_t *literal = (const uint32_t *)((const char *)mapping + 
+                                                 header->literalSection);
+    uint64_t token = 0;
+    for (token = 0; token < count && valid == true; token++)
+    {
+        valid = literal[token] == UINT32_MAX || literal[token] < literals;
+    }
+
+    if (valid == false)
+    {
+        scanner_close_token_stream(stream);
+        return false;
+    }
+
+    const char *base = mapping;
+    stream->header = header;
+    stream->kind = (const uint16_t *)(base + header->kindSection);
+    stream->offset = (const uint64_t *)(base + header->offsetSection);
+    stream->length = (const uint8_t *)(base + header->lengthSection);
+    stream->lineNumber = (const uint32_t *)(base + header->lineSection);
+    stream->symbol = (const scannerStreamSymbol *)(base + header->symbolSection);
+    stream->literal = (const uint32_t *)(base + header->literalSection);
+    stream->pool = (const int32_t *)(base + header->poolSection);
+    stream->tokenCount = (size_t)count;
+    stream->symbolCount = (size_t)symbols;
+    stream->literalCount = (size_t)literals;
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_set_cross_reference function:
+* Input: a pointer to a scannerContext object, a bool that turns the 
+*   cross-reference index on or off
+* Output: a boolean that is false if the index could not be allocated
+* Purpose: Makes the context keep the line and column of every declaration 
+*   and use of each identifier in its symbol table, for scanner_uses and 
+*   scanner_write_index. Only the tokens read after it is turned on are 
+*   recorded, so it is best called before the first one. Turning it off 
+*   discards what has been recorded.
+-----------------------------------------------------------------------------*/
+
+bool scanner_set_cross_reference(scannerContext *context, bool enabled)
+{
+    if (enabled == false)
+    {
+        freeUses(&context->symTable);
+        return true;
+    }
+    return startCrossReference(&context->symTable);
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_set_diagnostic_handler function:
+* Input: a pointer to a scannerContext object, a handler (or NULL to ignore 
+*   errors), and a pointer passed back to the handler
+* Output: void
+* Purpose: Sets the function that is given each error the context finds.
+-----------------------------------------------------------------------------*/
+
+void scanner_set_diagnostic_handler(scannerContext *context, 
+                                    scannerDiagnosticHandler handler, 
+                                    void *userData)
+{
+    context->diagnosticHandler = handler;
+    context->diagnosticData = userData;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_set_line_handler function:
+* Input: a pointer to a scannerContext object, a handler (or NULL), and a 
+*   pointer passed back to the handler
+* Output: void
+* Purpose: Sets the function that is given each line, after formatting, as 
+*   the scanner reaches it.
+-----------------------------------------------------------------------------*/
+
+void scanner_set_line_handler(scannerContext *context, 
+                              scannerLineHandler handler, void *userData)
+{
+    context->lineHandler = handler;
+    context->lineData = userData;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_set_table_driven function:
+* Input: a pointer to a scannerContext object, a bool selecting the lexer
+* Output: void
+* Purpose: Chooses between buildToken and the table-driven lexer, which 
+*   produce the same tokens.
+-----------------------------------------------------------------------------*/
+
+void scanner_set_table_driven(scannerContext *context, bool tableDriven)
+{
+    context->tableDriven = tableDriven;
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_uses function:
+* Input: a pointer to a scannerContext object that keeps a cross-reference 
+*   index, a pointer to the name of an identifier and its length, a pointer 
+*   to an array for its use sites, and how many the array can hold
+* Output: the number of sites where the identifier has been declared or 
+*   used so far, of which the first capacity are stored in order, or -1 if 
+*   the identifier is not in the symbol table or no index is kept
+* Purpose: Looks an identifier up in the context's symbol table, ignoring 
+*   case, and unpacks its list of uses.
+-----------------------------------------------------------------------------*/
+
+int scanner_uses(scannerContext *context, const char *name, int length, 
+                 scannerUseSite *sites, int capacity)
+{
+    if (context->symTable.uses == NULL || length <= 0 || length > TOKEN_LENGTH)
+    {
+        return -1;
+    }
+
+    token wanted;
+    memset(&wanted, 0, sizeof(wanted));
+    wanted.string = (char *)name;
+    wanted.length = length;
+    int tableSlot = findSymbol(&wanted, &context->symTable);
+    if (tableSlot < 0)
+    {
+        return -1;
+    }
+
+    postingList *uses = &context->symTable.uses[tableSlot];
+    return decodeUses(uses->data, uses->length, sites, capacity);
+}
+
+/*-----------------------------------------------------------------------------
+* scanner_write_index function:
+* Input: a pointer to a scannerContext object that keeps a cross-reference 
+*   index, a pointer to a character containing the name of the file to 
+*   write
+* Output: a boolean that is false if no index is kept or the file could 
+*   not be written
+* Purpose: Saves the context's cross-reference index as it stands, in the 
+*   format written by "--index", for scanner_open_index.
+-----------------------------------------------------------------------------*/
+
+bool scanner_write_index(scannerContext *context, const char *indexFilename)
+{
+    if (context->symTable.uses == NULL)
+    {
+        return false;
+    }
+
+    FILE *indexFile = fopen(indexFilename, "wb");
+    if (indexFile == NULL)
+    {
+        return false;
+    }
+    bool written = writeIndex(&context->symTable, indexFile);
+    return fclose(indexFile) == 0 && written == true;
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* scanPipeline function:
+* Input: a pointer to a tokenTable object, pointers to the input and output 
+*   files, and a pointer to the scan options
+* Output: a boolean that is false if the input could not be read or the 
+*   output could not be written
+* Purpose: Scans an input as it is read instead of loading it first. The 
+*   reading, lexing and writing each run on a thread of their own, the 
+*   writer on the calling thread, so reads and writes overlap with lexing. 
+*   The stages pass PIPELINE_DEPTH blocks round through ring buffers: the 
+*   reader fills a free block, the lexer adds the lines, tokens and errors 
+*   it finds as events, and the writer prints the events in order and frees 
+*   the block again. With every block in use the reader has to wait, so the 
+*   memory used does not grow with the input. The listing is the same as 
+*   scanSource writes for the whole input.
+-----------------------------------------------------------------------------*/
+
+bool scanPipeline(tokenTable *table, FILE *inputFile, FILE *outputFile, 
+                  scanOptions *options)
+{
+    pipelineJob *job = calloc(1, sizeof(pipelineJob));
+    if (job == NULL)
+    {
+        return false;
+    }
+    job->inputFile = inputFile;
+    job->options = options;
+
+    outputBuffer output;
+    bool success = openOutput(&output, outputFile);
+    output.upperCase = options->preserveCase == false;
+
+    int i = 0;
+    for (i = 0; i < PIPELINE_DEPTH; i++)
+    {
+        job->block[i].data = malloc(PIPELINE_BLOCK_SIZE);
+        job->block[i].capacity = PIPELINE_BLOCK_SIZE;
+        success = success == true && job->block[i].data != NULL;
+        pushRing(&job->freeBlocks, &job->block[i]);
+    }
+
+    initContext(&job->context, table, NULL, options->tableDriven);
+    if (options->tokensOnly == false)
+    {
+        job->context.lineHandler = recordLine;
+    }
+    job->context.diagnosticHandler = recordDiagnostic;
+    if (options->indexFile != NULL)
+    {
+        startCrossReference(&job->context.symTable);
+    }
+#ifdef SCANNER_STATS
+    scanStats stats;
+    attachStats(&job->context, options->stats != NULL ? &stats : NULL);
+#endif
+
+    pthread_t lexer;
+    pthread_t reader;
+    bool lexerStarted = success == true && 
+                        pthread_create(&lexer, NULL, lexPipeline, job) == 0;
+    bool readerStarted = lexerStarted == true && 
+                         pthread_create(&reader, NULL, readPipeline, job) == 0;
+    if (lexerStarted == true && readerStarted == false)
+    {
+        /* Stand in for the reader so that the lexer still stops */
+        pipelineBlock *block = popRing(&job->freeBlocks);
+        block->length = 0;
+        block->last = true;
+        pushRing(&job->readBlocks, block);
+    }
+
+    /* Write the events of each block in turn */
+    bool last = lexerStarted == false;
+    while (last == false)
+    {
+        pipelineBlock *block = popRing(&job->lexedBlocks);
+        last = block->last;
+        success = success == true && block->failed == false;
+
+        int event = 0;
+        for (event = 0; event < block->eventCount; event++)
+        {
+            pipelineEvent *current = &block->events[event];
+            if (current->kind == EVENT_LINE)
+            {
+                printLine(&output, current->lineNumber, current->string, 
+                          current->length);
+            }
+            else if (current->kind == EVENT_TOKEN)
+            {
+                token currentToken;
+                currentToken.string = (char *)current->string;
+                currentToken.length = current->length;
+                currentToken.ID = current->ID;
+                printToken(&output, table, &currentToken);
+            }
+            else
+            {
+                printDiagnostic(&output, 0, current->lineNumber, 0, 
+                                block->messages + current->message);
+            }
+        }
+
+        pushRing(&job->freeBlocks, block);
+    }
+
+    if (lexerStarted == true)
+    {
+        pthread_join(lexer, NULL);
+    }
+    if (readerStarted == true)
+    {
+        pthread_join(reader, NULL);
+    }
+    success = success == true && readerStarted == true && job->failed == 0;
+
+    if (lexerStarted == true)
+    {
+        printSymbolTable(&job->context.symTable, &output);
+    }
+    success = closeOutput(&output) == true && success == true;
+    if (options->indexFile != NULL)
+    {
+        success = lexerStarted == true && success == true && 
+                  writeIndex(&job->context.symTable, options->indexFile) == true;
+    }
+#ifdef SCANNER_STATS
+    collectStats(options->stats, &job->context);
+    if (options->stats != NULL)
+    {
+        scanStats fileStats;
+        memset(&fileStats, 0, sizeof(fileStats));
+        fileStats.fileCount = 1;
+        fileStats.bytesIn = job->bytesRead;
+        fileStats.bytesOut = output.written;
+        mergeStats(options->stats, &fileStats);
+    }
+#endif
+
+    for (i = 0; i < PIPELINE_DEPTH; i++)
+    {
+        free(job->block[i].data);
+        free(job->block[i].events);
+        free(job->block[i].messages);
+    }
+    freeSymbolTable(&job->context.symTable);
+    free(job);
+    return success;
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* scanSource function:
+* Input: a pointer to a tokenTable object, a pointer to a source object, a 
+*   pointer to an output file, and a pointer to the scan options
+* Output: a boolean that is false if the output could not be written
+* Purpose: Scans one input from start to finish. Gets tokens, prints them, 
+*   and checks them against a symbol table that belongs to this scan alone, 
+*   then prints the symbol table at the end of the input. The lines of the 
+*   input are left out of the listing when only tokens are wanted. Inputs of 
+*   at least two chunks are handed to scanSplitSource when splitting is 
+*   enabled, and the whole scan is handed to writeTokenStream when a binary 
+*   token stream is wanted instead of a listing. With an index file in the 
+*   options, the uses of each identifier are kept while scanning and the 
+*   cross-reference index is written to it at the end.
+-----------------------------------------------------------------------------*/
+
+bool scanSource(tokenTable *table, source *input, FILE *outputFile, 
+                scanOptions *options)
+{
+    if (options->binaryOutput == true)
+    {
+        return writeTokenStream(table, input, outputFile, options);
+    }
+
+    outputBuffer output;
+    if (openOutput(&output, outputFile) == false)
+    {
+        return false;
+    }
+    output.upperCase = options->preserveCase == false;
+
+    bool written = false;
+#ifdef SCANNER_POSIX
+    if (options->splitInput == true && input->length >= 2 * SPLIT_CHUNK_SIZE && 
+        scanSplitSource(table, input, &output, options) == true)
+    {
+        written = closeOutput(&output);
+    }
+    else
+#endif
+    {
+        scannerContext context;
+        initContext(&context, table, input, options->tableDriven);
+        if (options->tokensOnly == false)
+        {
+            context.lineHandler = printLine;
+            context.lineData = &output;
+        }
+        context.diagnosticHandler = printDiagnostic;
+        context.diagnosticData = &output;
+        if (options->indexFile != NULL)
+        {
+            startCrossReference(&context.symTable);
+        }
+#ifdef SCANNER_STATS
+        scanStats stats;
+        attachStats(&context, options->stats != NULL ? &stats : NULL);
+#endif
+        
+        while (!endOfSource(&context))
+        {
+            /*
+            * getToken starts the process of generating tokens for output.
+            * Check symbol determines whether the token needs to be added
+            * to the symbol table or searched for in the table. 
+            */
+            token currentToken = getToken(&context);
+#ifdef SCANNER_STATS
+            enterPhase(context.stats, PHASE_OUTPUT);
+#endif
+            printToken(&output, table, &currentToken);
+#ifdef SCANNER_STATS
+            enterPhase(context.stats, PHASE_SYMBOL);
+#endif
+            checkSymbol(&context, &currentToken);
+        }
+        
+#ifdef SCANNER_STATS
+        enterPhase(context.stats, PHASE_OUTPUT);
+#endif
+        printSymbolTable(&context.symTable, &output);
+        written = closeOutput(&output);
+        if (options->indexFile != NULL && 
+            writeIndex(&context.symTable, options->indexFile) == false)
+        {
+            written = false;
+        }
+#ifdef SCANNER_STATS
+        collectStats(options->stats, &context);
+#endif
+        freeLineIndex(&context.lines);
+        freeSymbolTable(&context.symTable);
+    }
+
+#ifdef SCANNER_STATS
+    if (options->stats != NULL)
+    {
+        scanStats fileStats;
+        memset(&fileStats, 0, sizeof(fileStats));
+        fileStats.fileCount = 1;
+        fileStats.bytesIn = input->length - (input->newlineAdded ? 1 : 0);
+        fileStats.bytesOut = output.written;
+        mergeStats(options->stats, &fileStats);
+    }
+#endif
+    return written;
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* scanSplitSource function:
+* Input: a pointer to a tokenTable object, a pointer to a source object, a 
+*   pointer to an outputBuffer object, and a pointer to the scan options
+* Output: a boolean that is false if the input could not be split, in which 
+*   case nothing has been written
+* Purpose: Scans a large input by splitting it into chunks of about 
+*   SPLIT_CHUNK_SIZE bytes that end on a '\n'. The only lexer state carried 
+*   from one line to the next is whether a comment is open, so each chunk 
+*   after the first is lexed on the thread pool from both states. The chunks 
+*   are then stitched in order: each one's text is taken from the state the 
+*   previous chunk ended in, and the symbol checks that were held back are 
+*   run at their places in the text, in one quick pass that keeps the BEGIN 
+*   and symbol table behaviour exactly as in a sequential scan.
+-----------------------------------------------------------------------------*/
+
+bool scanSplitSource(tokenTable *table, source *input, outputBuffer *output, 
+                     scanOptions *options)
+{
+    splitJob job;
+    job.table = table;
+    job.options = options;
+    job.chunkCount = 0;
+    job.nextTask = 0;
+    job.chunks = calloc(input->length / SPLIT_CHUNK_SIZE + 1, sizeof(chunk));
+    if (job.chunks == NULL)
+    {
+        return false;
+    }
+
+    /* Cut the input into chunks at line boundaries and number their lines */
+    size_t start = 0;
+    int firstLine = 1;
+    while (start < input->length)
+    {
+        size_t end = start + SPLIT_CHUNK_SIZE;
+        if (end >= input->length)
+        {
+            end = input->length;
+        }
+        else
+        {
+            end = (char *)memchr(input->buffer + end - 1, '\n', 
+                                 input->length - end + 1) - input->buffer + 1;
+        }
+
+        chunk *part = &job.chunks[job.chunkCount];
+        part->input.buffer = input->buffer + start;
+        part->input.length = end - start;
+        part->input.position = 0;
+        part->input.mapped = false;
+        part->input.commentOpen = false;
+        part->input.newlineAdded = false;
+        part->firstLine = firstLine;
+        job.chunkCount = job.chunkCount + 1;
+
+        char *newline = part->input.buffer;
+        char *chunkEnd = input->buffer + end;
+        while ((newline = memchr(newline, '\n', chunkEnd - newline)) != NULL)
+        {
+            firstLine++;
+            newline++;
+        }
+        start = end;
+    }
+
+    /* Lex every chunk from both starting states on the thread pool */
+    int threadCount = options->threadCount;
+    if (threadCount <= 0)
+    {
+        threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threadCount < 1)
+    {
+        threadCount = 1;
+    }
+
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_t *threads = malloc(threadCount * sizeof(pthread_t));
+    int started = 0;
+    while (threads != NULL && started < threadCount && 
+           pthread_create(&threads[started], NULL, lexChunks, &job) == 0)
+    {
+        started++;
+    }
+    if (started == 0)
+    {
+        lexChunks(&job);
+    }
+
+    int i = 0;
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&job.lock);
+
+    /* Make sure every chunk was lexed before anything is written */
+    bool success = true;
+    for (i = 0; i < job.chunkCount; i++)
+    {
+        if (job.chunks[i].text[0].data == NULL || 
+            (i > 0 && job.chunks[i].text[1].data == NULL))
+        {
+            success = false;
+        }
+    }
+
+    /* Stitch the chunks together, running the held-back symbol checks */
+    if (success == true)
+    {
+        scannerContext context;
+        initContext(&context, table, NULL, options->tableDriven);
+        context.diagnosticHandler = printDiagnostic;
+        context.diagnosticData = output;
+        if (options->indexFile != NULL)
+        {
+            startCrossReference(&context.symTable);
+        }
+#ifdef SCANNER_STATS
+        scanStats stats;
+        attachStats(&context, options->stats != NULL ? &stats : NULL);
+#endif
+        int state = 0;
+
+        for (i = 0; i < job.chunkCount; i++)
+        {
+            chunk *part = &job.chunks[i];
+            size_t written = 0;
+#ifdef SCANNER_STATS
+            mergeStats(options->stats, &part->stats[state]);
+#endif
+
+            int event = 0;
+            for (event = 0; event < part->eventCount[state]; event++)
+            {
+                symbolEvent *current = &part->events[state][event];
+#ifdef SCANNER_STATS
+                enterPhase(context.stats, PHASE_OUTPUT);
+#endif
+                appendBytes(output, part->text[state].data + written, 
+                            current->offset - written);
+                written = current->offset;
+#ifdef SCANNER_STATS
+                enterPhase(context.stats, PHASE_SYMBOL);
+#endif
+                checkSymbol(&context, &current->token);
+            }
+#ifdef SCANNER_STATS
+            enterPhase(context.stats, PHASE_OUTPUT);
+#endif
+            appendBytes(output, part->text[state].data + written, 
+                        part->text[state].length - written);
+
+            state = part->endsInComment[state] ? 1 : 0;
+        }
+
+        printSymbolTable(&context.symTable, output);
+        if (options->indexFile != NULL && 
+            writeIndex(&context.symTable, options->indexFile) == false)
+        {
+            output->failed = true;
+        }
+#ifdef SCANNER_STATS
+        collectStats(options->stats, &context);
+#endif
+        freeSymbolTable(&context.symTable);
+    }
+
+    for (i = 0; i < job.chunkCount; i++)
+    {
+        free(job.chunks[i].text[0].data);
+        free(job.chunks[i].text[1].data);
+        free(job.chunks[i].events[0]);
+        free(job.chunks[i].events[1]);
+    }
+    free(job.chunks);
+
+    return success;
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* searchForSymbol function:
+* Input: a pointer to a token, a pointer to a symbolTable
+* Output: a boolean representing whether or not the token is an element of the 
+*		symbol table
+* Purpose: This function returns a boolean with the true value if the token is 
+*		in the symbol table, and the false value if the token is not, as 
+*		found by findSymbol.
+-----------------------------------------------------------------------------*/
+
+bool searchForSymbol(token *currentToken, symbolTable *symTable)
+{
+	return findSymbol(currentToken, symTable) >= 0;
+}
+
+/*-----------------------------------------------------------------------------
+* selectKernels function:
+* Input: None
+* Output: void
+* Purpose: Points the countRun, findCommentEnd, findNewlines and foldCase 
+*		kernels at the AVX2 or SSE2 versions, and findFrozenSymbol at the 
+*		SSE2 version, when the CPU supports them. The scalar versions are 
+*		used otherwise, and on compilers or processors without these 
+*		intrinsics.
+-----------------------------------------------------------------------------*/
+
+void selectKernels()
+{
+#ifdef SCANNER_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		countRun = countRunAVX2;
+		findCommentEnd = findCommentEndAVX2;
+		findNewlines = findNewlinesAVX2;
+		foldCase = foldCaseAVX2;
+	}
+	else if (__builtin_cpu_supports("sse2"))
+	{
+		countRun = countRunSSE2;
+		findCommentEnd = findCommentEndSSE2;
+		findNewlines = findNewlinesSSE2;
+		foldCase = foldCaseSSE2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		findFrozenSymbol = findFrozenSymbolSSE2;
+	}
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+* selectKernelsOnce function:
+* Input: None
+* Output: void
+* Purpose: Calls selectKernels the first time a library function that loads 
+*		a token table is called, even when several threads load tables at 
+*		once.
+-----------------------------------------------------------------------------*/
+
+void selectKernelsOnce()
+{
+#ifdef SCANNER_POSIX
+	static pthread_once_t kernelsSelected = PTHREAD_ONCE_INIT;
+	pthread_once(&kernelsSelected, selectKernels);
+#else
+	selectKernels();
+#endif
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* sendReply function:
+* Input: a connected socket, a pointer to a character containing the reply
+* Output: a boolean that is false if the reply could not be sent
+* Purpose: Writes a status line to a client of the scan server, repeating 
+*   the write until all of it has gone.
+-----------------------------------------------------------------------------*/
+
+bool sendReply(int connection, const char *reply)
+{
+    size_t length = strlen(reply);
+    while (length > 0)
+    {
+        ssize_t written = write(connection, reply, length);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        reply = reply + written;
+        length = length - (size_t)written;
+    }
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+* serveConnections function:
+* Input: a pointer to a serverJob object
+* Output: NULL
+* Purpose: Thread body for the scan server. Takes connections one at a time 
+*   and answers the request on each. The thread's request buffer is kept 
+*   from one connection to the next, so once it has grown to fit the texts 
+*   being sent it is not allocated again. The thread that answers a request 
+*   to stop wakes each of the others with a connection of its own, so they 
+*   see that the server is stopping and return. A connection that neither 
+*   sends nor takes anything for SERVER_TIMEOUT_SECONDS is given up, so an 
+*   idle client cannot hold a thread for good.
+-----------------------------------------------------------------------------*/
+
+void *serveConnections(void *argument)
+{
+    serverJob *job = argument;
+    size_t capacity = READ_BLOCK_SIZE;
+    char *buffer = malloc(capacity);
+
+    while (buffer != NULL)
+    {
+        int connection = accept(job->listener, NULL, NULL);
+        if (connection < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno != EMFILE && errno != ENFILE)
+            {
+                break;
+            }
+
+            /* Out of descriptors for now, so wait for some to be closed */
+            struct timespec pause = {0, 10000000};
+            nanosleep(&pause, NULL);
+            continue;
+        }
+        if (__atomic_load_n(&job->stopping, __ATOMIC_ACQUIRE) != 0)
+        {
+            close(connection);
+            break;
+        }
+
+        struct timeval timeout = {SERVER_TIMEOUT_SECONDS, 0};
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, 
+                   sizeof(timeout));
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, 
+                   sizeof(timeout));
+
+        bool stop = serveRequest(job, connection, &buffer, &capacity);
+        close(connection);
+        if (stop == true)
+        {
+            __atomic_store_n(&job->stopping, 1, __ATOMIC_RELEASE);
+            int i = 0;
+            for (i = 1; i < job->threadCount; i++)
+            {
+                int wake = connectServer(job->socketPath);
+                if (wake >= 0)
+                {
+                    close(wake);
+                }
+            }
+            break;
+        }
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+* serveRequest function:
+* Input: a pointer to a serverJob object, a connected socket, and pointers to 
+*   the thread's request buffer and its capacity
+* Output: a boolean that is true if the request was to stop the server
+* Purpose: Reads one request from a client of the scan server and answers 
+*   it. A request is one line, followed for text by the text itself:
+*       FILE flags path      scan the file at path
+*       TEXT flags length    scan the length bytes after the line (at most 
+*                            SERVER_TEXT_LIMIT)
+*       STOP                 stop the server once its requests are answered
+*   The flags are "-" or any of the letters t (tokens only), b (binary token 
+*   stream), p (preserve case) and d (table-driven lexer), which are added 
+*   to the options the server was started with. The answer is "OK" on a 
+*   line of its own followed by the output up to the end of the connection, 
+*   or "ERROR" followed by a message. Text is read into the thread's buffer 
+*   and scanned there without being copied. A path is opened with the 
+*   server's own privileges. If the scan or its output fails 
+*   once "OK" has been sent, the server prints an error naming the request 
+*   and shuts the connection down.
+-----------------------------------------------------------------------------*/
+
+bool serveRequest(serverJob *job, int connection, char **buffer, 
+                  size_t *capacity)
+{
+    char reply[SERVER_REQUEST_LENGTH + 64];
+
+    /* Read until the request line is complete; text may follow it */
+    size_t received = 0;
+    char *end = NULL;
+    while (end == NULL && received < SERVER_REQUEST_LENGTH)
+    {
+        ssize_t count = read(connection, *buffer + received, 
+                             *capacity - received);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        end = memchr(*buffer + received, '\n', (size_t)count);
+        received = received + (size_t)count;
+    }
+    if (end == NULL)
+    {
+        sendReply(connection, "ERROR The request is too long.\n");
+        return false;
+    }
+    *end = '\0';
+    size_t lineLength = (size_t)(end - *buffer) + 1;
+
+    if (strcmp(*buffer, "STOP") == 0)
+    {
+        sendReply(connection, "OK\n");
+        return true;
+    }
+
+    char command[8];
+    char flags[8];
+    int argumentStart = 0;
+    if (sscanf(*buffer, "%7s %7s %n", command, flags, &argumentStart) != 2 || 
+        argumentStart == 0)
+    {
+        sendReply(connection, "ERROR The request is not understood.\n");
+        return false;
+    }
+
+    scanOptions options = *job->options;
+    options.tokensOnly = options.tokensOnly || strchr(flags, 't') != NULL;
+    options.binaryOutput = options.binaryOutput || strchr(flags, 'b') != NULL;
+    options.preserveCase = options.preserveCase || strchr(flags, 'p') != NULL;
+    options.tableDriven = options.tableDriven || strchr(flags, 'd') != NULL;
+
+    source input = {0};
+    bool loaded = false;
+    if (strcmp(command, "FILE") == 0 && strcmp(*buffer + argumentStart, "-") != 0)
+    {
+        if (openSource(*buffer + argumentStart, &input) == false)
+        {
+            snprintf(reply, sizeof(reply), "ERROR %s could not be opened.\n", 
+                     *buffer + argumentStart);
+            sendReply(connection, reply);
+            return false;
+        }
+        loaded = true;
+    }
+    else if (strcmp(command, "TEXT") == 0)
+    {
+        char *last = NULL;
+        unsigned long long length = strtoull(*buffer + argumentStart, &last, 10);
+        size_t needed = lineLength + (size_t)length + 1;
+        if (last == *buffer + argumentStart || *last != '\0' || 
+            needed <= lineLength)
+        {
+            sendReply(connection, "ERROR The request is not understood.\n");
+            return false;
+        }
+        if (length > SERVER_TEXT_LIMIT)
+        {
+            sendReply(connection, "ERROR The text is too long.\n");
+            return false;
+        }
+
+        /* Grow the buffer to hold the whole text and a final '\n' */
+        if (needed > *capacity)
+        {
+            char *grown = realloc(*buffer, needed);
+            if (grown == NULL)
+            {
+                sendReply(connection, "ERROR The text is too long.\n");
+                return false;
+            }
+            *buffer = grown;
+            *capacity = needed;
+        }
+
+        while (received < needed - 1)
+        {
+            ssize_t count = read(connection, *buffer + received, 
+                                 needed - 1 - received);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count <= 0)
+            {
+                return false;
+            }
+            received = received + (size_t)count;
+        }
+
+        input.buffer = *buffer + lineLength;
+        input.length = (size_t)length;
+        input.newlineAdded = input.length == 0 || 
+                             input.buffer[input.length - 1] != '\n';
+        if (input.newlineAdded == true)
+        {
+            input.buffer[input.length] = '\n';
+            input.length = input.length + 1;
+        }
+    }
+    else
+    {
+        sendReply(connection, "ERROR The request is not understood.\n");
+        return false;
+    }
+
+    /* The output goes to the client through a stream of its own */
+    int descriptor = dup(connection);
+    FILE *outputFile = descriptor >= 0 ? fdopen(descriptor, "wb") : NULL;
+    if (outputFile == NULL)
+    {
+        if (descriptor >= 0)
+        {
+            close(descriptor);
+        }
+        sendReply(connection, "ERROR The output could not be opened.\n");
+    }
+    else
+    {
+        bool written = sendReply(connection, "OK\n") == true && 
+                       scanSource(job->table, &input, outputFile, &options) == true;
+        written = fclose(outputFile) == 0 && written == true;
+
+        /* The client has been told OK, so the failure is reported here */
+        if (written == false)
+        {
+            printf("Error: The output of the request \"%s\" could not be sent.\n", 
+                   *buffer);
+            shutdown(connection, SHUT_RDWR);
+        }
+    }
+
+    if (loaded == true)
+    {
+        closeSource(&input);
+    }
+    return false;
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* skipBlanks function:
+* Input: a pointer to a scannerContext object
+* Output: a boolean that is false if only blanks were left in the input
+* Purpose: Moves the lexer's position over spaces and line ends to the start 
+*   of the next token. Tabs are skipped as well at the start of a line, 
+*   where they indent it, but anywhere else they are characters outside the 
+*   language. The '\n' that ends the input is never passed, so the position 
+*   stays inside it.
+-----------------------------------------------------------------------------*/
+
+bool skipBlanks(scannerContext *context)
+{
+    source *input = &context->input;
+    char *string = input->buffer;
+    size_t position = input->position;
+    bool lineStart = position == 0 || string[position - 1] == '\n';
+
+    while (true)
+    {
+        if (string[position] == ' ' || 
+            (string[position] == '\t' && lineStart == true))
+        {
+            position++;
+        }
+        else if (string[position] == '\n' && position + 1 < input->length)
+        {
+            position++;
+            lineStart = true;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    input->position = position;
+    return string[position] != '\n';
+}
+
+/*-----------------------------------------------------------------------------
+* splitDocumentLines function:
+* Input: a pointer to some text and its length, a pointer to an array of 
+*   documentLine objects and to its count, both filled in
+* Output: a boolean that is false if memory ran out
+* Purpose: Copies text into separate lines for a scannerDocument. Every line 
+*   keeps its '\n', and one is added to a final line that lacks it. Tokens 
+*   point into these copies, so they last until the line is edited.
+-----------------------------------------------------------------------------*/
+
+bool splitDocumentLines(const char *text, size_t length, documentLine **lines, 
+                        int *lineCount)
+{
+    int count = 0;
+    size_t position = 0;
+    for (position = 0; position < length; position++)
+    {
+        if (text[position] == '\n' || position == length - 1)
+        {
+            count++;
+        }
+    }
+
+    *lines = NULL;
+    *lineCount = 0;
+    if (count == 0)
+    {
+        return true;
+    }
+
+    *lines = calloc(count, sizeof(documentLine));
+    if (*lines == NULL)
+    {
+        return false;
+    }
+
+    position = 0;
+    int i = 0;
+    for (i = 0; i < count; i++)
+    {
+        const char *end = memchr(text + position, '\n', length - position);
+        size_t lineLength = end != NULL ? (size_t)(end - (text + position)) + 1 
+                                        : length - position;
+        size_t nextLine = position + lineLength;
+
+        documentLine *current = &(*lines)[i];
+        current->text = malloc(lineLength + 1);
+        if (current->text == NULL)
+        {
+            int j = 0;
+            for (j = 0; j < i; j++)
+            {
+                freeDocumentLine(&(*lines)[j]);
+            }
+            free(*lines);
+            *lines = NULL;
+            return false;
+        }
+
+        memcpy(current->text, text + position, lineLength);
+        if (end == NULL)
+        {
+            current->text[lineLength] = '\n';
+            lineLength++;
+        }
+        current->length = (int)lineLength;
+        position = nextLine;
+    }
+
+    *lineCount = count;
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+* startCrossReference function:
+* Input: a pointer to a symbol table object
+* Output: a boolean that is false if the lists of uses could not be 
+*		allocated
+* Purpose: Gives every slot of the table an empty list of uses, so that from 
+*		now on addSymbol and checkSymbol record where each identifier is 
+*		declared and used.
+-----------------------------------------------------------------------------*/
+
+bool startCrossReference(symbolTable *symTable)
+{
+	if (symTable->uses == NULL)
+	{
+		symTable->uses = calloc(symTable->capacity, sizeof(postingList));
+	}
+	return symTable->uses != NULL;
+}
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* storeCacheEntry function:
+* Input: a pointer to a character containing the cache folder, a pointer to 
+*   the cacheHeader object of the input, and a pointer to a character 
+*   containing the name of the output file just written for it
+* Output: void
+* Purpose: Copies the output into the cache after its header. The entry is 
+*   written to a file of its own first and then renamed into place, which 
+*   replaces any entry of the same name in one step, so other scans sharing 
+*   the folder never see a partly written entry. The cache is only an aid, 
+*   so an entry that cannot be stored is skipped without an error.
+-----------------------------------------------------------------------------*/
+
+void storeCacheEntry(char *cacheDirectory, cacheHeader *header, 
+                     char *outputFilename)
+{
+    static unsigned int entryCount = 0;
+    unsigned int number = __atomic_fetch_add(&entryCount, 1, __ATOMIC_RELAXED);
+
+    int size = strlen(cacheDirectory) + 64;
+    char *temporaryPath = malloc(size);
+    char *path = getCachePath(cacheDirectory, header);
+    char *block = malloc(READ_BLOCK_SIZE);
+    FILE *outputFile = fopen(outputFilename, "rb");
+    FILE *entry = NULL;
+    if (temporaryPath != NULL && path != NULL && block != NULL && 
+        outputFile != NULL)
+    {
+        snprintf(temporaryPath, size, "%s/.%ld.%u.tmp", cacheDirectory, 
+                 (long)getpid(), number);
+        entry = fopen(temporaryPath, "wb");
+    }
+
+    if (entry != NULL)
+    {
+        struct stat outputInfo;
+        bool stored = fstat(fileno(outputFile), &outputInfo) == 0;
+        header->outputLength = (uint64_t)outputInfo.st_size;
+        stored = stored && fwrite(header, sizeof(cacheHeader), 1, entry) == 1;
+
+        size_t count = 0;
+        uint64_t copied = 0;
+        while (stored == true && 
+               (count = fread(block, 1, READ_BLOCK_SIZE, outputFile)) > 0)
+        {
+            stored = fwrite(block, 1, count, entry) == count;
+            copied = copied + count;
+        }
+        stored = stored && ferror(outputFile) == 0 && 
+                 copied == header->outputLength;
+
+        if (fclose(entry) != 0 || stored == false || 
+            rename(temporaryPath, path) != 0)
+        {
+            remove(temporaryPath);
+        }
+    }
+
+    if (outputFile != NULL)
+    {
+        fclose(outputFile);
+    }
+    free(block);
+    free(path);
+    free(temporaryPath);
+}
+
+/*-----------------------------------------------------------------------------
+* trimCache function:
+* Input: a pointer to a character containing the cache folder, and the most 
+*   bytes its entries may take up
+* Output: void
+* Purpose: Removes the least recently used entries until the ones left fit 
+*   in the limit. Entries are marked as used when they are stored or read, 
+*   through their modification time. Another scan may remove an entry at 
+*   the same time, so one that has gone missing is simply passed over. 
+*   Temporary files from storeCacheEntry are named after the process 
+*   writing them; those left by a process that no longer runs are removed, 
+*   while those still being written are left alone and not counted.
+-----------------------------------------------------------------------------*/
+
+void trimCache(char *cacheDirectory, long long limit)
+{
+    DIR *directory = opendir(cacheDirectory);
+    if (directory == NULL)
+    {
+        return;
+    }
+
+    cacheEntry *entries = NULL;
+    int count = 0;
+    int capacity = 0;
+    long long total = 0;
+    size_t extensionLength = strlen(CACHE_EXTENSION);
+    struct dirent *file = NULL;
+    while ((file = readdir(directory)) != NULL)
+    {
+        size_t nameLength = strlen(file->d_name);
+        bool stored = nameLength > extensionLength && 
+                      strcmp(file->d_name + nameLength - extensionLength, 
+                             CACHE_EXTENSION) == 0;
+
+        /* A temporary file whose writer has exited will never be renamed */
+        long writer = 0;
+        bool abandoned = nameLength > 4 && 
+                         strcmp(file->d_name + nameLength - 4, ".tmp") == 0 && 
+                         sscanf(file->d_name, ".%ld.", &writer) == 1 && 
+                         kill((pid_t)writer, 0) != 0 && errno == ESRCH;
+        if (stored == false && abandoned == false)
+        {
+            continue;
+        }
+
+        if (count == capacity)
+        {
+            capacity = capacity * 2 + 64;
+            cacheEntry *grown = realloc(entries, capacity * sizeof(cacheEntry));
+            if (grown == NULL)
+            {
+                break;
+            }
+            entries = grown;
+        }
+
+        int size = strlen(cacheDirectory) + nameLength + 2;
+        char *path = malloc(size);
+        struct stat fileInfo;
+        if (path == NULL)
+        {
+            break;
+        }
+        snprintf(path, size, "%s/%s", cacheDirectory, file->d_name);
+        if (abandoned == true || stat(path, &fileInfo) != 0)
+        {
+            if (abandoned == true)
+            {
+                unlink(path);
+            }
+            free(path);
+            continue;
+        }
+
+        entries[count].path = path;
+        entries[count].size = fileInfo.st_size;
+        entries[count].used = fileInfo.st_mtime;
+        total = total + fileInfo.st_size;
+        count++;
+    }
+    closedir(directory);
+
+    if (total > limit)
+    {
+        qsort(entries, count, sizeof(cacheEntry), compareCacheEntries);
+    }
+
+    int i = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (total > limit)
+        {
+            unlink(entries[i].path);
+            total = total - entries[i].size;
+        }
+        free(entries[i].path);
+    }
+    free(entries);
+}
+#endif
+
+#ifdef SCANNER_POSIX
+/*-----------------------------------------------------------------------------
+* waitForRing function:
+* Input: a pointer to the number of times the caller has waited so far
+* Output: void
+* Purpose: Backs off while a ring buffer is full or empty. The first few 
+*   waits only spin, since the other stage is usually about to catch up, 
+*   then the thread yields, and then it sleeps briefly so that a stage held 
+*   up by slow input or output does not keep a processor busy.
+-----------------------------------------------------------------------------*/
+
+void waitForRing(int *attempts)
+{
+    *attempts = *attempts + 1;
+    if (*attempts < 64)
+    {
+        return;
+    }
+    else if (*attempts < 128)
+    {
+        sched_yield();
+    }
+    else
+    {
+        struct timespec pause = {0, 50000};
+        nanosleep(&pause, NULL);
+    }
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* writeIndex function:
+* Input: a pointer to a symbol table object that keeps a cross-reference 
+*   index, and a pointer to the open index file
+* Output: a boolean that is false if no index is kept or it could not be 
+*   written
+* Purpose: Writes the cross-reference index laid out as described by 
+*   scannerIndexHeader in scanner.h. The identifiers are sorted by name so 
+*   readers can find one with a binary search, and each one gives the 
+*   offset of its list of uses; the lists follow in the order of the 
+*   table's slots, exactly as they were packed while scanning.
+-----------------------------------------------------------------------------*/
+
+bool writeIndex(symbolTable *symTable, FILE *indexFile)
+{
+    if (symTable->uses == NULL)
+    {
+        return false;
+    }
+
+    scannerIndexSymbol *symbols = calloc(symTable->count + 1, 
+                                         sizeof(scannerIndexSymbol));
+    if (symbols == NULL)
+    {
+        return false;
+    }
+
+    scannerIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCANNER_INDEX_MAGIC, 4);
+    header.version = SCANNER_INDEX_VERSION;
+
+    int count = 0;
+    int slot = 0;
+    for (slot = 0; slot < symTable->capacity; slot++)
+    {
+        if (symTable->token[slot].ID != 0)
+        {
+            int nameLength = symTable->token[slot].length;
+            if (nameLength > SCANNER_STREAM_NAME_LENGTH)
+            {
+                nameLength = SCANNER_STREAM_NAME_LENGTH;
+            }
+            memcpy(symbols[count].name, symTable->token[slot].string, nameLength);
+            foldCase(symbols[count].name, nameLength);
+            symbols[count].useCount = (uint32_t)symTable->uses[slot].count;
+            symbols[count].postingOffset = header.postingLength;
+            symbols[count].postingLength = symTable->uses[slot].length;
+            header.useCount = header.useCount + symTable->uses[slot].count;
+            header.postingLength = header.postingLength + 
+                                   symTable->uses[slot].length;
+            count++;
+        }
+    }
+    qsort(symbols, count, sizeof(scannerIndexSymbol), compareIndexSymbols);
+
+    header.symbolCount = count;
+    header.symbolSection = (sizeof(header) + 7) & ~(uint64_t)7;
+    header.postingSection = header.symbolSection + 
+                            count * sizeof(scannerIndexSymbol);
+
+    outputBuffer output;
+    if (openOutput(&output, indexFile) == false)
+    {
+        free(symbols);
+        return false;
+    }
+
+    static const char padding[8] = {0};
+    appendBytes(&output, (char *)&header, sizeof(header));
+    appendBytes(&output, padding, header.symbolSection - sizeof(header));
+    appendBytes(&output, (char *)symbols, count * sizeof(scannerIndexSymbol));
+    for (slot = 0; slot < symTable->capacity; slot++)
+    {
+        if (symTable->token[slot].ID != 0 && symTable->uses[slot].length > 0)
+        {
+            appendBytes(&output, (char *)symTable->uses[slot].data, 
+                        symTable->uses[slot].length);
+        }
+    }
+
+    free(symbols);
+    return closeOutput(&output);
+}
+
+#ifdef SCANNER_STATS
+/*-----------------------------------------------------------------------------
+* writeStats function:
+* Input: a pointer to a character containing the file name, a pointer to 
+*   the total statistics, a pointer to the tokenTable object, and the timer 
+*   and clock readings taken before the first scan
+* Output: a boolean that is false if the file could not be written
+* Purpose: Writes the statistics as one JSON object: the number of files, 
+*   lines and bytes read and written, the seconds spent in each phase, the 
+*   number of tokens of each ID (named from the token table), the number 
+*   of errors of each kind, and the symbol tables' load factor and probe 
+*   length histogram. Timer ticks are turned into seconds using the clock 
+*   time that passed since the first scan began. The last histogram entry 
+*   counts every probe sequence of that length or longer.
+-----------------------------------------------------------------------------*/
+
+bool writeStats(char *statsFilename, scanStats *stats, tokenTable *table, 
+                uint64_t startTicks, double startSeconds)
+{
+	FILE *statsFile = fopen(statsFilename, "w");
+	if (statsFile == NULL)
+	{
+		return false;
+	}
+
+	double seconds = readClock() - startSeconds;
+	uint64_t ticks = readTimer() - startTicks;
+	double ticksPerSecond = seconds > 0 && ticks > 0 ? ticks / seconds : 1e9;
+
+	fprintf(statsFile, "{\n  \"files\": %llu,\n  \"seconds\": %.6f,\n"
+	        "  \"lines\": %llu,\n  \"bytesIn\": %llu,\n  \"bytesOut\": %llu,\n"
+	        "  \"cacheHits\": %llu,\n  \"cacheMisses\": %llu,\n",
+	        (unsigned long long)stats->fileCount, seconds, 
+	        (unsigned long long)stats->lineCount, 
+	        (unsigned long long)stats->bytesIn, 
+	        (unsigned long long)stats->bytesOut, 
+	        (unsigned long long)stats->cacheHits, 
+	        (unsigned long long)stats->cacheMisses);
+
+	const char *phaseNames[PHASE_COUNT] = { "idle", "read", "lex", "assignID", 
+	                                        "symbols", "output" };
+	fprintf(statsFile, "  \"phaseSeconds\": {");
+	int i = 0;
+	for (i = PHASE_READ; i < PHASE_COUNT; i++)
+	{
+		fprintf(statsFile, "%s\n    \"%s\": %.6f", i > PHASE_READ ? "," : "", 
+		        phaseNames[i], stats->phaseTicks[i] / ticksPerSecond);
+	}
+
+	uint64_t tokenTotal = 0;
+	for (i = 1; i < STATS_TOKEN_IDS; i++)
+	{
+		tokenTotal = tokenTotal + stats->tokenCount[i];
+	}
+	fprintf(statsFile, "\n  },\n  \"tokens\": {\n    \"total\": %llu,\n"
+	        "    \"byId\": {", (unsigned long long)tokenTotal);
+
+	bool first = true;
+	for (i = 1; i < STATS_TOKEN_IDS; i++)
+	{
+		if (stats->tokenCount[i] == 0)
+		{
+			continue;
+		}
+
+		fprintf(statsFile, "%s\n      \"%d\": { \"token\": \"", 
+		        first ? "" : ",", i);
+		int j = 0;
+		for (j = 0; j < TOKEN_TABLE_LENGTH; j++)
+		{
+			if (table->token[j].ID != i)
+			{
+				continue;
+			}
+
+			int k = 0;
+			for (k = 0; k < table->token[j].length; k++)
+			{
+				if (table->token[j].string[k] == '"' || 
+				    table->token[j].string[k] == '\\')
+				{
+					fputc('\\', statsFile);
+				}
+				fputc(table->token[j].string[k], statsFile);
+			}
+			break;
+		}
+		fprintf(statsFile, "\", \"count\": %llu }", 
+		        (unsigned long long)stats->tokenCount[i]);
+		first = false;
+	}
+
+	const char *errorNames[STATS_ERROR_KINDS] = { "other", "invalidCharacter", 
+	                                              "tokenTooLong", "declaredTwice", 
+	                                              "tooManyIdentifiers", "notDeclared", 
+	                                              "integerTooLarge" };
+	fprintf(statsFile, "\n    }\n  },\n  \"errors\": {");
+	for (i = SCANNER_ERROR_CHARACTER; i < STATS_ERROR_KINDS; i++)
+	{
+		fprintf(statsFile, "%s\n    \"%s\": %llu", 
+		        i > SCANNER_ERROR_CHARACTER ? "," : "", errorNames[i], 
+		        (unsigned long long)stats->errorCount[i]);
+	}
+
+	fprintf(statsFile, "\n  },\n  \"symbolTable\": {\n    \"identifiers\": %llu,\n"
+	        "    \"slots\": %llu,\n    \"loadFactor\": %.4f,\n"
+	        "    \"probeLengths\": {", 
+	        (unsigned long long)stats->symbolCount, 
+	        (unsigned long long)stats->symbolCapacity,
+	        stats->symbolCapacity > 0 
+	        ? (double)stats->symbolCount / stats->symbolCapacity : 0.0);
+	for (i = 0; i < PROBE_HISTOGRAM_LENGTH; i++)
+	{
+		fprintf(statsFile, "%s\n      \"%d%s\": %llu", i > 0 ? "," : "", i + 1, 
+		        i == PROBE_HISTOGRAM_LENGTH - 1 ? "+" : "", 
+		        (unsigned long long)stats->probeCount[i]);
+	}
+	fprintf(statsFile, "\n    }\n  }\n}\n");
+
+	return fclose(statsFile) == 0;
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+* writeTokenStream function:
+* Input: a pointer to a tokenTable object, a pointer to a source object, a 
+*   pointer to an output file, and a pointer to the scan options
+* Output: a boolean that is false if the stream could not be built or written
+* Purpose: Scans the input like scanSource, with the same symbol checks, but 
+*   writes a binary token stream (laid out as described by 
+*   scannerStreamHeader in scanner.h) instead of a listing. Tokens are 
+*   gathered one record at a time and then written out one field at a time, 
+*   so each section holds a single array. Tokens without a valid ID are 
+*   left out, as in the listing, and only the used slots of the symbol 
+*   table are written. Offsets and lengths refer to the input as read, so 
+*   the original spelling of each token can be found in the source file. 
+*   Integers are interned in the context's literal pool as they are 
+*   gathered, and the pool is written after the symbol table.
+-----------------------------------------------------------------------------*/
+
+bool writeTokenStream(tokenTable *table, source *input, FILE *outputFile, 
+                      scanOptions *options)
+{
+    scannerContext context;
+    initContext(&context, table, input, options->tableDriven);
+    if (options->indexFile != NULL)
+    {
+        startCrossReference(&context.symTable);
+    }
+#ifdef SCANNER_STATS
+    scanStats stats;
+    attachStats(&context, options->stats != NULL ? &stats : NULL);
+#endif
+
+    streamToken *tokens = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    bool success = true;
+
+    while (!endOfSource(&context) && success == true)
+    {
+        token currentToken = getToken(&context);
+#ifdef SCANNER_STATS
+        enterPhase(context.stats, PHASE_SYMBOL);
+#endif
+        checkSymbol(&context, &currentToken);
+        if (currentToken.ID == 0)
+        {
+            continue;
+        }
+        locateToken(&context, &currentToken);
+
+#ifdef SCANNER_STATS
+        enterPhase(context.stats, PHASE_OUTPUT);
+#endif
+        if (count == capacity)
+        {
+            capacity = capacity * 2 + 1024;
+            streamToken *grown = realloc(tokens, capacity * sizeof(streamToken));
+            if (grown == NULL)
+            {
+                success = false;
+                break;
+            }
+            tokens = grown;
+        }
+
+        tokens[count].offset = currentToken.offset;
+        tokens[count].lineNumber = (uint32_t)currentToken.lineNumber;
+        tokens[count].literal = UINT32_MAX;
+        tokens[count].kind = (uint16_t)currentToken.ID;
+        tokens[count].length = (uint8_t)currentToken.length;
+        if (currentToken.ID == table->intID)
+        {
+            int literal = internLiteral(&context.literals, currentToken.value);
+            if (literal < 0)
+            {
+                success = false;
+                break;
+            }
+            tokens[count].literal = (uint32_t)literal;
+        }
+        count++;
+    }
+
+    /* Lay the sections out one after another on 8-byte boundaries */
+    symbolTable *symTable = &context.symTable;
+    scannerStreamHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCANNER_STREAM_MAGIC, 4);
+    header.version = SCANNER_STREAM_VERSION;
+    header.sourceLength = input->length;
+    header.tokenCount = count;
+    header.symbolCount = symTable->count;
+    header.kindSection = (sizeof(header) + 7) & ~(uint64_t)7;
+    header.offsetSection = (header.kindSection + count * sizeof(uint16_t) + 7) & ~(uint64_t)7;
+    header.lengthSection = header.offsetSection + count * sizeof(uint64_t);
+    header.lineSection = (header.lengthSection + count * sizeof(uint8_t) + 7) & ~(uint64_t)7;
+    header.symbolSection = (header.lineSection + count * sizeof(uint32_t) + 7) & ~(uint64_t)7;
+    header.literalCount = context.literals.count;
+    header.literalSection = (header.symbolSection + 
+                             symTable->count * sizeof(scannerStreamSymbol) + 7) & ~(uint64_t)7;
+    header.poolSection = (header.literalSection + count * sizeof(uint32_t) + 7) & ~(uint64_t)7;
+
+    outputBuffer output;
+    if (success == true && openOutput(&output, outputFile) == true)
+    {
+        static const char padding[8] = {0};
+        size_t i = 0;
+
+        appendBytes(&output, (char *)&header, sizeof(header));
+        appendBytes(&output, padding, header.kindSection - sizeof(header));
+        for (i = 0; i < count; i++)
+        {
+            appendBytes(&output, (char *)&tokens[i].kind, sizeof(uint16_t));
+        }
+        appendBytes(&output, padding, header.offsetSection - 
+                    (header.kindSection + count * sizeof(uint16_t)));
+        for (i = 0; i < count; i++)
+        {
+            appendBytes(&output, (char *)&tokens[i].offset, sizeof(uint64_t));
+        }
+        for (i = 0; i < count; i++)
+        {
+            appendBytes(&output, (char *)&tokens[i].length, sizeof(uint8_t));
+        }
+        appendBytes(&output, padding, header.lineSection - 
+                    (header.lengthSection + count * sizeof(uint8_t)));
+        for (i = 0; i < count; i++)
+        {
+            appendBytes(&output, (char *)&tokens[i].lineNumber, sizeof(uint32_t));
+        }
+        appendBytes(&output, padding, header.symbolSection - 
+                    (header.lineSection + count * sizeof(uint32_t)));
+
+        int slot = 0;
+        for (slot = 0; slot < symTable->capacity; slot++)
+        {
+            if (symTable->token[slot].ID != 0)
+            {
+                scannerStreamSymbol symbol;
+                memset(&symbol, 0, sizeof(symbol));
+                symbol.slot = (uint32_t)slot;
+                int nameLength = symTable->token[slot].length;
+                if (nameLength > SCANNER_STREAM_NAME_LENGTH)
+                {
+                    nameLength = SCANNER_STREAM_NAME_LENGTH;
+                }
+                memcpy(symbol.name, symTable->token[slot].string, nameLength);
+                foldCase(symbol.name, nameLength);
+                appendBytes(&output, (char *)&symbol, sizeof(symbol));
+            }
+        }
+
+        appendBytes(&output, padding, header.literalSection - 
+                    (header.symbolSection + 
+                     symTable->count * sizeof(scannerStreamSymbol)));
+        for (i = 0; i < count; i++)
+        {
+            appendBytes(&output, (char *)&tokens[i].literal, sizeof(uint32_t));
+        }
+        appendBytes(&output, padding, header.poolSection - 
+                    (header.literalSection + count * sizeof(uint32_t)));
+        int literal = 0;
+        for (literal = 0; literal < context.literals.count; literal++)
+        {
+            int32_t value = context.literals.value[literal];
+            appendBytes(&output, (char *)&value, sizeof(int32_t));
+        }
+
+        success = closeOutput(&output);
+    }
+    else
+    {
+        success = false;
+    }
+    if (success == true && options->indexFile != NULL)
+    {
+        success = writeIndex(symTable, options->indexFile);
+    }
+
+#ifdef SCANNER_STATS
+    if (context.stats != NULL)
+    {
+        stats.fileCount = 1;
+        stats.bytesIn = input->length - (input->newlineAdded ? 1 : 0);
+        stats.bytesOut = success == true ? output.written : 0;
+        collectStats(options->stats, &context);
+    }
+#endif
+    free(tokens);
+    freeLineIndex(&context.lines);
+    freeSymbolTable(symTable);
+    freeLiteralPool(&context.literals);
+    return success;
 }
@@ -0,0 +1,250 @@
+/*-----------------------------------------------------------------------------
+* Library interface to the Simplified Pascal scanner.
+*
+* A scanner context holds everything needed to scan one input: its own copy
+* of the text, the current line, and the symbol table. Contexts share
+* nothing but a token table, which is only read once loaded, so any number
+* of them can be scanned at once from different threads. Tokens are pulled
+* one at a time with scanner_next_token, which does no I/O of its own.
+* Errors are passed to a diagnostic handler and each line of the input can
+* be passed to a line handler as it is reached; both are optional. The
+* token table compiled into the scanner is given by
+* scanner_builtin_token_table without reading anything, and other tables
+* are read and checked by scanner_load_token_table.
+*
+* A scannerDocument keeps the tokens and errors of every line of a text
+* that is being edited. After an edit only the changed lines are lexed
+* again, carrying on past them only until the comment state at the start of
+* a line matches the previous scan, and the symbol checks are re-run only
+* until the symbol table state matches, so an editor can rescan cheaply on
+* every change.
+*
+* Token streams written by the program with "--binary" are read back with
+* scanner_open_token_stream, which maps the file and points straight into
+* it, so the tokens can be walked without copying or parsing anything.
+*
+* A context can also keep a cross-reference index of where each identifier
+* in its symbol table is declared and used, queried with scanner_uses or
+* saved with scanner_write_index. The program writes the same index next to
+* each output with "--index", and scanner_open_index maps it back so uses
+* can be looked up without scanning the input again.
+*
+* Building scanner.c with SCANNER_LIBRARY defined leaves out the program's
+* main function so it can be linked into other programs.
+-----------------------------------------------------------------------------*/
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Kinds of diagnostic passed to a scannerDiagnosticHandler */
+#define SCANNER_ERROR_CHARACTER 1
+#define SCANNER_ERROR_TOKEN_LENGTH 2
+#define SCANNER_ERROR_DECLARED_TWICE 3
+#define SCANNER_ERROR_TOO_MANY_IDENTIFIERS 4
+#define SCANNER_ERROR_NOT_DECLARED 5
+#define SCANNER_ERROR_INTEGER_RANGE 6
+#define SCANNER_MESSAGE_LENGTH 128
+
+/* The largest value of an integer literal */
+#define SCANNER_MAX_INTEGER 2147483647
+
+/* Binary token streams start with this magic string and version */
+#define SCANNER_STREAM_MAGIC "PTOK"
+#define SCANNER_STREAM_VERSION 2
+#define SCANNER_STREAM_NAME_LENGTH 12
+
+/* Cross-reference indexes start with this magic string and version */
+#define SCANNER_INDEX_MAGIC "PXRF"
+#define SCANNER_INDEX_VERSION 1
+
+typedef struct tokenTable tokenTable;
+typedef struct scannerContext scannerContext;
+typedef struct scannerDocument scannerDocument;
+
+/*
+* One token. The text points into the context's (or document's) copy of
+* the input, with its letters in the case they were written, and stays
+* valid until the context is destroyed or the document is next edited.
+* Keywords and identifiers are matched without regard to case. Lines and
+* columns count from 1; the offset counts from 0. An integer's value is
+* converted while it is lexed (a literal above SCANNER_MAX_INTEGER is
+* reported and given that value), and literal is its number in the
+* context's literal pool (see scanner_literals), or -1 for other tokens
+* and for the tokens of a document.
+*/
+typedef struct
+{
+    int kind;
+    const char *text;
+    int length;
+    int lineNumber;
+    int column;
+    size_t offset;
+    int value;
+    int literal;
+} scannerToken;
+
+/* An error kept by a scannerDocument */
+typedef struct
+{
+    int kind;
+    int lineNumber;
+    int column;
+    char message[SCANNER_MESSAGE_LENGTH];
+} scannerDiagnostic;
+
+/*
+* Layout of a binary token stream, in the byte order of the machine that
+* wrote it. The header is followed by sections holding one array each,
+* every section starting on an 8-byte boundary at the offset given in the
+* header: the token kinds, their byte offsets into the source, their
+* lengths, their line numbers, the identifiers in the symbol table, each
+* token's number in the literal pool (UINT32_MAX if it is not an integer),
+* and the pool itself: the value of each different integer literal, in the
+* order they first appear.
+*/
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceLength;
+    uint64_t tokenCount;
+    uint64_t symbolCount;
+    uint64_t kindSection;
+    uint64_t offsetSection;
+    uint64_t lengthSection;
+    uint64_t lineSection;
+    uint64_t symbolSection;
+    uint64_t literalCount;
+    uint64_t literalSection;
+    uint64_t poolSection;
+} scannerStreamHeader;
+
+/*
+* An identifier and its slot in the symbol table; the name is in uppercase
+* and NUL padded
+*/
+typedef struct
+{
+    uint32_t slot;
+    char name[SCANNER_STREAM_NAME_LENGTH];
+} scannerStreamSymbol;
+
+/* A token stream opened for reading; every array points into the file */
+typedef struct
+{
+    const scannerStreamHeader *header;
+    const uint16_t *kind;
+    const uint64_t *offset;
+    const uint8_t *length;
+    const uint32_t *lineNumber;
+    const scannerStreamSymbol *symbol;
+    const uint32_t *literal;
+    const int32_t *pool;
+    size_t tokenCount;
+    size_t symbolCount;
+    size_t literalCount;
+    void *mapping;
+    size_t mappingLength;
+} scannerTokenStream;
+
+/* A place where an identifier is declared or used */
+typedef struct
+{
+    int lineNumber;
+    int column;
+} scannerUseSite;
+
+/*
+* Layout of a cross-reference index, in the byte order of the machine that
+* wrote it. The header is followed by the identifiers in the symbol table,
+* sorted by name, and then by their lists of use sites. A list holds the
+* sites in the order they were scanned, each as two unsigned LEB128
+* numbers: the lines since the previous site, then the column, counted
+* from the previous site's column when both are on the same line.
+*/
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t symbolCount;
+    uint64_t useCount;
+    uint64_t symbolSection;
+    uint64_t postingSection;
+    uint64_t postingLength;
+} scannerIndexHeader;
+
+/*
+* An identifier of a cross-reference index; the name is in uppercase and
+* NUL padded, and its list of use sites starts postingOffset bytes into
+* the posting section
+*/
+typedef struct
+{
+    char name[SCANNER_STREAM_NAME_LENGTH];
+    uint32_t useCount;
+    uint64_t postingOffset;
+    uint64_t postingLength;
+} scannerIndexSymbol;
+
+/* A cross-reference index opened for reading; it points into the file */
+typedef struct
+{
+    const scannerIndexHeader *header;
+    const scannerIndexSymbol *symbol;
+    const uint8_t *postings;
+    size_t symbolCount;
+    void *mapping;
+    size_t mappingLength;
+} scannerIndex;
+
+typedef void (*scannerDiagnosticHandler)(void *userData, int kind,
+                                         int lineNumber, int column,
+                                         const char *message);
+typedef void (*scannerLineHandler)(void *userData, int lineNumber,
+                                   const char *string, int length);
+
+tokenTable *scanner_load_token_table(const char *tokenTableFilename);
+tokenTable *scanner_builtin_token_table(void);
+void scanner_free_token_table(tokenTable *table);
+
+scannerContext *scanner_create(tokenTable *table, const char *text, size_t length);
+scannerContext *scanner_create_from_file(tokenTable *table, const char *inputFilename);
+void scanner_set_diagnostic_handler(scannerContext *context,
+                                    scannerDiagnosticHandler handler,
+                                    void *userData);
+void scanner_set_line_handler(scannerContext *context,
+                              scannerLineHandler handler, void *userData);
+void scanner_set_table_driven(scannerContext *context, bool tableDriven);
+bool scanner_set_cross_reference(scannerContext *context, bool enabled);
+bool scanner_next_token(scannerContext *context, scannerToken *result);
+const int *scanner_literals(scannerContext *context, int *count);
+int scanner_uses(scannerContext *context, const char *name, int length,
+                 scannerUseSite *sites, int capacity);
+bool scanner_write_index(scannerContext *context, const char *indexFilename);
+void scanner_destroy(scannerContext *context);
+
+scannerDocument *scanner_document_create(tokenTable *table, const char *text, size_t length);
+int scanner_document_edit(scannerDocument *document, int firstLine, int lineCount,
+                          const char *text, size_t length);
+int scanner_document_line_count(scannerDocument *document);
+int scanner_document_token_count(scannerDocument *document, int lineNumber);
+bool scanner_document_token(scannerDocument *document, int lineNumber, int index,
+                            scannerToken *result);
+int scanner_document_diagnostic_count(scannerDocument *document, int lineNumber);
+bool scanner_document_diagnostic(scannerDocument *document, int lineNumber, int index,
+                                 scannerDiagnostic *result);
+void scanner_document_destroy(scannerDocument *document);
+
+bool scanner_open_token_stream(const char *streamFilename, scannerTokenStream *stream);
+void scanner_close_token_stream(scannerTokenStream *stream);
+
+bool scanner_open_index(const char *indexFilename, scannerIndex *index);
+int scanner_index_uses(scannerIndex *index, const char *name, int length,
+                       scannerUseSite *sites, int capacity);
+void scanner_close_index(scannerIndex *index);
+
+#endif
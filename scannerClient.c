@@ -0,0 +1,462 @@
+/*-----------------------------------------------------------------------------
+* Sends scan requests to a scanner started with "--serve socketPath", in
+* place of running the scanner itself for each file.
+*
+* The server loads the token table once and stays running, so a client only
+* pays for a connection to it rather than for starting a process and loading
+* the table. Each input file named on the command line is sent as one
+* request on a connection of its own, and the output that comes back is
+* written to the output directory under the same name the scanner's batch
+* mode would give it. Files are sent by their full path and read by the
+* server; with "--inline", or for "-" (standard input), the text itself is
+* sent instead, for servers that cannot see the client's files.
+*
+* The protocol is described with serveRequest in scanner.c.
+-----------------------------------------------------------------------------*/
+/* Declares realpath and the socket calls under -std=c11 */
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define DEFAULT_SOCKET "scanner.sock"
+#define READ_BLOCK_SIZE 65536
+#define STATUS_LENGTH 8192
+
+int connectServer(char *socketPath);
+char *getOutputFilename(char *outputDirectory, char *inputFilename, char *extension);
+char *readInput(char *inputFilename, size_t *length);
+bool requestScan(char *socketPath, char *flags, char *inputFilename, bool sendText, char *outputFilename);
+bool sendAll(int connection, const char *bytes, size_t length);
+
+/*-----------------------------------------------------------------------------
+* The main program reads the options and sends a request for each input
+* file, or a request to stop the server with "--stop". The flags of each
+* request are built from the same output options the scanner takes.
+-----------------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+{
+    char *socketPath = DEFAULT_SOCKET;
+    char *outputDirectory = ".";
+    char flags[8] = "";
+    int flagCount = 0;
+    bool sendText = false;
+    bool stop = false;
+    char **inputFilenames = malloc(argc * sizeof(char *));
+    int fileCount = 0;
+
+    int arg = 1;
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "--tokens-only") == 0)
+        {
+            flags[flagCount++] = 't';
+        }
+        else if (strcmp(argv[arg], "--binary") == 0)
+        {
+            flags[flagCount++] = 'b';
+        }
+        else if (strcmp(argv[arg], "--preserve-case") == 0)
+        {
+            flags[flagCount++] = 'p';
+        }
+        else if (strcmp(argv[arg], "--table-driven") == 0)
+        {
+            flags[flagCount++] = 'd';
+        }
+        else if (strcmp(argv[arg], "--inline") == 0)
+        {
+            sendText = true;
+        }
+        else if (strcmp(argv[arg], "--stop") == 0)
+        {
+            stop = true;
+        }
+        else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            socketPath = argv[arg];
+        }
+        else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            outputDirectory = argv[arg];
+        }
+        else if (argv[arg][0] != '-' || strcmp(argv[arg], "-") == 0)
+        {
+            inputFilenames[fileCount] = argv[arg];
+            fileCount++;
+        }
+        else
+        {
+            fileCount = 0;
+            stop = false;
+            break;
+        }
+
+        /* There are only four flags, so more means one was repeated */
+        if (flagCount > 4)
+        {
+            fileCount = 0;
+            stop = false;
+            break;
+        }
+    }
+
+    if (stop == true)
+    {
+        int connection = connectServer(socketPath);
+        char status[4] = "";
+        bool stopped = connection >= 0 && sendAll(connection, "STOP\n", 5) &&
+                       read(connection, status, 3) == 3 &&
+                       memcmp(status, "OK\n", 3) == 0;
+        if (connection >= 0)
+        {
+            close(connection);
+        }
+        if (stopped == false)
+        {
+            printf("Error: No server could be stopped at %s.\n", socketPath);
+            exit(1);
+        }
+        free(inputFilenames);
+        return 0;
+    }
+
+    if (fileCount == 0)
+    {
+        printf("Usage: %s [-s socketPath] [--tokens-only] [--binary] "
+               "[--preserve-case] [--table-driven] [--inline] "
+               "[-o outputDirectory] inputFile ...\n"
+               "       %s [-s socketPath] --stop\n", argv[0], argv[0]);
+        exit(1);
+    }
+    if (flagCount == 0)
+    {
+        flags[flagCount++] = '-';
+    }
+
+    /* A server that refuses a request may hang up before it is all sent */
+    signal(SIGPIPE, SIG_IGN);
+
+    int failures = 0;
+    int i = 0;
+    for (i = 0; i < fileCount; i++)
+    {
+        char *outputFilename = getOutputFilename(outputDirectory,
+                                                 inputFilenames[i],
+                                                 strchr(flags, 'b') != NULL
+                                                 ? "tok" : "out");
+        if (outputFilename == NULL ||
+            requestScan(socketPath, flags, inputFilenames[i], sendText,
+                        outputFilename) == false)
+        {
+            failures++;
+        }
+        free(outputFilename);
+    }
+
+    printf("Results for %d of %d files stored in %s\n",
+           fileCount - failures, fileCount, outputDirectory);
+    free(inputFilenames);
+    return failures == 0 ? 0 : 1;
+}
+
+/*-----------------------------------------------------------------------------
+* connectServer function:
+* Input: a pointer to a character containing the path of the server's socket
+* Output: a connected socket, or -1 if no server is taking connections there
+* Purpose: Opens a connection to the scan server for one request.
+-----------------------------------------------------------------------------*/
+
+int connectServer(char *socketPath)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection >= 0 &&
+        connect(connection, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(connection);
+        connection = -1;
+    }
+    return connection;
+}
+
+/*-----------------------------------------------------------------------------
+* getOutputFilename function:
+* Input: pointers to characters containing the output directory, the input
+*   file name, and the extension for the output file
+* Output: a pointer to a new string holding the output file name, or NULL if
+*   it could not be allocated
+* Purpose: Names the output for an input the way the scanner's batch mode
+*   does: the folder and extension of the input are replaced, so
+*   "tests/allTokens.txt" becomes "outputDirectory/allTokens.out", and
+*   standard input ("-") becomes "stdin.out".
+-----------------------------------------------------------------------------*/
+
+char *getOutputFilename(char *outputDirectory, char *inputFilename,
+                        char *extension)
+{
+    char *name = inputFilename;
+    if (strcmp(inputFilename, "-") == 0)
+    {
+        name = "stdin";
+    }
+
+    /* Drop the folder */
+    char *separator = strrchr(name, '/');
+    if (separator != NULL)
+    {
+        name = separator + 1;
+    }
+
+    /* Drop the extension */
+    int nameLength = strlen(name);
+    char *dot = strrchr(name, '.');
+    if (dot != NULL && dot != name)
+    {
+        nameLength = dot - name;
+    }
+
+    int size = strlen(outputDirectory) + nameLength + strlen(extension) + 3;
+    char *outputFilename = malloc(size);
+    if (outputFilename != NULL)
+    {
+        snprintf(outputFilename, size, "%s/%.*s.%s",
+                 outputDirectory, nameLength, name, extension);
+    }
+
+    return outputFilename;
+}
+
+/*-----------------------------------------------------------------------------
+* readInput function:
+* Input: a pointer to a character containing the input file name ("-" for
+*   standard input), a pointer to the length to fill in
+* Output: a pointer to a new buffer holding the whole input, or NULL if it
+*   could not be read
+* Purpose: Loads an input whose text is to be sent to the server.
+-----------------------------------------------------------------------------*/
+
+char *readInput(char *inputFilename, size_t *length)
+{
+    FILE *inputFile = strcmp(inputFilename, "-") == 0
+                    ? stdin : fopen(inputFilename, "rb");
+    if (inputFile == NULL)
+    {
+        return NULL;
+    }
+
+    size_t capacity = READ_BLOCK_SIZE;
+    char *text = malloc(capacity);
+    *length = 0;
+    while (text != NULL)
+    {
+        if (capacity - *length < READ_BLOCK_SIZE)
+        {
+            capacity = capacity * 2;
+            char *grown = realloc(text, capacity);
+            if (grown == NULL)
+            {
+                free(text);
+                text = NULL;
+                break;
+            }
+            text = grown;
+        }
+
+        size_t count = fread(text + *length, 1, READ_BLOCK_SIZE, inputFile);
+        *length = *length + count;
+        if (count < READ_BLOCK_SIZE)
+        {
+            if (ferror(inputFile))
+            {
+                free(text);
+                text = NULL;
+            }
+            break;
+        }
+    }
+
+    if (inputFile != stdin)
+    {
+        fclose(inputFile);
+    }
+    return text;
+}
+
+/*-----------------------------------------------------------------------------
+* requestScan function:
+* Input: pointers to characters containing the server's socket, the flags
+*   of the request and the input file name, whether to send the text of the
+*   input rather than its path, and the output file name
+* Output: a boolean that is false if the input could not be scanned or the
+*   output could not be written
+* Purpose: Sends one scan request and writes the output that comes back to
+*   the output file. The output file is only created once the server has
+*   answered "OK", so a failed request leaves nothing behind; the server's
+*   message is printed instead.
+-----------------------------------------------------------------------------*/
+
+bool requestScan(char *socketPath, char *flags, char *inputFilename,
+                 bool sendText, char *outputFilename)
+{
+    char request[PATH_MAX + 64];
+    char *text = NULL;
+    size_t length = 0;
+    if (sendText == true || strcmp(inputFilename, "-") == 0)
+    {
+        text = readInput(inputFilename, &length);
+        if (text == NULL)
+        {
+            printf("Error: %s could not be opened.\n", inputFilename);
+            return false;
+        }
+        snprintf(request, sizeof(request), "TEXT %s %zu\n", flags, length);
+    }
+    else
+    {
+        /* The server may be running in another folder */
+        char path[PATH_MAX];
+        if (realpath(inputFilename, path) == NULL)
+        {
+            printf("Error: %s could not be opened.\n", inputFilename);
+            return false;
+        }
+        snprintf(request, sizeof(request), "FILE %s %s\n", flags, path);
+    }
+
+    int connection = connectServer(socketPath);
+    if (connection < 0)
+    {
+        printf("Error: No server is running at %s.\n", socketPath);
+        free(text);
+        return false;
+    }
+    sendAll(connection, request, strlen(request));
+    sendAll(connection, text, length);
+    free(text);
+
+    /* Read the status line, which says why if the request was refused */
+    char status[STATUS_LENGTH];
+    size_t received = 0;
+    char *end = NULL;
+    while (end == NULL && received < STATUS_LENGTH - 1)
+    {
+        ssize_t count = read(connection, status + received,
+                             STATUS_LENGTH - 1 - received);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            break;
+        }
+        end = memchr(status + received, '\n', (size_t)count);
+        received = received + (size_t)count;
+    }
+    if (end == NULL)
+    {
+        printf("Error: %s could not be scanned.\n", inputFilename);
+        close(connection);
+        return false;
+    }
+    *end = '\0';
+    if (strcmp(status, "OK") != 0)
+    {
+        if (strncmp(status, "ERROR ", 6) == 0)
+        {
+            printf("Error: %s\n", status + 6);
+        }
+        else
+        {
+            printf("Error: %s could not be scanned.\n", inputFilename);
+        }
+        close(connection);
+        return false;
+    }
+
+    FILE *outputFile = fopen(outputFilename, strchr(flags, 'b') != NULL
+                                             ? "wb" : "w");
+    if (outputFile == NULL)
+    {
+        printf("Error: %s could not be opened.\n", outputFilename);
+        close(connection);
+        return false;
+    }
+
+    /* Copy whatever followed the status line, then the rest */
+    size_t start = (size_t)(end - status) + 1;
+    bool written = fwrite(status + start, 1, received - start, outputFile) ==
+                   received - start;
+    char block[READ_BLOCK_SIZE];
+    while (written == true)
+    {
+        ssize_t count = read(connection, block, sizeof(block));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            written = count == 0;
+            break;
+        }
+        written = fwrite(block, 1, (size_t)count, outputFile) == (size_t)count;
+    }
+    close(connection);
+
+    if (fclose(outputFile) != 0 || written == false)
+    {
+        printf("Error: %s could not be written.\n", outputFilename);
+        return false;
+    }
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+* sendAll function:
+* Input: a connected socket, a pointer to some bytes, and the number of bytes
+* Output: a boolean that is false if the bytes could not all be sent
+* Purpose: Writes the bytes to the socket, repeating the write until all of
+*   them have gone.
+-----------------------------------------------------------------------------*/
+
+bool sendAll(int connection, const char *bytes, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(connection, bytes, length);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        bytes = bytes + written;
+        length = length - (size_t)written;
+    }
+    return true;
+}
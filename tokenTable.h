@@ -0,0 +1,98 @@
+/*-----------------------------------------------------------------------------
+* Token table compiled into the scanner. Generated from tokenTable.txt by
+* generateTokenTable; run it again instead of editing this file.
+-----------------------------------------------------------------------------*/
+#ifndef TOKEN_TABLE_H
+#define TOKEN_TABLE_H
+
+#if TOKEN_TABLE_LENGTH != 23 || KEYWORD_HASH_SIZE != 64 || CLASS_COUNT != 11
+#error "tokenTable.h is out of date; run generateTokenTable again."
+#endif
+
+static const char *const builtinTokenString[TOKEN_TABLE_LENGTH] =
+{
+    "PROGRAM",
+    "VAR",
+    "BEGIN",
+    "END",
+    "END.",
+    "INTEGER",
+    "FOR",
+    "READ",
+    "WRITE",
+    "TO",
+    "DO",
+    ";",
+    ":",
+    ",",
+    ":=",
+    "+",
+    "-",
+    "*",
+    "DIV",
+    "(",
+    ")",
+    "id",
+    "int"
+};
+
+static const int builtinTokenLength[TOKEN_TABLE_LENGTH] =
+{
+    7, 3, 5, 3, 4, 7, 3, 4, 5, 2, 2, 1, 1, 1, 2, 1,
+    1, 1, 3, 1, 1, 2, 3
+};
+
+static const int builtinTokenID[TOKEN_TABLE_LENGTH] =
+{
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+    17, 18, 19, 20, 21, 22, 23
+};
+
+static const unsigned int builtinKeywordSeed = 0x9E3779B9u;
+static const int builtinKeywordSlot[KEYWORD_HASH_SIZE] =
+{
+    -1, -1, -1, -1, 20, -1, 7, 14, 2, -1, 17, -1, -1, -1, -1, -1,
+    -1, -1, -1, 10, -1, 1, -1, -1, 15, -1, -1, -1, -1, -1, -1, -1,
+    -1, 4, -1, -1, 5, -1, -1, -1, -1, -1, -1, -1, -1, 12, -1, 18,
+    -1, -1, 8, -1, 6, 9, 0, 13, -1, -1, 3, 11, 16, -1, -1, 19
+};
+
+static const int builtinIdID = 22;
+static const int builtinIntID = 23;
+
+static const unsigned char builtinCharClass[256] =
+{
+    8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 10, 0, 0, 8, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    9, 0, 0, 0, 0, 0, 0, 0, 6, 8, 7, 8, 8, 8, 3, 0,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 4, 8, 0, 5, 0, 0,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static const unsigned char builtinAction[CLASS_COUNT][CLASS_COUNT] =
+{
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {1, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1},
+    {1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1},
+    {6, 6, 6, 6, 6, 6, 6, 6, 6, 5, 5},
+    {1, 1, 1, 1, 1, 4, 1, 1, 1, 1, 1},
+    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+    {1, 1, 1, 1, 1, 1, 1, 7, 1, 1, 1},
+    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+    {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2}
+};
+
+#endif